@@ -0,0 +1,124 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020 Mikhail Komarov <nemo@nil.foundation>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+// Publishes decoded parents caches into the shared cache directory and holds them locked in memory until
+// interrupted, so that sealing processes started with `parent_cache_shared` attach to them instead of each
+// reading the cache files on their own.
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <nil/filecoin/storage/proofs/core/configuration.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/shared_cache.hpp>
+
+using namespace nil::filecoin;
+
+/// The parents caches named by `paths`: files as they are, and every `*.cache` file of directories.
+std::vector<std::string> parent_caches(const std::vector<std::string> &paths) {
+    std::vector<std::string> caches;
+    for (const std::string &path : paths) {
+        if (!boost::filesystem::is_directory(path)) {
+            caches.push_back(path);
+            continue;
+        }
+        for (const boost::filesystem::directory_entry &entry : boost::filesystem::directory_iterator(path)) {
+            if (boost::filesystem::is_regular_file(entry.path()) && entry.path().extension() == ".cache") {
+                caches.push_back(entry.path().string());
+            }
+        }
+    }
+    return caches;
+}
+
+int main(int argc, char *argv[]) {
+    namespace po = boost::program_options;
+
+    std::string shared_dir;
+    std::vector<std::string> paths;
+    po::options_description options("Usage: parentcached [options] [cache-or-directory...]");
+    options.add_options()("help,h", "print this help")(
+        "shared-dir,d", po::value<std::string>(&shared_dir),
+        "directory of a memory file system (tmpfs or hugetlbfs) to publish into, parent_cache_shared_dir by default")(
+        "cache", po::value<std::vector<std::string>>(&paths),
+        "parents cache files, or directories of them, parent_cache by default");
+    po::positional_options_description positional;
+    positional.add("cache", -1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(options).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        std::cerr << e.what() << std::endl << options << std::endl;
+        return 2;
+    }
+    if (vm.count("help")) {
+        std::cout << options << std::endl;
+        return 0;
+    }
+    if (shared_dir.empty()) {
+        shared_dir = settings::SETTINGS.lock().parent_cache_shared_dir;
+    }
+    if (paths.empty()) {
+        paths.push_back(settings::SETTINGS.lock().parent_cache);
+    }
+
+    // Signals are only waited for once every copy is published and locked.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::vector<std::unique_ptr<stacked::vanilla::shared_parent_cache_publisher>> publishers;
+    try {
+        for (const std::string &cache : parent_caches(paths)) {
+            publishers.push_back(
+                std::make_unique<stacked::vanilla::shared_parent_cache_publisher>(shared_dir, cache));
+            std::cout << "published " << stacked::vanilla::shared_parent_cache_path(shared_dir, cache) << std::endl;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "could not publish parents cache: " << e.what() << std::endl;
+        return 1;
+    }
+    if (publishers.empty()) {
+        std::cerr << "no parents cache found" << std::endl;
+        return 1;
+    }
+
+    // The published files outlive this process, attached processes keep their mappings; only the pages stop
+    // being locked in memory.
+    int signal = 0;
+    sigwait(&signals, &signal);
+    std::cout << "stopping on signal " << signal << std::endl;
+    return 0;
+}
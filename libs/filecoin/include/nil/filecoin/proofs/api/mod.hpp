@@ -25,26 +25,45 @@
 #ifndef FILECOIN_SEAL_API_MOD_HPP
 #define FILECOIN_SEAL_API_MOD_HPP
 
+#include <algorithm>
+#include <optional>
 #include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <nil/filecoin/storage/proofs/core/sector.hpp>
+#include <nil/filecoin/storage/proofs/core/merkle/tree_d_builder.hpp>
 
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/params.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/proof.hpp>
 
 #include <nil/filecoin/proofs/types/bytes_amount.hpp>
 #include <nil/filecoin/proofs/types/piece_info.hpp>
 #include <nil/filecoin/proofs/types/porep_config.hpp>
 #include <nil/filecoin/proofs/types/mod.hpp>
+#include <nil/filecoin/proofs/unsealed_cache.hpp>
 
 #include <nil/filecoin/proofs/api/seal.hpp>
 #include <nil/filecoin/proofs/api/post.hpp>
 
 namespace nil {
     namespace filecoin {
+        /// The cache of unsealed sector copies of the process, created from the settings on first use. It is
+        /// shared by every tree type so that a single budget covers all copies.
+        inline proofs::unsealed_cache &shared_unsealed_cache() {
+            static proofs::unsealed_cache cache(settings::SETTINGS.lock().unsealed_cache,
+                                                settings::SETTINGS.lock().unsealed_cache_max_bytes);
+            return cache;
+        }
+
         /// Unseals the sector at `sealed_path` and returns the bytes for a piece
         /// whose first (unpadded) byte begins at `offset` and ends at `offset` plus
-        /// `num_bytes`, inclusive. Note that the entire sector is unsealed each time
-        /// this function is called.
+        /// `num_bytes`, inclusive. Only the requested range of the sector is read
+        /// and decoded, but all its layers are relabeled each time this function
+        /// is called.
         ///
         /// # Arguments
         ///
@@ -64,23 +83,33 @@ namespace nil {
                                const boost::filesystem::path &sealed_path, const boost::filesystem::path &output_path,
                                prover_id_type prover_id, sector_id_type sector_id, const commitment_type &comm_d,
                                const ticket_type &ticket, unpadded_byte_index offset, unpadded_bytes_amount num_bytes) {
-            std::ifstream f_in(sealed_path, std::ios::binary);
             std::ofstream f_out(output_path, std::ios::binary);
 
-            return unseal_range<MerkleTreeType>(config, cache_path, f_in, buf_f_out, prover_id, sector_id, comm_d,
+            return unseal_range<MerkleTreeType>(config, cache_path, sealed_path, f_out, prover_id, sector_id, comm_d,
                                                 ticket, offset, num_bytes);
         }
 
-        /// Unseals the sector read from `sealed_sector` and returns the bytes for a
-        /// piece whose first (unpadded) byte begins at `offset` and ends at `offset`
-        /// plus `num_bytes`, inclusive. Note that the entire sector is unsealed each
-        /// time this function is called.
+        /// Unseals the sector at `sealed_path` and writes the bytes for a piece
+        /// whose first (unpadded) byte begins at `offset` and ends at `offset` plus
+        /// `num_bytes`, inclusive, to `unsealed_output`.
+        ///
+        /// The labels are regenerated layer by layer, then only the sealed nodes
+        /// holding the requested bytes are read and decoded, batch by batch, so the
+        /// memory used is bounded by the two label buffers rather than by copies of
+        /// the sealed and unsealed sector. The last layer is labeled only up to the
+        /// end of the range. With the `unseal_cache_labels` setting, the layer before
+        /// it is cached in `cache_path`, so later unseals of the same sector only
+        /// label (part of) the last layer.
+        ///
+        /// With a non-zero `unsealed_cache_max_bytes` setting, the whole sector is
+        /// instead unsealed once into the `unsealed_cache` directory, and ranges of
+        /// sectors found there are read from the copy without any labeling.
         ///
         /// # Arguments
         ///
         /// * `porep_config` - porep configuration containing the sector size.
         /// * `cache_path` - path to the directory in which the sector data's Merkle Tree is written.
-        /// * `sealed_sector` - a byte source from which we read sealed sector data.
+        /// * `sealed_path` - path to the sealed sector file, read with positional reads.
         /// * `unsealed_output` - a byte sink to which we write unsealed, un-bit-padded sector bytes.
         /// * `prover_id` - the prover-id that sealed the sector.
         /// * `sector_id` - the sector-id of the sealed sector.
@@ -88,9 +117,9 @@ namespace nil {
         /// * `ticket` - the ticket that was used to generate the sector's replica-id.
         /// * `offset` - the byte index in the unsealed sector of the first byte that we want to read.
         /// * `num_bytes` - the number of bytes that we want to read.
-        template<typename Read, typename Write, typename MerkleTreeType>
+        template<typename MerkleTreeType, typename Write>
         unpadded_bytes_amount unseal_range(const porep_config &config, const boost::filesystem::path &cache_path,
-                                           const Read &sealed_sector, const Write &unsealed_output,
+                                           const boost::filesystem::path &sealed_path, Write &unsealed_output,
                                            const prover_id_type &prover_id, const sector_id_type &sector_id,
                                            const commitment_type &comm_d, const ticket_type &ticket,
                                            unpadded_byte_index offset, unpadded_bytes_amount num_bytes) {
@@ -106,37 +135,86 @@ namespace nil {
             replica_id_type replica_id = generate_replica_id<typename MerkleTreeType::hash_type>(
                 prover_id, sector_id, ticket, comm_d, config.porep_id);
 
-            std::vector<std::uint8_t> data;
-            sealed_sector.read_to_end(&mut data);
+            let pp =
+                public_params(PaddedBytesAmount::from(config), PoRepProofPartitions::from(config), config.porep_id);
 
             std::size_t base_tree_size = get_base_tree_size<DefaultBinaryTree>(config.sector_size);
             std::size_t base_tree_leafs = get_base_tree_leafs<DefaultBinaryTree>(base_tree_size);
-            // MT for original data is always named tree-d, and it will be
-            // referenced later in the process as such.
-            StoreConfig config =
+            // Labels kept for later unseals of this sector live next to its Merkle trees.
+            StoreConfig store_config =
                 StoreConfig(cache_path.as_ref(), cache_key::CommDTree.to_string(),
                             default_rows_to_discard(base_tree_leafs, <DefaultBinaryTree as MerkleTreeTrait>::Arity));
-            let pp =
-                public_params(PaddedBytesAmount::from(config), PoRepProofPartitions::from(config), config.porep_id);
-
-            padded_bytes_amount offset_padded = unpadded_bytes_amount::from(offset);
-            padded_bytes_amount num_bytes_padded = num_bytes;
 
-            let unsealed_all =
-                StackedDrg<MerkleTreeType, DefaultPieceHasher>::extract_all(pp, replica_id, data, config);
-            std::size_t start = offset_padded;
-            std::size_t end = start + num_bytes_padded;
-            let unsealed = &unsealed_all[start..end];
+            // Fr32 padding turns every 127 unpadded bytes into a 128-byte chunk of 4 nodes, which unpads on its
+            // own. Only the chunks holding the requested bytes are decoded, and since batches start on a chunk
+            // boundary, each one is unpadded and written as soon as it is decoded.
+            constexpr const std::uint64_t unpadded_chunk = 127;
+            constexpr const std::uint64_t chunk_nodes = 128 / NODE_SIZE;
+            static_assert(EXTRACT_BATCH_NODES % chunk_nodes == 0 &&
+                              proofs::UNSEALED_CACHE_READ_NODES % chunk_nodes == 0,
+                          "batches must hold whole fr32 chunks");
+
+            const std::uint64_t first_chunk = offset / unpadded_chunk;
+            const std::uint64_t last_chunk = (offset + num_bytes + unpadded_chunk - 1) / unpadded_chunk;
+
+            const std::uint64_t first_node = first_chunk * chunk_nodes;
+            const std::uint64_t num_nodes = (last_chunk - first_chunk) * chunk_nodes;
+
+            std::size_t written = 0;
+            const auto write_batch = [&](std::uint64_t first, std::uint64_t count, const std::uint8_t *data) {
+                // The unpadded bytes of the batch, clipped to the requested range.
+                const std::uint64_t batch_start = first / chunk_nodes * unpadded_chunk;
+                const std::uint64_t batch_end = (first + count) / chunk_nodes * unpadded_chunk;
+                const std::uint64_t start = std::max<std::uint64_t>(batch_start, offset);
+                const std::uint64_t end = std::min<std::uint64_t>(batch_end, offset + num_bytes);
+                const std::vector<std::uint8_t> unsealed(data, data + count * NODE_SIZE);
+                written += write_unpadded(unsealed, unsealed_output, start - batch_start, end - start);
+            };
+            const auto extract_nodes = [&](std::uint64_t first, std::uint64_t count, const auto &write) {
+                StackedDrg<MerkleTreeType, DefaultPieceHasher>().extract_range(
+                    pp.graph, pp.layer_challenges, replica_id, sealed_path, store_config, first, count, write);
+            };
+
+            // With a budget for unsealed copies, the whole sector is unsealed once into the cache and every
+            // range is then served from the copy.
+            const std::uint64_t cache_max_bytes = settings::SETTINGS.lock().unsealed_cache_max_bytes;
+            if (cache_max_bytes > 0) {
+                proofs::unsealed_cache &cache = shared_unsealed_cache();
+
+                const std::uint64_t sector_nodes = pp.graph.size();
+                std::optional<proofs::unsealed_cache::copy> cached =
+                    cache.find(sector_id, comm_d, sector_nodes * NODE_SIZE);
+                if (!cached) {
+                    cached = cache.insert(sector_id, comm_d, sector_nodes * NODE_SIZE, [&](const std::string &path) {
+                        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                        if (fd < 0) {
+                            throw std::system_error(errno, std::generic_category(), "could not create " + path);
+                        }
+                        try {
+                            extract_nodes(0, sector_nodes,
+                                          [&](std::uint64_t first, std::uint64_t count, const std::uint8_t *data) {
+                                              stacked::vanilla::cache_writer::pwrite_all(
+                                                  fd, data, count * NODE_SIZE, first * NODE_SIZE, path);
+                                          });
+                        } catch (...) {
+                            ::close(fd);
+                            throw;
+                        }
+                        ::close(fd);
+                    });
+                }
+                if (cached) {
+                    cached->read(first_node, num_nodes, write_batch);
+                    info !("unseal_range:finish");
+                    return written;
+                }
+            }
 
-            // If the call to `extract_range` was successful, the `unsealed` vector must
-            // have a length which equals `num_bytes_padded`. The byte at its 0-index
-            // byte will be the the byte at index `offset_padded` in the sealed sector.
-            std::size_t written =
-                write_unpadded(unsealed, unsealed_output, 0, num_bytes.into()).context("write_unpadded failed");
+            extract_nodes(first_node, num_nodes, write_batch);
 
             info !("unseal_range:finish");
             return written;
-        }    // namespace filecoin
+        }
 
         /// Generates a piece commitment for the provided byte source. Returns an error
         /// if the byte source produced more than `piece_size` bytes.
@@ -187,10 +265,13 @@ namespace nil {
         /// * `target` - a writer where we will write the processed piece bytes.
         /// * `piece_size` - the number of unpadded user-bytes which can be read from source before EOF.
         /// * `piece_lengths` - the number of bytes for each previous piece in the sector.
+        /// * `tree_d` - if set, is fed everything written to `target`, so that tree_d and comm_d are complete
+        ///   once the last piece of the sector is added and `finish()` is called.
         template<typename Read, typename Write>
         std::tuple<piece_info, unpadded_bytes_amount>
             add_piece(const Read &source, const Write &target, unpadded_bytes_amount piece_size,
-                      const std::vector<unpadded_bytes_amount> &piece_lengths) {
+                      const std::vector<unpadded_bytes_amount> &piece_lengths,
+                      merkletree::tree_d_builder *tree_d = nullptr) {
             info !("add_piece:start");
 
             let result = measure_op(
@@ -204,22 +285,30 @@ namespace nil {
                     let piece_alignment = crate::pieces::get_piece_alignment(written_bytes, piece_size);
                     Fr32Reader fr32_reader(source);
 
+                    const auto write = [&](const std::uint8_t *bytes, std::size_t size) {
+                        target.write_all(bytes, size);
+                        if (tree_d != nullptr) {
+                            tree_d->append(bytes, size);
+                        }
+                    };
+                    const std::vector<std::uint8_t> zeros(std::max(piece_alignment.left_bytes,
+                                                                   piece_alignment.right_bytes));
+
                     // write left alignment
-                    for (int i = 0; i < piece_alignment.left_bytes; i++) {
-                        target.write_all(&[0u8][..]);
-                    }
+                    write(zeros.data(), piece_alignment.left_bytes);
 
                     CommitmentReader commitment_reader(fr32_reader);
-                    let n = std::io::copy(&mut commitment_reader, &mut target)
-                                .context("failed to write and preprocess bytes");
+                    std::size_t n = 0;
+                    std::vector<std::uint8_t> buffer(1 << 20);
+                    for (std::size_t r; (r = commitment_reader.read(buffer)) != 0; n += r) {
+                        write(buffer.data(), r);
+                    }
 
                     assert(("add_piece: read 0 bytes before EOF from source", n != 0));
                     assert(("add_piece: invalid bytes amount written", n == piece_size));
 
                     // write right alignment
-                    for (int i = 0; i < piece_alignment.right_bytes; i++) {
-                        target.write_all(&[0u8][..]);
-                    }
+                    write(zeros.data(), piece_alignment.right_bytes);
 
                     let commitment = commitment_reader.finish();
                     std::array<std::uint8_t, 32> comm;
@@ -251,10 +340,12 @@ namespace nil {
         /// * `source` - a readable source of unprocessed piece bytes.
         /// * `target` - a writer where we will write the processed piece bytes.
         /// * `piece_size` - the number of unpadded user-bytes which can be read from source before EOF.
+        /// * `tree_d` - if set, is fed everything written to `target`, see `add_piece`.
         template<typename Read, typename Write>
         inline std::tuple<piece_info, unpadded_bytes_amount>
-            write_and_preprocess(const Read &source, const Write &target, unpadded_bytes_amount piece_size) {
-            return add_piece(source, target, piece_size);
+            write_and_preprocess(const Read &source, const Write &target, unpadded_bytes_amount piece_size,
+                                 merkletree::tree_d_builder *tree_d = nullptr) {
+            return add_piece(source, target, piece_size, {}, tree_d);
         }
 
         // Verifies if a DiskStore specified by a config (or set of 'required_configs' is consistent).
@@ -85,9 +85,21 @@ namespace nil {
                     // referenced later in the process as such.
                     StoreConfig config = StoreConfig(cache_path.as_ref(), cache_key::CommDTree.to_string(),
                                                      default_rows_to_discard(base_tree_leafs, BINARY_ARITY));
-                    BinaryMerkleTree<DefaultPieceHasher> data_tree =
-                        create_base_merkle_tree<BinaryMerkleTree<DefaultPieceHasher>>(Some(config.clone()),
-                                                                                      base_tree_leafs, &data);
+
+                    // tree_d is complete if it was built by a `tree_d_builder` while the sector was staged,
+                    // only a partially built tree is left under a temporary name.
+                    const boost::filesystem::path tree_d_path = StoreConfig::data_path(config.path, config.id);
+                    BinaryMerkleTree<DefaultPieceHasher> data_tree;
+                    if (boost::filesystem::exists(tree_d_path) &&
+                        boost::filesystem::file_size(tree_d_path) == base_tree_size * NODE_SIZE) {
+                        trace !("seal phase 1: using tree_d built during data ingest");
+                        DiskStore<DefaultPieceDomain> store =
+                            DiskStore::new_from_disk(base_tree_size, BINARY_ARITY, config);
+                        data_tree = BinaryMerkleTree<DefaultPieceHasher>::from_data_store(store, base_tree_leafs);
+                    } else {
+                        data_tree = create_base_merkle_tree<BinaryMerkleTree<DefaultPieceHasher>>(
+                            Some(config.clone()), base_tree_leafs, &data);
+                    }
                     drop(data);
 
                     config.size = data_tree.size();
@@ -25,73 +25,164 @@
 #ifndef FILECOIN_COMMITMENT_READER_HPP
 #define FILECOIN_COMMITMENT_READER_HPP
 
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include <nil/crypto3/hash/algorithm/hash.hpp>
 
+#include <nil/filecoin/storage/proofs/core/hasher/sha256.hpp>
+
 #include <nil/filecoin/proofs/constants.hpp>
 #include <nil/filecoin/proofs/pieces.hpp>
 
 namespace nil {
     namespace filecoin {
         namespace proofs {
-            template<typename R>
-            struct CommitmentReader {
-                /// Attempt to generate the next hash, but only if the buffers are full.
-                void try_hash() {
-                    if (buffer_pos < 63) {
-                        return;
-                    }
-
-                    // WARNING: keep in sync with DefaultPieceHasher and its .node impl
-                    typename DefaultPieceHasher::digest_type hash = crypto3::hash<DefaultPieceHasher>(buffer);
-                    current_tree.push_back(hash);
-                    buffer_pos = 0;
-
-                    // TODO: reduce hashes when possible, instead of keeping them around.
+            /// Number of leaf pairs `CommitmentReducer` hashes at once, 1 MiB of data.
+            constexpr static const std::size_t COMMITMENT_BATCH_PAIRS = 1 << 14;
+
+            /// Smallest chunk `compute_commitment` hands to one thread.
+            constexpr static const std::size_t COMMITMENT_MIN_CHUNK_SIZE = 1 << 24;
+
+            /// Folds the leaves of a piece tree into its root with O(log n) memory: a stack holds at most one
+            /// pending subtree root per height, and two subtrees are merged as soon as the second one is
+            /// complete, like the carries of a binary counter.
+            ///
+            /// Leaves are buffered in batches of `COMMITMENT_BATCH_PAIRS` pairs, which start at aligned
+            /// positions and are therefore complete subtrees, reduced in place with the multi-lane hasher.
+            struct CommitmentReducer {
+                typedef typename DefaultPieceHasher::digest_type digest_type;
+
+                CommitmentReducer() : buffer(COMMITMENT_BATCH_PAIRS * sha256::PAIR_SIZE) {
                 }
 
-                typename DefaultPieceHasher::digest_type finish() {
-                    assert(("not enough inputs provided", buffer_pos == 0));
-
-                    std::vector<typename DefaultPieceHasher::digest_type> current_row = current_tree, next_row;
-
-                    while (current_row.size() > 1) {
-                        for (int i = 0; i < current_row.size(); i += 2) {
-                            next_row.push_back(piece_hash(current_row[i], current_row[i + 1]));
+                /// Appends `size` bytes of leaves, in any chunking.
+                void append(const std::uint8_t *data, std::size_t size) {
+                    while (size > 0) {
+                        const std::size_t count = std::min(size, buffer.size() - buffer_pos);
+                        std::copy(data, data + count, buffer.begin() + buffer_pos);
+                        buffer_pos += count;
+                        data += count;
+                        size -= count;
+
+                        if (buffer_pos == buffer.size()) {
+                            std::size_t nodes = 2 * COMMITMENT_BATCH_PAIRS;
+                            std::size_t height = 0;
+                            for (; nodes > 1; nodes /= 2, ++height) {
+                                sha256::hash_pairs(buffer.data(), buffer.data(), nodes / 2);
+                            }
+                            push(buffer.data(), height);
+                            buffer_pos = 0;
                         }
-
-                        current_row = next_row;
-                        next_row.clear();
                     }
+                }
 
-                    assert(current_row.size() == 1);
+                /// Returns the root, the number of leaves must be a power of two.
+                digest_type finish() {
+                    assert(("not enough inputs provided", buffer_pos % sha256::PAIR_SIZE == 0));
 
-                    return current_row[0];
-                }
+                    const std::size_t pairs = buffer_pos / sha256::PAIR_SIZE;
+                    sha256::hash_pairs(buffer.data(), buffer.data(), pairs);
+                    for (std::size_t i = 0; i < pairs; ++i) {
+                        push(buffer.data() + i * sha256::NODE_SIZE, 1);
+                    }
+                    buffer_pos = 0;
 
-                void read(std::vector<std::uint8_t> &buf) {
-                    std::size_t start = buffer_pos;
-                    std::size_t left = 64 - buffer_pos;
-                    std::size_t end = start + std::min(left, buf.size());
+                    assert(("the number of leaves must be a power of two", stack.size() == 1));
+                    return stack.front().first;
+                }
 
-                    // fill the buffer as much as possible
-                    let r = source.read(&mut self.buffer[start..end]);
+            private:
+                /// Pushes the root of a complete subtree of `height`, merging it with its left sibling if that
+                /// is pending.
+                void push(const std::uint8_t *node, std::size_t height) {
+                    digest_type root;
+                    std::copy(node, node + sha256::NODE_SIZE, root.begin());
+                    while (!stack.empty() && stack.back().second == height) {
+                        root = sha256::hash_pair(stack.back().first.data(), root.data());
+                        stack.pop_back();
+                        ++height;
+                    }
+                    assert(("subtrees must be pushed in order", stack.empty() || stack.back().second > height));
+                    stack.emplace_back(root, height);
+                }
 
-                    // write the data, we read
-                    buf[..r].copy_from_slice(&buffer[start..start + r]);
+                std::vector<std::uint8_t> buffer;
+                std::size_t buffer_pos = 0;
+                /// Pending subtree roots with their heights, strictly decreasing.
+                std::vector<std::pair<digest_type, std::size_t>> stack;
+            };
 
-                    buffer_pos += r;
+            template<typename R>
+            struct CommitmentReader {
+                CommitmentReader(R source) : source(std::move(source)) {
+                }
 
-                    // try to hash
-                    try_hash();
+                typename DefaultPieceHasher::digest_type finish() {
+                    return reducer.finish();
+                }
 
+                std::size_t read(std::vector<std::uint8_t> &buf) {
+                    // Pass everything read through the reducer, which only keeps O(log n) nodes.
+                    const std::size_t r = source.read(buf);
+                    reducer.append(buf.data(), r);
                     return r;
                 }
 
                 R source;
-                std::array<std::uint8_t, 64> buffer;
-                std::size_t buffer_pos;
-                std::vector<typename DefaultPieceHasher::digest_type> current_tree;
+                CommitmentReducer reducer;
             };
+
+            /// Commitment of a piece which is entirely available in memory, e.g. mapped, of `size` bytes, a
+            /// power of two: chunks of it are reduced to their roots by up to `threads` threads in parallel,
+            /// the roots are then reduced to the commitment.
+            inline typename DefaultPieceHasher::digest_type compute_commitment(const std::uint8_t *data,
+                                                                              std::size_t size, std::size_t threads) {
+                assert(("piece size must be a power of two", size >= sha256::PAIR_SIZE && (size & (size - 1)) == 0));
+
+                // Power of two chunks, a few per thread to balance them.
+                std::size_t chunk = size;
+                while (chunk > COMMITMENT_MIN_CHUNK_SIZE && size / chunk < 4 * threads) {
+                    chunk /= 2;
+                }
+                const std::size_t chunks = size / chunk;
+
+                std::vector<typename DefaultPieceHasher::digest_type> roots(chunks);
+                std::atomic<std::size_t> next(0);
+                const auto work = [&]() {
+                    for (std::size_t i; (i = next.fetch_add(1)) < chunks;) {
+                        CommitmentReducer reducer;
+                        reducer.append(data + i * chunk, chunk);
+                        roots[i] = reducer.finish();
+                    }
+                };
+
+                std::vector<std::thread> workers;
+                try {
+                    for (std::size_t i = 1; i < std::min(threads, chunks); ++i) {
+                        workers.emplace_back(work);
+                    }
+                } catch (...) {
+                    // Stop the workers already started and join them before unwinding.
+                    next = chunks;
+                    for (std::thread &worker : workers) {
+                        worker.join();
+                    }
+                    throw;
+                }
+                work();
+                for (std::thread &worker : workers) {
+                    worker.join();
+                }
+
+                // The roots are the nodes of one level, reduce them in place.
+                for (std::size_t nodes = chunks; nodes > 1; nodes /= 2) {
+                    sha256::hash_pairs(roots.front().data(), roots.front().data(), nodes / 2);
+                }
+                return roots.front();
+            }
         }    // namespace proofs
     }        // namespace filecoin
 }    // namespace nil
@@ -25,9 +25,14 @@
 #ifndef FILECOIN_PROOFS_PIECES_HPP
 #define FILECOIN_PROOFS_PIECES_HPP
 
+#include <array>
+#include <type_traits>
 #include <unordered_map>
 
+#include <boost/assert.hpp>
+
 #include <nil/filecoin/storage/proofs/core/fr32.hpp>
+#include <nil/filecoin/storage/proofs/core/hasher/sha256.hpp>
 #include <nil/filecoin/storage/proofs/core/utilities.hpp>
 
 #include <nil/filecoin/proofs/types/sector_size.hpp>
@@ -70,6 +75,18 @@ namespace nil {
                                                           SecondInputIterator sfirst, SecondInputIterator slast) {
             using namespace nil::crypto3;
 
+            if constexpr (std::is_same<PieceHash, DefaultPieceHasher>::value) {
+                // Two nodes: the truncated node function of the piece hasher.
+                std::array<std::uint8_t, sha256::PAIR_SIZE> pair;
+                BOOST_ASSERT_MSG(std::distance(ffirst, flast) == sha256::NODE_SIZE &&
+                                     std::distance(sfirst, slast) == sha256::NODE_SIZE,
+                                 "piece hash inputs must be nodes");
+                std::copy(sfirst, slast, std::copy(ffirst, flast, pair.begin()));
+                typename PieceHash::digest_type node;
+                sha256::hash_pairs(pair.data(), node.data(), 1);
+                return node;
+            }
+
             accumulator_set<PieceHash> acc;
             hash<PieceHash>(ffirst, flast, acc);
             hash<PieceHash>(sfirst, slast, acc);
@@ -0,0 +1,347 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_PROOFS_UNSEALED_CACHE_HPP
+#define FILECOIN_PROOFS_UNSEALED_CACHE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_writer.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace proofs {
+            /// Nodes read at once from a cached copy, a whole number of 4-node fr32 chunks.
+            constexpr static const std::size_t UNSEALED_CACHE_READ_NODES = 1 << 16;
+
+            /// A directory of fr32-padded unsealed sector copies, keyed by sector id and comm_d, holding at most
+            /// `max_bytes` of them. The least recently used copies are evicted to make room for new ones.
+            ///
+            /// Copies are filled under a temporary name, synced and renamed into place, and their names record
+            /// their sizes. Copies left by an earlier process are adopted in the order of their modification
+            /// times, and a copy whose size differs from the recorded one, say one truncated by a crash, is
+            /// removed rather than served. Copies are handed out open, so one being read stays readable when it
+            /// is evicted meanwhile, and concurrent inserts of the same copy fill it once.
+            class unsealed_cache {
+            public:
+                typedef std::array<std::uint8_t, 32> commitment_type;
+
+                /// An open cached copy.
+                class copy {
+                public:
+                    copy(copy &&other) noexcept : fd(other.fd), path(std::move(other.path)) {
+                        other.fd = -1;
+                    }
+
+                    copy &operator=(copy &&other) noexcept {
+                        std::swap(fd, other.fd);
+                        std::swap(path, other.path);
+                        return *this;
+                    }
+
+                    copy(const copy &) = delete;
+                    copy &operator=(const copy &) = delete;
+
+                    ~copy() {
+                        if (fd >= 0) {
+                            ::close(fd);
+                        }
+                    }
+
+                    /// Passes nodes `[first_node, first_node + num_nodes)` of the copy to
+                    /// `write(first, count, data)`, `UNSEALED_CACHE_READ_NODES` at a time.
+                    template<typename Write>
+                    void read(std::uint64_t first_node, std::uint64_t num_nodes, const Write &write) const {
+                        constexpr const std::size_t node_size = 32;
+
+                        std::vector<std::uint8_t> batch(
+                            std::min<std::uint64_t>(num_nodes, UNSEALED_CACHE_READ_NODES) * node_size);
+                        std::uint64_t count = 0;
+                        for (std::uint64_t node = first_node; node < first_node + num_nodes; node += count) {
+                            count = std::min<std::uint64_t>(first_node + num_nodes - node, UNSEALED_CACHE_READ_NODES);
+                            stacked::vanilla::cache_writer::pread_all(fd, batch.data(), count * node_size,
+                                                                      node * node_size, path.string());
+                            write(node, count, static_cast<const std::uint8_t *>(batch.data()));
+                        }
+                    }
+
+                private:
+                    friend class unsealed_cache;
+
+                    copy(int fd, const boost::filesystem::path &path) : fd(fd), path(path) {
+                    }
+
+                    int fd;
+                    boost::filesystem::path path;
+                };
+
+                unsealed_cache(const boost::filesystem::path &directory, std::uint64_t max_bytes) :
+                    directory(directory), max_bytes(max_bytes) {
+                    boost::filesystem::create_directories(directory);
+
+                    std::vector<std::pair<std::time_t, boost::filesystem::path>> found;
+                    for (const boost::filesystem::directory_entry &entry :
+                         boost::filesystem::directory_iterator(directory)) {
+                        if (entry.path().extension() == ".unsealed") {
+                            const std::optional<std::uint64_t> size = recorded_size(entry.path());
+                            if (size && boost::filesystem::file_size(entry.path()) == *size) {
+                                found.emplace_back(boost::filesystem::last_write_time(entry.path()), entry.path());
+                                continue;
+                            }
+                            BOOST_LOG_TRIVIAL(warning)
+                                << "removing incomplete unsealed copy " << entry.path().filename().string();
+                            boost::system::error_code ec;
+                            boost::filesystem::remove(entry.path(), ec);
+                        } else if (entry.path().extension() == ".partial") {
+                            boost::system::error_code ec;
+                            boost::filesystem::remove(entry.path(), ec);
+                        }
+                    }
+                    std::sort(found.begin(), found.end());
+                    for (const auto &[time, path] : found) {
+                        entries[path.string()] = {*recorded_size(path), ++clock};
+                    }
+                    evict(max_bytes);
+                }
+
+                boost::filesystem::path entry_path(std::uint64_t sector_id, const commitment_type &comm_d,
+                                                   std::uint64_t size) const {
+                    static const char digits[] = "0123456789abcdef";
+                    std::string name = std::to_string(sector_id) + "-";
+                    for (std::uint8_t byte : comm_d) {
+                        name.push_back(digits[byte >> 4]);
+                        name.push_back(digits[byte & 0xf]);
+                    }
+                    return directory / (name + "-" + std::to_string(size) + ".unsealed");
+                }
+
+                /// Opens the copy of `size` bytes of the sector and marks it most recently used, or returns nothing
+                /// if it is not cached.
+                std::optional<copy> find(std::uint64_t sector_id, const commitment_type &comm_d, std::uint64_t size) {
+                    const boost::filesystem::path path = entry_path(sector_id, comm_d, size);
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    return open_entry(path);
+                }
+
+                /// Caches the copy of `size` bytes that `fill(path)` writes to `path`, evicting the least recently
+                /// used copies as needed, and opens it. Nothing is cached if the copy alone exceeds the budget.
+                ///
+                /// While a copy is being filled, other inserts of it wait and then open it rather than fill it
+                /// again. If the fill fails, the next of them fills it instead.
+                template<typename Fill>
+                std::optional<copy> insert(std::uint64_t sector_id, const commitment_type &comm_d,
+                                           std::uint64_t size, const Fill &fill) {
+                    if (size > max_bytes) {
+                        return std::nullopt;
+                    }
+
+                    const boost::filesystem::path path = entry_path(sector_id, comm_d, size);
+                    const std::string key = path.string();
+                    boost::filesystem::path partial_path = path;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        filled.wait(lock, [&]() { return filling.count(key) == 0; });
+                        std::optional<copy> found = open_entry(path);
+                        if (found) {
+                            return found;
+                        }
+
+                        // Copies being filled take their share of the budget too.
+                        filling[key] = size;
+                        evict(budget());
+                        partial_path += "." + std::to_string(++clock) + ".partial";
+                    }
+
+                    BOOST_LOG_TRIVIAL(info) << "caching unsealed copy " << path.filename().string();
+                    try {
+                        fill(partial_path.string());
+                        sync(partial_path, size);
+                        boost::filesystem::rename(partial_path, path);
+                    } catch (...) {
+                        boost::system::error_code ec;
+                        boost::filesystem::remove(partial_path, ec);
+                        const std::lock_guard<std::mutex> lock(mutex);
+                        filling.erase(key);
+                        filled.notify_all();
+                        throw;
+                    }
+
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    filling.erase(key);
+                    filled.notify_all();
+                    entries[key] = {size, ++clock};
+                    evict(budget(), key);
+                    return open_entry(path);
+                }
+
+                /// Bytes currently cached.
+                std::uint64_t size() const {
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    std::uint64_t total = 0;
+                    for (const auto &entry : entries) {
+                        total += entry.second.size;
+                    }
+                    return total;
+                }
+
+            private:
+                struct entry_type {
+                    std::uint64_t size;
+                    std::uint64_t used;
+                };
+
+                /// The size recorded in the name of the copy at `path`, or nothing if the name records none.
+                static std::optional<std::uint64_t> recorded_size(const boost::filesystem::path &path) {
+                    const std::string stem = path.stem().string();
+                    const std::size_t dash = stem.rfind('-');
+                    if (dash == std::string::npos) {
+                        return std::nullopt;
+                    }
+                    std::uint64_t size = 0;
+                    const char *last = stem.data() + stem.size();
+                    const auto [end, error] = std::from_chars(stem.data() + dash + 1, last, size);
+                    if (error != std::errc() || end != last) {
+                        return std::nullopt;
+                    }
+                    return size;
+                }
+
+                /// Checks that the filled copy at `path` holds `size` bytes and syncs it, so that the rename into
+                /// place cannot outlive its data in a crash.
+                static void sync(const boost::filesystem::path &path, std::uint64_t size) {
+                    const int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+                    if (fd < 0) {
+                        throw std::system_error(errno, std::generic_category(), "could not open " + path.string());
+                    }
+                    struct stat st;
+                    if (::fstat(fd, &st) != 0 || ::fsync(fd) != 0) {
+                        const int error = errno;
+                        ::close(fd);
+                        throw std::system_error(error, std::generic_category(), "could not sync " + path.string());
+                    }
+                    ::close(fd);
+                    if (static_cast<std::uint64_t>(st.st_size) != size) {
+                        throw std::runtime_error("unsealed copy " + path.filename().string() + " has " +
+                                                 std::to_string(st.st_size) + " bytes, expected " +
+                                                 std::to_string(size));
+                    }
+                }
+
+                /// Opens the copy at `path` if it is cached and complete and marks it most recently used. Must be
+                /// called with `mutex` held, so that the copy cannot be evicted before it is open.
+                std::optional<copy> open_entry(const boost::filesystem::path &path) {
+                    const auto entry = entries.find(path.string());
+                    if (entry == entries.end()) {
+                        return std::nullopt;
+                    }
+                    const int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+                    if (fd < 0) {
+                        BOOST_LOG_TRIVIAL(warning) << "dropping unreadable unsealed copy " << path.filename().string();
+                        entries.erase(entry);
+                        return std::nullopt;
+                    }
+                    struct stat st;
+                    if (::fstat(fd, &st) != 0 || static_cast<std::uint64_t>(st.st_size) != entry->second.size) {
+                        BOOST_LOG_TRIVIAL(warning) << "removing incomplete unsealed copy " << path.filename().string();
+                        ::close(fd);
+                        boost::system::error_code ec;
+                        boost::filesystem::remove(path, ec);
+                        entries.erase(entry);
+                        return std::nullopt;
+                    }
+                    entry->second.used = ++clock;
+                    return copy(fd, path);
+                }
+
+                /// Bytes left to the cached copies once the copies being filled are accounted for. Must be called
+                /// with `mutex` held.
+                std::uint64_t budget() const {
+                    std::uint64_t reserved = 0;
+                    for (const auto &entry : filling) {
+                        reserved += entry.second;
+                    }
+                    return max_bytes - std::min(reserved, max_bytes);
+                }
+
+                /// Removes the least recently used copies, other than `keep`, until at most `budget` bytes are
+                /// cached. Must be called with `mutex` held.
+                void evict(std::uint64_t budget, const std::string &keep = std::string()) {
+                    std::uint64_t total = 0;
+                    std::vector<std::pair<std::uint64_t, std::string>> order;
+                    for (const auto &entry : entries) {
+                        total += entry.second.size;
+                        order.emplace_back(entry.second.used, entry.first);
+                    }
+                    std::sort(order.begin(), order.end());
+
+                    for (const auto &[used, path] : order) {
+                        if (total <= budget) {
+                            break;
+                        }
+                        if (path == keep) {
+                            continue;
+                        }
+                        BOOST_LOG_TRIVIAL(info)
+                            << "evicting unsealed copy " << boost::filesystem::path(path).filename().string();
+                        boost::system::error_code ec;
+                        boost::filesystem::remove(path, ec);
+                        total -= entries[path].size;
+                        entries.erase(path);
+                    }
+                }
+
+                boost::filesystem::path directory;
+                std::uint64_t max_bytes;
+
+                mutable std::mutex mutex;
+                std::condition_variable filled;
+                std::map<std::string, entry_type> entries;
+                // Sizes of the copies being filled.
+                std::map<std::string, std::uint64_t> filling;
+                std::uint64_t clock = 0;
+            };
+        }    // namespace proofs
+    }        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_PROOFS_UNSEALED_CACHE_HPP
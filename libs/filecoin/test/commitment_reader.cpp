@@ -50,4 +50,31 @@ BOOST_AUTO_TEST_CASE(test_commitment_reader) {
     BOOST_CHECK_EQUAL(&commitment1[..], AsRef::<[u8]>::as_ref(&commitment2));
 }
 
+BOOST_AUTO_TEST_CASE(test_commitment_reducer_matches_full_tree) {
+    using namespace nil::filecoin;
+
+    // Several reducer batches, appended in uneven chunks.
+    const std::size_t size = 4 * proofs::COMMITMENT_BATCH_PAIRS * sha256::PAIR_SIZE;
+    std::vector<std::uint8_t> data(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<std::uint8_t>(i * 13 + (i >> 10));
+    }
+
+    proofs::CommitmentReducer reducer;
+    for (std::size_t offset = 0, chunk = 1; offset < size; offset += chunk, chunk = chunk * 3 % 100003 + 1) {
+        chunk = std::min(chunk, size - offset);
+        reducer.append(data.data() + offset, chunk);
+    }
+    const typename DefaultPieceHasher::digest_type streamed = reducer.finish();
+
+    std::vector<std::uint8_t> level = data;
+    for (std::size_t nodes = size / sha256::NODE_SIZE; nodes > 1; nodes /= 2) {
+        sha256::hash_pairs(level.data(), level.data(), nodes / 2);
+    }
+    BOOST_CHECK(std::equal(streamed.begin(), streamed.end(), level.begin()));
+
+    const typename DefaultPieceHasher::digest_type parallel = proofs::compute_commitment(data.data(), size, 4);
+    BOOST_CHECK(parallel == streamed);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,238 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE filecoin_unsealed_cache_test
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+#include <nil/filecoin/proofs/unsealed_cache.hpp>
+
+using namespace nil::filecoin::proofs;
+
+namespace {
+    unsealed_cache::commitment_type commitment(std::uint8_t seed) {
+        unsealed_cache::commitment_type comm_d;
+        for (std::size_t i = 0; i < comm_d.size(); ++i) {
+            comm_d[i] = static_cast<std::uint8_t>(seed + i);
+        }
+        return comm_d;
+    }
+
+    std::vector<std::uint8_t> sector_data(std::size_t size, std::uint8_t seed) {
+        std::vector<std::uint8_t> data(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<std::uint8_t>(seed * 31 + i * 7 + (i >> 8));
+        }
+        return data;
+    }
+
+    std::optional<unsealed_cache::copy> insert(unsealed_cache &cache, std::uint64_t sector_id,
+                                               const std::vector<std::uint8_t> &data) {
+        return cache.insert(sector_id, commitment(sector_id), data.size(), [&](const std::string &path) {
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char *>(data.data()), data.size());
+        });
+    }
+
+    std::vector<std::uint8_t> read_all(const unsealed_cache::copy &copy, std::uint64_t num_nodes) {
+        std::vector<std::uint8_t> read;
+        copy.read(0, num_nodes, [&](std::uint64_t first, std::uint64_t count, const std::uint8_t *nodes) {
+            read.insert(read.end(), nodes, nodes + count * 32);
+        });
+        return read;
+    }
+}    // namespace
+
+BOOST_AUTO_TEST_SUITE(filecoin_unsealed_cache_test_suite)
+
+BOOST_AUTO_TEST_CASE(test_unsealed_cache_serves_ranges) {
+    const boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    // Several read batches, read from an unaligned node.
+    const std::vector<std::uint8_t> data = sector_data(3 * UNSEALED_CACHE_READ_NODES * 32, 1);
+    unsealed_cache cache(directory, data.size());
+
+    BOOST_CHECK(!cache.find(1, commitment(1), data.size()));
+    const std::optional<unsealed_cache::copy> copy = insert(cache, 1, data);
+    BOOST_REQUIRE(copy);
+    BOOST_CHECK(cache.find(1, commitment(1), data.size()));
+
+    const std::uint64_t first_node = 5;
+    const std::uint64_t num_nodes = 2 * UNSEALED_CACHE_READ_NODES + 3;
+    std::vector<std::uint8_t> read;
+    std::uint64_t next = first_node;
+    copy->read(first_node, num_nodes, [&](std::uint64_t first, std::uint64_t count, const std::uint8_t *nodes) {
+        BOOST_CHECK_EQUAL(first, next);
+        next += count;
+        read.insert(read.end(), nodes, nodes + count * 32);
+    });
+    BOOST_CHECK(std::equal(read.begin(), read.end(), data.begin() + first_node * 32,
+                           data.begin() + (first_node + num_nodes) * 32));
+    BOOST_CHECK_EQUAL(read.size(), num_nodes * 32);
+
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(test_unsealed_cache_evicts_least_recently_used) {
+    const boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const std::size_t sector_size = 4096;
+
+    {
+        unsealed_cache cache(directory, 3 * sector_size);
+        for (std::uint64_t sector_id = 1; sector_id <= 3; ++sector_id) {
+            BOOST_REQUIRE(insert(cache, sector_id, sector_data(sector_size, sector_id)));
+        }
+        BOOST_CHECK_EQUAL(cache.size(), 3 * sector_size);
+
+        // Sector 1 becomes the most recently used, so sector 2 makes room for sector 4.
+        BOOST_CHECK(cache.find(1, commitment(1), sector_size));
+        BOOST_REQUIRE(insert(cache, 4, sector_data(sector_size, 4)));
+        BOOST_CHECK(cache.find(1, commitment(1), sector_size));
+        BOOST_CHECK(!cache.find(2, commitment(2), sector_size));
+        BOOST_CHECK(cache.find(3, commitment(3), sector_size));
+        BOOST_CHECK(cache.find(4, commitment(4), sector_size));
+        BOOST_CHECK(!boost::filesystem::exists(cache.entry_path(2, commitment(2), sector_size)));
+        BOOST_CHECK_EQUAL(cache.size(), 3 * sector_size);
+
+        // A copy larger than the whole budget is not cached.
+        BOOST_CHECK(!insert(cache, 5, sector_data(4 * sector_size, 5)));
+        BOOST_CHECK_EQUAL(cache.size(), 3 * sector_size);
+    }
+
+    // A new cache adopts the copies on disk, and trims them to its budget.
+    unsealed_cache reopened(directory, 2 * sector_size);
+    BOOST_CHECK_EQUAL(reopened.size(), 2 * sector_size);
+
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(test_unsealed_cache_copy_outlives_eviction) {
+    const boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const std::size_t sector_size = 4096;
+    unsealed_cache cache(directory, sector_size);
+
+    const std::vector<std::uint8_t> data = sector_data(sector_size, 1);
+    const std::optional<unsealed_cache::copy> copy = insert(cache, 1, data);
+    BOOST_REQUIRE(copy);
+
+    // Sector 2 evicts sector 1, whose open copy still reads in full.
+    BOOST_REQUIRE(insert(cache, 2, sector_data(sector_size, 2)));
+    BOOST_CHECK(!cache.find(1, commitment(1), sector_size));
+    BOOST_CHECK(read_all(*copy, sector_size / 32) == data);
+
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(test_unsealed_cache_fills_once) {
+    const boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const std::size_t sector_size = 4096;
+    unsealed_cache cache(directory, 2 * sector_size);
+
+    const std::vector<std::uint8_t> data = sector_data(sector_size, 1);
+    std::atomic<std::size_t> fills(0);
+    std::atomic<std::size_t> copies(0);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < 8; ++i) {
+        threads.emplace_back([&]() {
+            const std::optional<unsealed_cache::copy> copy =
+                cache.insert(1, commitment(1), data.size(), [&](const std::string &path) {
+                    ++fills;
+                    // Long enough for the other threads to ask for the copy while it is filled.
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    std::ofstream out(path, std::ios::binary);
+                    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+                });
+            if (copy && read_all(*copy, sector_size / 32) == data) {
+                ++copies;
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(fills, 1);
+    BOOST_CHECK_EQUAL(copies, threads.size());
+    BOOST_CHECK_EQUAL(cache.size(), sector_size);
+
+    // A failed fill leaves nothing behind, and the next insert fills the copy.
+    BOOST_CHECK_THROW(cache.insert(2, commitment(2), data.size(),
+                                   [&](const std::string &path) { throw std::runtime_error("fill failed"); }),
+                      std::runtime_error);
+    BOOST_CHECK(!cache.find(2, commitment(2), sector_size));
+    BOOST_CHECK(insert(cache, 2, data));
+
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(test_unsealed_cache_rejects_truncated_copies) {
+    const boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const std::size_t sector_size = 4096;
+    const std::vector<std::uint8_t> data = sector_data(sector_size, 1);
+
+    {
+        unsealed_cache cache(directory, 3 * sector_size);
+
+        // A fill that writes less than the copy is not cached.
+        BOOST_CHECK_THROW(cache.insert(1, commitment(1), sector_size,
+                                       [&](const std::string &path) {
+                                           std::ofstream out(path, std::ios::binary);
+                                           out.write(reinterpret_cast<const char *>(data.data()), sector_size / 2);
+                                       }),
+                          std::runtime_error);
+        BOOST_CHECK(!cache.find(1, commitment(1), sector_size));
+
+        // A copy truncated after it was cached is removed, so that the sector is unsealed again.
+        BOOST_REQUIRE(insert(cache, 1, data));
+        boost::filesystem::resize_file(cache.entry_path(1, commitment(1), sector_size), sector_size / 2);
+        BOOST_CHECK(!cache.find(1, commitment(1), sector_size));
+        BOOST_CHECK(!boost::filesystem::exists(cache.entry_path(1, commitment(1), sector_size)));
+        BOOST_CHECK_EQUAL(cache.size(), 0);
+
+        BOOST_REQUIRE(insert(cache, 1, data));
+        BOOST_REQUIRE(insert(cache, 2, sector_data(sector_size, 2)));
+        boost::filesystem::resize_file(cache.entry_path(2, commitment(2), sector_size), sector_size / 2);
+    }
+
+    // A new cache adopts the complete copy only.
+    unsealed_cache reopened(directory, 3 * sector_size);
+    BOOST_CHECK_EQUAL(reopened.size(), sector_size);
+    BOOST_CHECK(!boost::filesystem::exists(reopened.entry_path(2, commitment(2), sector_size)));
+    const std::optional<unsealed_cache::copy> copy = reopened.find(1, commitment(1), sector_size);
+    BOOST_REQUIRE(copy);
+    BOOST_CHECK(read_all(*copy, sector_size / 32) == data);
+
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
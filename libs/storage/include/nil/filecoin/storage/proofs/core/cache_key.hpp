@@ -58,6 +58,10 @@ namespace std {
     std::string label_layer(std::size_t layer) {
         return "layer-" + std::to_string(layer);
     }
+
+    std::string unseal_label_layer(std::size_t layer) {
+        return "unseal-layer-" + std::to_string(layer);
+    }
 }    // namespace std
 
 #endif
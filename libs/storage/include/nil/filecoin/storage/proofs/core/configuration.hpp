@@ -51,17 +51,33 @@ namespace nil {
             bool use_gpu_column_builder = true;
             std::uint32_t max_gpu_column_batch_size = 400000;
             std::uint32_t column_write_batch_size = 262114;
+            std::uint32_t cpu_column_batch_size = 65536;
+            bool use_batched_column_hasher = false;
+            std::uint32_t column_read_threads = 16;
+            std::uint32_t prove_layers_threads = 16;
             bool use_gpu_tree_builder = true;
             std::uint32_t gpu_for_parallel_tree_r = 0;
             std::uint32_t max_gpu_tree_batch_size = 700000;
             std::uint32_t rows_to_discard = 2;
             std::uint32_t sdr_parents_cache_size = 2048;
+            bool sdr_parents_cache_prefetch = true;
+            bool maximize_caching = true;
             std::string parameter_cache = "/var/tmp/filecoin-proof-parameters/";
             std::string parent_cache = cache("filecoin-parents");
+            std::uint32_t parent_cache_format = 1;
+            bool parent_cache_shared = false;
+            std::string parent_cache_shared_dir = "/dev/shm";
             bool use_multicore_sdr = true;
             std::uint32_t multicore_sdr_producers = 3;
             std::uint32_t multicore_sdr_producer_stride = 128;
             std::uint32_t multicore_sdr_lookahead = 800;
+            bool sdr_huge_pages = true;
+            std::int32_t sdr_numa_node = -1;
+            bool sdr_resume = true;
+            bool sdr_layer_direct_io = true;
+            bool unseal_cache_labels = false;
+            std::string unsealed_cache = cache("filecoin-unsealed");
+            std::uint64_t unsealed_cache_max_bytes = 0;
         };
     }    // namespace filecoin
 }    // namespace nil
@@ -0,0 +1,204 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_BLAKE2B_COMPRESS_HPP
+#define FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_BLAKE2B_COMPRESS_HPP
+
+#include <array>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILECOIN_BLAKE2B_X86_KERNELS
+#endif
+
+namespace nil {
+    namespace filecoin {
+        namespace blake2b {
+            /// Unkeyed BLAKE2b-128 of 16-byte messages, the shape hashed by the Feistel round function.
+            /// Such a message fits a single block, so the whole hash is one compression with a constant
+            /// parameter block; bit-compatible with `crypto3::hashes::blake2b<128>`.
+            ///
+            /// Messages and digests are passed as little-endian 64-bit words.
+
+            /// Number of messages hashed by `hash128_x4`.
+            constexpr static const std::size_t LANES = 4;
+
+            constexpr static const std::size_t MESSAGE_BYTES = 16;
+
+            typedef std::array<std::uint64_t, 2> words_type;
+
+            constexpr static const std::uint64_t IV[8] = {0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b,
+                                                          0xa54ff53a5f1d36f1, 0x510e527fade682d1, 0x9b05688c2b3e6c1f,
+                                                          0x1f83d9abfb41bd6b, 0x5be0cd19137e2179};
+
+            constexpr static const std::uint8_t SIGMA[12][16] = {
+                {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+                {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+                {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+                {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+                {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+                {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+                {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+                {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+                {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+                {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+                {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+                {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+            /// First state word: IV[0] ^ 0x0101kknn with no key and a 16-byte digest.
+            constexpr static const std::uint64_t H0 = IV[0] ^ 0x01010000 ^ 16;
+
+            namespace detail {
+                inline std::uint64_t rotr(std::uint64_t x, unsigned n) {
+                    return (x >> n) | (x << (64 - n));
+                }
+
+                inline void mix(std::uint64_t *v, std::size_t a, std::size_t b, std::size_t c, std::size_t d,
+                                std::uint64_t x, std::uint64_t y) {
+                    v[a] = v[a] + v[b] + x;
+                    v[d] = rotr(v[d] ^ v[a], 32);
+                    v[c] = v[c] + v[d];
+                    v[b] = rotr(v[b] ^ v[c], 24);
+                    v[a] = v[a] + v[b] + y;
+                    v[d] = rotr(v[d] ^ v[a], 16);
+                    v[c] = v[c] + v[d];
+                    v[b] = rotr(v[b] ^ v[c], 63);
+                }
+            }    // namespace detail
+
+            /// BLAKE2b-128 of a single 16-byte message.
+            inline words_type hash128(const words_type &message) {
+                const std::uint64_t m[16] = {message[0], message[1]};
+                // Single final block of MESSAGE_BYTES bytes: t0 = MESSAGE_BYTES and f0 = ~0.
+                std::uint64_t v[16] = {H0,    IV[1], IV[2], IV[3], IV[4], IV[5], IV[6], IV[7],
+                                       IV[0], IV[1], IV[2], IV[3], IV[4] ^ MESSAGE_BYTES, IV[5], ~IV[6], IV[7]};
+
+                for (std::size_t round = 0; round < 12; ++round) {
+                    const std::uint8_t *s = SIGMA[round];
+                    detail::mix(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+                    detail::mix(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+                    detail::mix(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+                    detail::mix(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+                    detail::mix(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+                    detail::mix(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+                    detail::mix(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+                    detail::mix(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+                }
+
+                return {H0 ^ v[0] ^ v[8], IV[1] ^ v[1] ^ v[9]};
+            }
+
+#ifdef FILECOIN_BLAKE2B_X86_KERNELS
+            namespace detail {
+                __attribute__((target("avx2"))) inline __m256i rotr4(__m256i x, int n) {
+                    return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n));
+                }
+
+                __attribute__((target("avx2"))) inline void mix4(__m256i *v, std::size_t a, std::size_t b,
+                                                                 std::size_t c, std::size_t d, __m256i x,
+                                                                 __m256i y) {
+                    v[a] = _mm256_add_epi64(_mm256_add_epi64(v[a], v[b]), x);
+                    v[d] = rotr4(_mm256_xor_si256(v[d], v[a]), 32);
+                    v[c] = _mm256_add_epi64(v[c], v[d]);
+                    v[b] = rotr4(_mm256_xor_si256(v[b], v[c]), 24);
+                    v[a] = _mm256_add_epi64(_mm256_add_epi64(v[a], v[b]), y);
+                    v[d] = rotr4(_mm256_xor_si256(v[d], v[a]), 16);
+                    v[c] = _mm256_add_epi64(v[c], v[d]);
+                    v[b] = rotr4(_mm256_xor_si256(v[b], v[c]), 63);
+                }
+            }    // namespace detail
+
+            /// BLAKE2b-128 of four 16-byte messages, one per 64-bit AVX2 lane.
+            __attribute__((target("avx2"))) inline void hash128_avx2_x4(const words_type messages[LANES],
+                                                                       words_type digests[LANES]) {
+                const __m256i zero = _mm256_setzero_si256();
+                __m256i m[16];
+                for (std::size_t i = 0; i < 16; ++i) {
+                    m[i] = zero;
+                }
+                m[0] = _mm256_setr_epi64x(messages[0][0], messages[1][0], messages[2][0], messages[3][0]);
+                m[1] = _mm256_setr_epi64x(messages[0][1], messages[1][1], messages[2][1], messages[3][1]);
+
+                // Single final block of MESSAGE_BYTES bytes: t0 = MESSAGE_BYTES and f0 = ~0.
+                const std::uint64_t init[16] = {H0,    IV[1], IV[2], IV[3], IV[4], IV[5], IV[6], IV[7],
+                                                IV[0], IV[1], IV[2], IV[3], IV[4] ^ MESSAGE_BYTES, IV[5], ~IV[6], IV[7]};
+                __m256i v[16];
+                for (std::size_t i = 0; i < 16; ++i) {
+                    v[i] = _mm256_set1_epi64x(static_cast<long long>(init[i]));
+                }
+
+                for (std::size_t round = 0; round < 12; ++round) {
+                    const std::uint8_t *s = SIGMA[round];
+                    detail::mix4(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+                    detail::mix4(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+                    detail::mix4(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+                    detail::mix4(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+                    detail::mix4(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+                    detail::mix4(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+                    detail::mix4(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+                    detail::mix4(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+                }
+
+                alignas(32) std::uint64_t h0[LANES], h1[LANES];
+                _mm256_store_si256(reinterpret_cast<__m256i *>(h0),
+                                   _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(H0)),
+                                                    _mm256_xor_si256(v[0], v[8])));
+                _mm256_store_si256(reinterpret_cast<__m256i *>(h1),
+                                   _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(IV[1])),
+                                                    _mm256_xor_si256(v[1], v[9])));
+                for (std::size_t lane = 0; lane < LANES; ++lane) {
+                    digests[lane] = {h0[lane], h1[lane]};
+                }
+            }
+#endif
+
+            inline bool has_avx2() {
+#ifdef FILECOIN_BLAKE2B_X86_KERNELS
+                static const bool supported = __builtin_cpu_supports("avx2");
+                return supported;
+#else
+                return false;
+#endif
+            }
+
+            /// BLAKE2b-128 of four 16-byte messages, vectorized where AVX2 is available.
+            inline void hash128_x4(const words_type messages[LANES], words_type digests[LANES]) {
+#ifdef FILECOIN_BLAKE2B_X86_KERNELS
+                if (has_avx2()) {
+                    hash128_avx2_x4(messages, digests);
+                    return;
+                }
+#endif
+                for (std::size_t lane = 0; lane < LANES; ++lane) {
+                    digests[lane] = hash128(messages[lane]);
+                }
+            }
+        }    // namespace blake2b
+    }        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_BLAKE2B_COMPRESS_HPP
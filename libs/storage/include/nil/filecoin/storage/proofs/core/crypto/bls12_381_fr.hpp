@@ -0,0 +1,193 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_BLS12_381_FR_HPP
+#define FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_BLS12_381_FR_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace nil {
+    namespace filecoin {
+        namespace fr {
+            /// Scalar field of BLS12-381, p = 0x73eda753...ffffffff00000001, in Montgomery form with
+            /// R = 2^256: four little-endian 64-bit limbs holding a * R mod p, always fully reduced.
+
+            typedef std::array<std::uint64_t, 4> element;
+
+            constexpr static const element MODULUS = {0xffffffff00000001, 0x53bda402fffe5bfe, 0x3339d80809a1d805,
+                                                      0x73eda753299d7d48};
+            /// R mod p, the Montgomery form of one.
+            constexpr static const element ONE = {0x00000001fffffffe, 0x5884b7fa00034802, 0x998c4fefecbc4ff5,
+                                                  0x1824b159acc5056f};
+            /// R^2 mod p.
+            constexpr static const element R2 = {0xc999e990f3f29c6d, 0x2b6cedcb87925c23, 0x05d314967254398f,
+                                                 0x0748d9d99f59ff11};
+            /// -p^-1 mod 2^64.
+            constexpr static const std::uint64_t INV = 0xfffffffeffffffff;
+
+            constexpr static const std::size_t BYTES = 32;
+
+            namespace detail {
+                typedef unsigned __int128 wide_type;
+
+                /// Returns whether `a >= b` as 256-bit integers.
+                inline bool geq(const element &a, const element &b) {
+                    for (std::size_t i = 4; i-- > 0;) {
+                        if (a[i] != b[i]) {
+                            return a[i] > b[i];
+                        }
+                    }
+                    return true;
+                }
+
+                /// `a - b` as 256-bit integers, `a >= b`.
+                inline element sub_raw(const element &a, const element &b) {
+                    element r;
+                    std::uint64_t borrow = 0;
+                    for (std::size_t i = 0; i < 4; ++i) {
+                        const wide_type d = wide_type(a[i]) - b[i] - borrow;
+                        r[i] = static_cast<std::uint64_t>(d);
+                        borrow = static_cast<std::uint64_t>(d >> 64) & 1;
+                    }
+                    return r;
+                }
+            }    // namespace detail
+
+            inline element add(const element &a, const element &b) {
+                element r;
+                std::uint64_t carry = 0;
+                for (std::size_t i = 0; i < 4; ++i) {
+                    const detail::wide_type s = detail::wide_type(a[i]) + b[i] + carry;
+                    r[i] = static_cast<std::uint64_t>(s);
+                    carry = static_cast<std::uint64_t>(s >> 64);
+                }
+                // p < 2^255, so the sum of two reduced elements never carries out.
+                return detail::geq(r, MODULUS) ? detail::sub_raw(r, MODULUS) : r;
+            }
+
+            inline element sub(const element &a, const element &b) {
+                if (detail::geq(a, b)) {
+                    return detail::sub_raw(a, b);
+                }
+                return add(a, detail::sub_raw(MODULUS, b));
+            }
+
+            /// Montgomery product a * b / R mod p (CIOS).
+            inline element mul(const element &a, const element &b) {
+                std::array<std::uint64_t, 6> t = {};
+                for (std::size_t i = 0; i < 4; ++i) {
+                    std::uint64_t carry = 0;
+                    for (std::size_t j = 0; j < 4; ++j) {
+                        const detail::wide_type s = detail::wide_type(a[i]) * b[j] + t[j] + carry;
+                        t[j] = static_cast<std::uint64_t>(s);
+                        carry = static_cast<std::uint64_t>(s >> 64);
+                    }
+                    detail::wide_type s = detail::wide_type(t[4]) + carry;
+                    t[4] = static_cast<std::uint64_t>(s);
+                    t[5] = static_cast<std::uint64_t>(s >> 64);
+
+                    const std::uint64_t m = t[0] * INV;
+                    s = detail::wide_type(m) * MODULUS[0] + t[0];
+                    carry = static_cast<std::uint64_t>(s >> 64);
+                    for (std::size_t j = 1; j < 4; ++j) {
+                        s = detail::wide_type(m) * MODULUS[j] + t[j] + carry;
+                        t[j - 1] = static_cast<std::uint64_t>(s);
+                        carry = static_cast<std::uint64_t>(s >> 64);
+                    }
+                    s = detail::wide_type(t[4]) + carry;
+                    t[3] = static_cast<std::uint64_t>(s);
+                    t[4] = t[5] + static_cast<std::uint64_t>(s >> 64);
+                }
+
+                const element r = {t[0], t[1], t[2], t[3]};
+                return detail::geq(r, MODULUS) ? detail::sub_raw(r, MODULUS) : r;
+            }
+
+            inline element square(const element &a) {
+                return mul(a, a);
+            }
+
+            /// a^exponent, `exponent` as a plain little-endian integer.
+            inline element pow(const element &a, const element &exponent) {
+                element r = ONE;
+                for (std::size_t i = 256; i-- > 0;) {
+                    r = square(r);
+                    if ((exponent[i / 64] >> (i % 64)) & 1) {
+                        r = mul(r, a);
+                    }
+                }
+                return r;
+            }
+
+            /// a^-1 = a^(p - 2), zero for zero.
+            inline element inverse(const element &a) {
+                return pow(a, detail::sub_raw(MODULUS, element {2, 0, 0, 0}));
+            }
+
+            /// Montgomery form of the canonical integer `value < p`.
+            inline element from_canonical(const element &value) {
+                return mul(value, R2);
+            }
+
+            inline element from_u64(std::uint64_t value) {
+                return from_canonical(element {value, 0, 0, 0});
+            }
+
+            inline element to_canonical(const element &a) {
+                return mul(a, element {1, 0, 0, 0});
+            }
+
+            /// Reads the canonical 32-byte little-endian representation, returns false if it is not
+            /// below p.
+            inline bool from_bytes(const std::uint8_t *in, element &out) {
+                element value;
+                for (std::size_t i = 0; i < 4; ++i) {
+                    value[i] = 0;
+                    for (std::size_t j = 0; j < 8; ++j) {
+                        value[i] |= std::uint64_t(in[i * 8 + j]) << (8 * j);
+                    }
+                }
+                if (detail::geq(value, MODULUS)) {
+                    return false;
+                }
+                out = from_canonical(value);
+                return true;
+            }
+
+            inline void to_bytes(const element &a, std::uint8_t *out) {
+                const element value = to_canonical(a);
+                for (std::size_t i = 0; i < 4; ++i) {
+                    for (std::size_t j = 0; j < 8; ++j) {
+                        out[i * 8 + j] = static_cast<std::uint8_t>(value[i] >> (8 * j));
+                    }
+                }
+            }
+        }    // namespace fr
+    }        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_BLS12_381_FR_HPP
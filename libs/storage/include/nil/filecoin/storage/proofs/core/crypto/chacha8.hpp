@@ -0,0 +1,206 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_CHACHA8_HPP
+#define FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_CHACHA8_HPP
+
+#include <array>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILECOIN_CHACHA8_X86_KERNELS
+#endif
+
+namespace nil {
+    namespace filecoin {
+        namespace chacha8 {
+            /// ChaCha with 8 rounds, keyed by a 32-byte seed with a 64-bit block counter starting at zero
+            /// and a zero stream id, i.e. the keystream of `ChaCha8Rng::from_seed` used by DRG parent
+            /// sampling. `next_u64` of that generator consumes two consecutive keystream words, low word
+            /// first.
+
+            constexpr static const std::size_t BLOCK_WORDS = 16;
+
+            /// Number of independent keys processed by `blocks_x8`.
+            constexpr static const std::size_t LANES = 8;
+
+            typedef std::array<std::uint32_t, 8> key_type;
+            typedef std::array<std::uint32_t, BLOCK_WORDS> block_type;
+
+            constexpr static const std::uint32_t SIGMA[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+
+            namespace detail {
+                inline std::uint32_t rotl(std::uint32_t x, unsigned n) {
+                    return (x << n) | (x >> (32 - n));
+                }
+
+                inline void quarter_round(std::uint32_t &a, std::uint32_t &b, std::uint32_t &c, std::uint32_t &d) {
+                    a += b;
+                    d = rotl(d ^ a, 16);
+                    c += d;
+                    b = rotl(b ^ c, 12);
+                    a += b;
+                    d = rotl(d ^ a, 8);
+                    c += d;
+                    b = rotl(b ^ c, 7);
+                }
+            }    // namespace detail
+
+            /// Builds the key of a 32-byte seed (little-endian words).
+            inline key_type key_from_seed(const std::uint8_t *seed) {
+                key_type key;
+                for (std::size_t i = 0; i < 8; ++i) {
+                    key[i] = std::uint32_t(seed[4 * i]) | std::uint32_t(seed[4 * i + 1]) << 8 |
+                             std::uint32_t(seed[4 * i + 2]) << 16 | std::uint32_t(seed[4 * i + 3]) << 24;
+                }
+                return key;
+            }
+
+            /// Keystream block `counter` of `key`.
+            inline void block(const key_type &key, std::uint64_t counter, block_type &out) {
+                block_type x = {SIGMA[0],
+                                SIGMA[1],
+                                SIGMA[2],
+                                SIGMA[3],
+                                key[0],
+                                key[1],
+                                key[2],
+                                key[3],
+                                key[4],
+                                key[5],
+                                key[6],
+                                key[7],
+                                static_cast<std::uint32_t>(counter),
+                                static_cast<std::uint32_t>(counter >> 32),
+                                0,
+                                0};
+                const block_type input = x;
+
+                for (std::size_t round = 0; round < 8; round += 2) {
+                    detail::quarter_round(x[0], x[4], x[8], x[12]);
+                    detail::quarter_round(x[1], x[5], x[9], x[13]);
+                    detail::quarter_round(x[2], x[6], x[10], x[14]);
+                    detail::quarter_round(x[3], x[7], x[11], x[15]);
+                    detail::quarter_round(x[0], x[5], x[10], x[15]);
+                    detail::quarter_round(x[1], x[6], x[11], x[12]);
+                    detail::quarter_round(x[2], x[7], x[8], x[13]);
+                    detail::quarter_round(x[3], x[4], x[9], x[14]);
+                }
+
+                for (std::size_t i = 0; i < BLOCK_WORDS; ++i) {
+                    out[i] = x[i] + input[i];
+                }
+            }
+
+#ifdef FILECOIN_CHACHA8_X86_KERNELS
+            namespace detail {
+                __attribute__((target("avx2"))) inline __m256i rotl8(__m256i x, int n) {
+                    return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+                }
+
+                __attribute__((target("avx2"))) inline void quarter_round8(__m256i &a, __m256i &b, __m256i &c,
+                                                                           __m256i &d) {
+                    a = _mm256_add_epi32(a, b);
+                    d = rotl8(_mm256_xor_si256(d, a), 16);
+                    c = _mm256_add_epi32(c, d);
+                    b = rotl8(_mm256_xor_si256(b, c), 12);
+                    a = _mm256_add_epi32(a, b);
+                    d = rotl8(_mm256_xor_si256(d, a), 8);
+                    c = _mm256_add_epi32(c, d);
+                    b = rotl8(_mm256_xor_si256(b, c), 7);
+                }
+            }    // namespace detail
+
+            /// Block `counter` of eight keys at once, one key per 32-bit AVX2 lane.
+            __attribute__((target("avx2"))) inline void block_avx2_x8(const key_type keys[LANES],
+                                                                     std::uint64_t counter,
+                                                                     block_type out[LANES]) {
+                __m256i x[BLOCK_WORDS];
+                for (std::size_t i = 0; i < 4; ++i) {
+                    x[i] = _mm256_set1_epi32(static_cast<int>(SIGMA[i]));
+                }
+                for (std::size_t i = 0; i < 8; ++i) {
+                    x[4 + i] = _mm256_setr_epi32(keys[0][i], keys[1][i], keys[2][i], keys[3][i], keys[4][i],
+                                                 keys[5][i], keys[6][i], keys[7][i]);
+                }
+                x[12] = _mm256_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(counter)));
+                x[13] = _mm256_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(counter >> 32)));
+                x[14] = _mm256_setzero_si256();
+                x[15] = _mm256_setzero_si256();
+
+                __m256i input[BLOCK_WORDS];
+                for (std::size_t i = 0; i < BLOCK_WORDS; ++i) {
+                    input[i] = x[i];
+                }
+
+                for (std::size_t round = 0; round < 8; round += 2) {
+                    detail::quarter_round8(x[0], x[4], x[8], x[12]);
+                    detail::quarter_round8(x[1], x[5], x[9], x[13]);
+                    detail::quarter_round8(x[2], x[6], x[10], x[14]);
+                    detail::quarter_round8(x[3], x[7], x[11], x[15]);
+                    detail::quarter_round8(x[0], x[5], x[10], x[15]);
+                    detail::quarter_round8(x[1], x[6], x[11], x[12]);
+                    detail::quarter_round8(x[2], x[7], x[8], x[13]);
+                    detail::quarter_round8(x[3], x[4], x[9], x[14]);
+                }
+
+                for (std::size_t i = 0; i < BLOCK_WORDS; ++i) {
+                    alignas(32) std::uint32_t lanes[LANES];
+                    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi32(x[i], input[i]));
+                    for (std::size_t lane = 0; lane < LANES; ++lane) {
+                        out[lane][i] = lanes[lane];
+                    }
+                }
+            }
+#endif
+
+            inline bool has_avx2() {
+#ifdef FILECOIN_CHACHA8_X86_KERNELS
+                static const bool supported = __builtin_cpu_supports("avx2");
+                return supported;
+#else
+                return false;
+#endif
+            }
+
+            /// Block `counter` of eight keys, vectorized where AVX2 is available.
+            inline void block_x8(const key_type keys[LANES], std::uint64_t counter, block_type out[LANES]) {
+#ifdef FILECOIN_CHACHA8_X86_KERNELS
+                if (has_avx2()) {
+                    block_avx2_x8(keys, counter, out);
+                    return;
+                }
+#endif
+                for (std::size_t lane = 0; lane < LANES; ++lane) {
+                    block(keys[lane], counter, out[lane]);
+                }
+            }
+        }    // namespace chacha8
+    }        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_CHACHA8_HPP
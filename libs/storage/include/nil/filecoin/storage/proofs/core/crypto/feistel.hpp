@@ -27,6 +27,8 @@
 #include <nil/crypto3/hash/algorithm/hash.hpp>
 #include <nil/crypto3/hash/blake2b.hpp>
 
+#include <nil/filecoin/storage/proofs/core/crypto/blake2b_compress.hpp>
+
 namespace nil {
     namespace filecoin {
 
@@ -169,6 +171,97 @@ namespace nil {
             return u;
         }
 
+        namespace detail {
+            inline Index byte_swap(Index x) {
+                Index r = 0;
+                for (std::size_t i = 0; i < sizeof(Index); ++i) {
+                    r = (r << 8) | ((x >> (8 * i)) & 0xff);
+                }
+                return r;
+            }
+        }    // namespace detail
+
+        /// `feistel` of `blake2b::LANES` right halves under the same key at once. The 16-byte
+        /// `right || key` blocks are big-endian, the BLAKE2b kernels take little-endian words.
+        inline void feistel_x4(const Index right[blake2b::LANES], Index key, Index right_mask,
+                               Index out[blake2b::LANES]) {
+            blake2b::words_type messages[blake2b::LANES];
+            blake2b::words_type digests[blake2b::LANES];
+            for (std::size_t lane = 0; lane < blake2b::LANES; ++lane) {
+                messages[lane] = {detail::byte_swap(right[lane]), detail::byte_swap(key)};
+            }
+            blake2b::hash128_x4(messages, digests);
+            for (std::size_t lane = 0; lane < blake2b::LANES; ++lane) {
+                out[lane] = detail::byte_swap(digests[lane][0]) & right_mask;
+            }
+        }
+
+        /// `encode` of `blake2b::LANES` indices at once.
+        inline void encode_x4(const Index index[blake2b::LANES], const std::vector<Index> &keys,
+                              FeistelPrecomputed precomputed, Index out[blake2b::LANES]) {
+            Index left[blake2b::LANES], right[blake2b::LANES], f[blake2b::LANES];
+            for (std::size_t lane = 0; lane < blake2b::LANES; ++lane) {
+                left[lane] = (index[lane] & std::get<0>(precomputed)) >> std::get<2>(precomputed);
+                right[lane] = index[lane] & std::get<1>(precomputed);
+            }
+
+            for (std::size_t round = 0; round < FEISTEL_ROUNDS; ++round) {
+                feistel_x4(right, keys[round], std::get<1>(precomputed), f);
+                for (std::size_t lane = 0; lane < blake2b::LANES; ++lane) {
+                    const Index l = right[lane];
+                    right[lane] = left[lane] ^ f[lane];
+                    left[lane] = l;
+                }
+            }
+
+            for (std::size_t lane = 0; lane < blake2b::LANES; ++lane) {
+                out[lane] = (left[lane] << std::get<2>(precomputed)) | right[lane];
+            }
+        }
+
+        // Batched `permute`: `out[i] = permute(num_elements, indices[i], keys, precomputed)`.
+        //
+        // Indices are encoded `blake2b::LANES` at a time. A lane whose value is still out of range
+        // keeps cycle walking on the next pass while lanes that landed in range are refilled with the
+        // next pending index, so a long walk only occupies its own lane.
+        void permute_batch(Index num_elements, const Index *indices, std::size_t count, const std::vector<Index> &keys,
+                           FeistelPrecomputed precomputed, Index *out) {
+            constexpr std::size_t LANES = blake2b::LANES;
+
+            Index values[LANES] = {}, encoded[LANES];
+            std::size_t slots[LANES];
+            bool active[LANES] = {};
+
+            std::size_t next = 0, pending = 0;
+            for (;;) {
+                for (std::size_t lane = 0; lane < LANES; ++lane) {
+                    if (!active[lane] && next < count) {
+                        slots[lane] = next;
+                        values[lane] = indices[next++];
+                        active[lane] = true;
+                        ++pending;
+                    }
+                }
+                if (pending == 0) {
+                    break;
+                }
+
+                encode_x4(values, keys, precomputed, encoded);
+
+                for (std::size_t lane = 0; lane < LANES; ++lane) {
+                    if (!active[lane]) {
+                        continue;
+                    }
+                    values[lane] = encoded[lane];
+                    if (encoded[lane] < num_elements) {
+                        out[slots[lane]] = encoded[lane];
+                        active[lane] = false;
+                        --pending;
+                    }
+                }
+            }
+        }
+
         // Inverts the `permute` result to its starting value for the same `key`.
         Index invert_permute(Index num_elements, Index index, const std::vector<Index> &keys,
                              FeistelPrecomputed precomputed) {
@@ -0,0 +1,474 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_POSEIDON_BATCH_HPP
+#define FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_POSEIDON_BATCH_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+#include <nil/filecoin/storage/proofs/core/crypto/bls12_381_fr.hpp>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FILECOIN_POSEIDON_X86_KERNELS
+#endif
+
+namespace nil {
+    namespace filecoin {
+        namespace poseidon {
+            /// Poseidon over the BLS12-381 scalar field as used for Filecoin trees and columns: x^5 S-box,
+            /// 8 full rounds, the standard-strength number of partial rounds for the width, round constants
+            /// from the Grain LFSR of the reference parameter generation and the Cauchy MDS matrix
+            /// 1 / (i + (j + width)). The state starts as the domain tag 2^arity - 1 followed by the inputs,
+            /// the hash is the second state element after the permutation.
+            ///
+            /// Inputs and outputs of the batch functions are canonical 32-byte little-endian field elements,
+            /// `Arity` inputs per hash, one hash after the other. Batches are hashed 8 at a time with AVX-512
+            /// IFMA (radix 2^52 Montgomery arithmetic) where available and with the scalar 4x64-bit
+            /// Montgomery arithmetic of `fr` otherwise.
+
+            constexpr static const std::size_t FULL_ROUNDS = 8;
+
+            /// Number of hashes of one AVX-512 IFMA batch.
+            constexpr static const std::size_t LANES = 8;
+
+            constexpr std::size_t partial_rounds(std::size_t width) {
+                return width == 3 ? 55 : width == 5 ? 56 : width == 9 ? 57 : width == 12 ? 57 : 0;
+            }
+
+            namespace detail {
+                /// Grain LFSR of the Poseidon reference parameter generation, in self-shrinking mode.
+                class grain {
+                public:
+                    grain(std::size_t field_size, std::size_t width, std::size_t full_rounds,
+                          std::size_t partial_rounds) {
+                        // GF(p) | x^alpha S-box | field size | width | full rounds | partial rounds | 30 ones
+                        push(1, 2);
+                        push(0, 4);
+                        push(field_size, 12);
+                        push(width, 12);
+                        push(full_rounds, 10);
+                        push(partial_rounds, 10);
+                        push((1U << 30) - 1, 30);
+                        for (std::size_t i = 0; i < 160; ++i) {
+                            step();
+                        }
+                    }
+
+                    bool next_bit() {
+                        for (;;) {
+                            if (step()) {
+                                return step();
+                            }
+                            step();
+                        }
+                    }
+
+                    /// Next field element: `field_size` bits, most significant first, rejected until below p.
+                    fr::element next_element(std::size_t field_size) {
+                        for (;;) {
+                            fr::element value = {};
+                            for (std::size_t i = field_size; i-- > 0;) {
+                                value[i / 64] |= std::uint64_t(next_bit()) << (i % 64);
+                            }
+                            if (!fr::detail::geq(value, fr::MODULUS)) {
+                                return fr::from_canonical(value);
+                            }
+                        }
+                    }
+
+                private:
+                    void push(std::uint64_t value, std::size_t bits) {
+                        for (std::size_t i = bits; i-- > 0;) {
+                            state_[size_++] = (value >> i) & 1;
+                        }
+                    }
+
+                    bool step() {
+                        const auto bit = [&](std::size_t i) { return state_[(head_ + i) % STATE_BITS]; };
+                        const bool next = bit(62) ^ bit(51) ^ bit(38) ^ bit(23) ^ bit(13) ^ bit(0);
+                        state_[head_] = next;
+                        head_ = (head_ + 1) % STATE_BITS;
+                        return next;
+                    }
+
+                    constexpr static const std::size_t STATE_BITS = 80;
+
+                    std::array<bool, STATE_BITS> state_ = {};
+                    std::size_t size_ = 0;
+                    std::size_t head_ = 0;
+                };
+
+                typedef std::array<std::uint64_t, 5> limbs52_type;
+
+                constexpr static const std::uint64_t MASK52 = (std::uint64_t(1) << 52) - 1;
+
+                inline limbs52_type to_limbs52(const fr::element &value) {
+                    return {value[0] & MASK52, ((value[0] >> 52) | (value[1] << 12)) & MASK52,
+                            ((value[1] >> 40) | (value[2] << 24)) & MASK52,
+                            ((value[2] >> 28) | (value[3] << 36)) & MASK52, value[3] >> 16};
+                }
+
+                inline fr::element from_limbs52(const limbs52_type &limbs) {
+                    return {limbs[0] | (limbs[1] << 52), (limbs[1] >> 12) | (limbs[2] << 40),
+                            (limbs[2] >> 24) | (limbs[3] << 28), (limbs[3] >> 36) | (limbs[4] << 16)};
+                }
+
+                /// Radix 2^52 Montgomery form (R = 2^260) of the Montgomery element `a`.
+                inline limbs52_type to_montgomery52(const fr::element &a) {
+                    static const fr::element r52 = fr::pow(fr::from_u64(2), fr::element {260, 0, 0, 0});
+                    return to_limbs52(fr::to_canonical(fr::mul(a, r52)));
+                }
+            }    // namespace detail
+
+            template<std::size_t Arity>
+            struct parameters {
+                constexpr static const std::size_t WIDTH = Arity + 1;
+                constexpr static const std::size_t PARTIAL_ROUNDS = partial_rounds(WIDTH);
+                constexpr static const std::size_t ROUNDS = FULL_ROUNDS + PARTIAL_ROUNDS;
+
+                static_assert(PARTIAL_ROUNDS != 0, "unsupported Poseidon arity");
+
+                static const parameters &instance() {
+                    static const parameters params;
+                    return params;
+                }
+
+                std::array<fr::element, ROUNDS * WIDTH> round_constants;
+                std::array<std::array<fr::element, WIDTH>, WIDTH> mds;
+                fr::element domain_tag;
+
+                /// The same constants in radix 2^52 Montgomery form for the IFMA kernel.
+                std::array<detail::limbs52_type, ROUNDS * WIDTH> round_constants52;
+                std::array<std::array<detail::limbs52_type, WIDTH>, WIDTH> mds52;
+                detail::limbs52_type domain_tag52;
+
+            private:
+                parameters() {
+                    detail::grain grain(255, WIDTH, FULL_ROUNDS, PARTIAL_ROUNDS);
+                    for (std::size_t i = 0; i < round_constants.size(); ++i) {
+                        round_constants[i] = grain.next_element(255);
+                        round_constants52[i] = detail::to_montgomery52(round_constants[i]);
+                    }
+                    for (std::size_t i = 0; i < WIDTH; ++i) {
+                        for (std::size_t j = 0; j < WIDTH; ++j) {
+                            mds[i][j] = fr::inverse(fr::from_u64(i + j + WIDTH));
+                            mds52[i][j] = detail::to_montgomery52(mds[i][j]);
+                        }
+                    }
+                    domain_tag = fr::from_u64((std::uint64_t(1) << Arity) - 1);
+                    domain_tag52 = detail::to_montgomery52(domain_tag);
+                }
+            };
+
+            /// Applies the permutation to `state`, in Montgomery form.
+            template<std::size_t Arity>
+            void permute(std::array<fr::element, Arity + 1> &state) {
+                typedef parameters<Arity> params_type;
+                const params_type &params = params_type::instance();
+
+                for (std::size_t round = 0; round < params_type::ROUNDS; ++round) {
+                    const bool full = round < FULL_ROUNDS / 2 || round >= FULL_ROUNDS / 2 + params_type::PARTIAL_ROUNDS;
+                    for (std::size_t i = 0; i < params_type::WIDTH; ++i) {
+                        state[i] = fr::add(state[i], params.round_constants[round * params_type::WIDTH + i]);
+                    }
+                    for (std::size_t i = 0; i < (full ? params_type::WIDTH : 1); ++i) {
+                        const fr::element square = fr::square(state[i]);
+                        state[i] = fr::mul(fr::square(square), state[i]);
+                    }
+
+                    std::array<fr::element, Arity + 1> mixed = {};
+                    for (std::size_t j = 0; j < params_type::WIDTH; ++j) {
+                        for (std::size_t i = 0; i < params_type::WIDTH; ++i) {
+                            mixed[j] = fr::add(mixed[j], fr::mul(state[i], params.mds[i][j]));
+                        }
+                    }
+                    state = mixed;
+                }
+            }
+
+            /// Hashes `Arity` field elements in Montgomery form.
+            template<std::size_t Arity>
+            fr::element hash(const fr::element *inputs) {
+                std::array<fr::element, Arity + 1> state;
+                state[0] = parameters<Arity>::instance().domain_tag;
+                std::copy(inputs, inputs + Arity, state.begin() + 1);
+                permute<Arity>(state);
+                return state[1];
+            }
+
+            template<std::size_t Arity>
+            void hash_batch_scalar(const std::uint8_t *inputs, std::size_t count, std::uint8_t *out) {
+                std::array<fr::element, Arity> elements;
+                for (std::size_t n = 0; n < count; ++n) {
+                    for (std::size_t i = 0; i < Arity; ++i) {
+                        if (!fr::from_bytes(inputs + (n * Arity + i) * fr::BYTES, elements[i])) {
+                            throw std::invalid_argument("poseidon input is not a canonical field element");
+                        }
+                    }
+                    fr::to_bytes(hash<Arity>(elements.data()), out + n * fr::BYTES);
+                }
+            }
+
+#ifdef FILECOIN_POSEIDON_X86_KERNELS
+            namespace detail {
+                /// 8 field elements, one per lane, as 5 radix 2^52 limbs.
+                struct element_x8 {
+                    __m512i limbs[5];
+                };
+
+                constexpr static const limbs52_type MODULUS52 = {0xfffff00000001, 0x2fffe5bfefff, 0x9a1d80553bda4,
+                                                                 0x7d483339d8080, 0x73eda753299d};
+                constexpr static const limbs52_type TWICE_MODULUS52 = {0xffffe00000002, 0x5fffcb7fdfff,
+                                                                       0x343b00aa77b48, 0xfa906673b0101,
+                                                                       0xe7db4ea6533a};
+                /// -p^-1 mod 2^52.
+                constexpr static const std::uint64_t INV52 = 0xffffeffffffff;
+                /// 2^520 mod p, to enter the radix 2^52 Montgomery form.
+                constexpr static const limbs52_type R52_SQUARED = {0x99103f29c6cf0, 0x57927663d999e,
+                                                                   0xa1c0ed631138b, 0x3c829f7715f1b,
+                                                                   0x9ff646cc027};
+
+                __attribute__((target("avx512f,avx512ifma"))) inline element_x8 broadcast(const limbs52_type &a) {
+                    element_x8 r;
+                    for (std::size_t k = 0; k < 5; ++k) {
+                        r.limbs[k] = _mm512_set1_epi64(a[k]);
+                    }
+                    return r;
+                }
+
+                /// Subtracts `q` from the lanes of `a` which are not below it.
+                __attribute__((target("avx512f,avx512ifma"))) inline element_x8 reduce_once(const element_x8 &a,
+                                                                                           const limbs52_type &q) {
+                    const __m512i mask = _mm512_set1_epi64(MASK52);
+                    element_x8 d;
+                    __m512i borrow = _mm512_setzero_si512();
+                    for (std::size_t k = 0; k < 5; ++k) {
+                        const __m512i diff =
+                            _mm512_sub_epi64(_mm512_sub_epi64(a.limbs[k], _mm512_set1_epi64(q[k])), borrow);
+                        borrow = _mm512_srli_epi64(diff, 63);
+                        d.limbs[k] = _mm512_and_si512(diff, mask);
+                    }
+                    const __mmask8 no_borrow = _mm512_cmpeq_epi64_mask(borrow, _mm512_setzero_si512());
+                    element_x8 r;
+                    for (std::size_t k = 0; k < 5; ++k) {
+                        r.limbs[k] = _mm512_mask_blend_epi64(no_borrow, a.limbs[k], d.limbs[k]);
+                    }
+                    return r;
+                }
+
+                /// Adds the product a * b to the 10-limb accumulator `wide` without reducing it.
+                __attribute__((target("avx512f,avx512ifma"))) inline void mul_acc(__m512i wide[10],
+                                                                                 const element_x8 &a,
+                                                                                 const element_x8 &b) {
+                    for (std::size_t i = 0; i < 5; ++i) {
+                        for (std::size_t j = 0; j < 5; ++j) {
+                            wide[i + j] = _mm512_madd52lo_epu64(wide[i + j], a.limbs[i], b.limbs[j]);
+                            wide[i + j + 1] = _mm512_madd52hi_epu64(wide[i + j + 1], a.limbs[i], b.limbs[j]);
+                        }
+                    }
+                }
+
+                /// Montgomery reduction wide / 2^260 mod p of an accumulator below 24 p^2, result below 2p.
+                __attribute__((target("avx512f,avx512ifma"))) inline element_x8 reduce(__m512i wide[10]) {
+                    const __m512i inv = _mm512_set1_epi64(INV52);
+                    for (std::size_t i = 0; i < 5; ++i) {
+                        const __m512i m = _mm512_madd52lo_epu64(_mm512_setzero_si512(), wide[i], inv);
+                        for (std::size_t j = 0; j < 5; ++j) {
+                            const __m512i p = _mm512_set1_epi64(MODULUS52[j]);
+                            wide[i + j] = _mm512_madd52lo_epu64(wide[i + j], m, p);
+                            wide[i + j + 1] = _mm512_madd52hi_epu64(wide[i + j + 1], m, p);
+                        }
+                        wide[i + 1] = _mm512_add_epi64(wide[i + 1], _mm512_srli_epi64(wide[i], 52));
+                    }
+
+                    const __m512i mask = _mm512_set1_epi64(MASK52);
+                    element_x8 r;
+                    for (std::size_t k = 0; k < 4; ++k) {
+                        wide[6 + k] = _mm512_add_epi64(wide[6 + k], _mm512_srli_epi64(wide[5 + k], 52));
+                        r.limbs[k] = _mm512_and_si512(wide[5 + k], mask);
+                    }
+                    r.limbs[4] = wide[9];
+                    return reduce_once(r, TWICE_MODULUS52);
+                }
+
+                __attribute__((target("avx512f,avx512ifma"))) inline element_x8 mul(const element_x8 &a,
+                                                                                   const element_x8 &b) {
+                    __m512i wide[10];
+                    for (__m512i &limb : wide) {
+                        limb = _mm512_setzero_si512();
+                    }
+                    mul_acc(wide, a, b);
+                    return reduce(wide);
+                }
+
+                /// a + b for lanes below 2p, result below 2p.
+                __attribute__((target("avx512f,avx512ifma"))) inline element_x8 add(const element_x8 &a,
+                                                                                   const element_x8 &b) {
+                    const __m512i mask = _mm512_set1_epi64(MASK52);
+                    element_x8 r;
+                    __m512i carry = _mm512_setzero_si512();
+                    for (std::size_t k = 0; k < 5; ++k) {
+                        const __m512i sum = _mm512_add_epi64(_mm512_add_epi64(a.limbs[k], b.limbs[k]), carry);
+                        carry = _mm512_srli_epi64(sum, 52);
+                        r.limbs[k] = k < 4 ? _mm512_and_si512(sum, mask) : sum;
+                    }
+                    return reduce_once(r, TWICE_MODULUS52);
+                }
+
+                template<std::size_t Arity>
+                __attribute__((target("avx512f,avx512ifma"))) void hash_x8(const std::uint8_t *inputs,
+                                                                          std::uint8_t *out) {
+                    typedef parameters<Arity> params_type;
+                    constexpr std::size_t WIDTH = params_type::WIDTH;
+                    const params_type &params = params_type::instance();
+
+                    // Load the inputs, lane `l` holding hash `l`, and enter the Montgomery form.
+                    std::array<element_x8, WIDTH> state;
+                    state[0] = broadcast(params.domain_tag52);
+                    const element_x8 r52_squared = broadcast(R52_SQUARED);
+                    for (std::size_t i = 0; i < Arity; ++i) {
+                        alignas(64) std::uint64_t limbs[5][LANES];
+                        for (std::size_t lane = 0; lane < LANES; ++lane) {
+                            const std::uint8_t *bytes = inputs + (lane * Arity + i) * fr::BYTES;
+                            fr::element value;
+                            for (std::size_t w = 0; w < 4; ++w) {
+                                value[w] = 0;
+                                for (std::size_t b = 0; b < 8; ++b) {
+                                    value[w] |= std::uint64_t(bytes[w * 8 + b]) << (8 * b);
+                                }
+                            }
+                            if (fr::detail::geq(value, fr::MODULUS)) {
+                                throw std::invalid_argument("poseidon input is not a canonical field element");
+                            }
+                            const limbs52_type split = to_limbs52(value);
+                            for (std::size_t k = 0; k < 5; ++k) {
+                                limbs[k][lane] = split[k];
+                            }
+                        }
+                        element_x8 value;
+                        for (std::size_t k = 0; k < 5; ++k) {
+                            value.limbs[k] = _mm512_load_si512(limbs[k]);
+                        }
+                        state[i + 1] = mul(value, r52_squared);
+                    }
+
+                    for (std::size_t round = 0; round < params_type::ROUNDS; ++round) {
+                        const bool full =
+                            round < FULL_ROUNDS / 2 || round >= FULL_ROUNDS / 2 + params_type::PARTIAL_ROUNDS;
+                        for (std::size_t i = 0; i < WIDTH; ++i) {
+                            state[i] = add(state[i], broadcast(params.round_constants52[round * WIDTH + i]));
+                        }
+                        for (std::size_t i = 0; i < (full ? WIDTH : 1); ++i) {
+                            const element_x8 square = mul(state[i], state[i]);
+                            state[i] = mul(mul(square, square), state[i]);
+                        }
+
+                        // One reduction per output element: the sum of WIDTH products stays below 24 p^2.
+                        std::array<element_x8, WIDTH> mixed;
+                        for (std::size_t j = 0; j < WIDTH; ++j) {
+                            __m512i wide[10];
+                            for (__m512i &limb : wide) {
+                                limb = _mm512_setzero_si512();
+                            }
+                            for (std::size_t i = 0; i < WIDTH; ++i) {
+                                mul_acc(wide, state[i], broadcast(params.mds52[i][j]));
+                            }
+                            mixed[j] = reduce(wide);
+                        }
+                        state = mixed;
+                    }
+
+                    // Leave the Montgomery form and store the second element of every lane.
+                    __m512i wide[10];
+                    for (std::size_t k = 0; k < 10; ++k) {
+                        wide[k] = k < 5 ? state[1].limbs[k] : _mm512_setzero_si512();
+                    }
+                    const element_x8 result = reduce_once(reduce(wide), MODULUS52);
+                    alignas(64) std::uint64_t limbs[5][LANES];
+                    for (std::size_t k = 0; k < 5; ++k) {
+                        _mm512_store_si512(limbs[k], result.limbs[k]);
+                    }
+                    for (std::size_t lane = 0; lane < LANES; ++lane) {
+                        const fr::element value =
+                            from_limbs52({limbs[0][lane], limbs[1][lane], limbs[2][lane], limbs[3][lane],
+                                          limbs[4][lane]});
+                        for (std::size_t w = 0; w < 4; ++w) {
+                            for (std::size_t b = 0; b < 8; ++b) {
+                                out[lane * fr::BYTES + w * 8 + b] = static_cast<std::uint8_t>(value[w] >> (8 * b));
+                            }
+                        }
+                    }
+                }
+            }    // namespace detail
+#endif
+
+            inline bool has_ifma() {
+#ifdef FILECOIN_POSEIDON_X86_KERNELS
+                static const bool supported =
+                    __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+                return supported;
+#else
+                return false;
+#endif
+            }
+
+            /// Hashes `count` groups of `Arity` canonical 32-byte field elements into `out`.
+            template<std::size_t Arity>
+            void hash_batch(const std::uint8_t *inputs, std::size_t count, std::uint8_t *out) {
+                std::size_t done = 0;
+#ifdef FILECOIN_POSEIDON_X86_KERNELS
+                if (has_ifma()) {
+                    for (; done + LANES <= count; done += LANES) {
+                        detail::hash_x8<Arity>(inputs + done * Arity * fr::BYTES, out + done * fr::BYTES);
+                    }
+                }
+#endif
+                hash_batch_scalar<Arity>(inputs + done * Arity * fr::BYTES, count - done, out + done * fr::BYTES);
+            }
+
+            /// `hash_batch` for an arity known at run time, the column heights of the supported sector sizes.
+            inline void hash_columns(std::size_t arity, const std::uint8_t *inputs, std::size_t count,
+                                     std::uint8_t *out) {
+                switch (arity) {
+                    case 2:
+                        return hash_batch<2>(inputs, count, out);
+                    case 8:
+                        return hash_batch<8>(inputs, count, out);
+                    case 11:
+                        return hash_batch<11>(inputs, count, out);
+                    default:
+                        throw std::invalid_argument("unsupported poseidon column arity");
+                }
+            }
+        }    // namespace poseidon
+    }        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_POSEIDON_BATCH_HPP
@@ -0,0 +1,398 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_SHA256_COMPRESS_HPP
+#define FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_SHA256_COMPRESS_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define FILECOIN_SHA256_X86_KERNELS
+#endif
+
+namespace nil {
+    namespace filecoin {
+        namespace sha256 {
+            /// Raw SHA-256 block compression kernels. They operate on already padded messages and are
+            /// bit-compatible with `crypto3::hashes::sha2<256>`; callers with fixed-shape inputs (labels,
+            /// tree nodes) build the padding once and skip the generic accumulator machinery.
+
+            constexpr static const std::size_t BLOCK_SIZE = 64;
+            constexpr static const std::size_t DIGEST_SIZE = 32;
+
+            /// Number of independent messages hashed by `compress_x8`.
+            constexpr static const std::size_t LANES = 8;
+
+            typedef std::array<std::uint32_t, 8> state_type;
+
+            constexpr static const state_type INITIAL_STATE = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                                               0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+            alignas(64) constexpr static const std::uint32_t K[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+            enum class backend { portable, avx2, sha_ni };
+
+            namespace detail {
+                inline std::uint32_t load_be32(const std::uint8_t *p) {
+                    return std::uint32_t(p[0]) << 24 | std::uint32_t(p[1]) << 16 | std::uint32_t(p[2]) << 8 |
+                           std::uint32_t(p[3]);
+                }
+
+                inline std::uint32_t rotr(std::uint32_t x, unsigned n) {
+                    return (x >> n) | (x << (32 - n));
+                }
+            }    // namespace detail
+
+            /// Portable compression of `blocks` consecutive 64-byte blocks into `state`.
+            inline void compress_portable(state_type &state, const std::uint8_t *data, std::size_t blocks) {
+                using detail::rotr;
+
+                for (; blocks > 0; --blocks, data += BLOCK_SIZE) {
+                    std::uint32_t w[64];
+                    for (std::size_t t = 0; t < 16; ++t) {
+                        w[t] = detail::load_be32(data + 4 * t);
+                    }
+                    for (std::size_t t = 16; t < 64; ++t) {
+                        std::uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+                        std::uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+                        w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+                    }
+
+                    std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4],
+                                  f = state[5], g = state[6], h = state[7];
+
+                    for (std::size_t t = 0; t < 64; ++t) {
+                        std::uint32_t t1 =
+                            h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+                        std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                        h = g;
+                        g = f;
+                        f = e;
+                        e = d + t1;
+                        d = c;
+                        c = b;
+                        b = a;
+                        a = t1 + t2;
+                    }
+
+                    state[0] += a;
+                    state[1] += b;
+                    state[2] += c;
+                    state[3] += d;
+                    state[4] += e;
+                    state[5] += f;
+                    state[6] += g;
+                    state[7] += h;
+                }
+            }
+
+#ifdef FILECOIN_SHA256_X86_KERNELS
+            /// Single-stream compression with the SHA extensions (SHA-NI).
+            __attribute__((target("sha,sse4.1"))) inline void compress_sha_ni(state_type &state,
+                                                                              const std::uint8_t *data,
+                                                                              std::size_t blocks) {
+                const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+                __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0]));
+                __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4]));
+                tmp = _mm_shuffle_epi32(tmp, 0xB1);                  // CDAB
+                state1 = _mm_shuffle_epi32(state1, 0x1B);            // EFGH
+                __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);    // ABEF
+                state1 = _mm_blend_epi16(state1, tmp, 0xF0);         // CDGH
+
+                for (; blocks > 0; --blocks, data += BLOCK_SIZE) {
+                    const __m128i abef_save = state0;
+                    const __m128i cdgh_save = state1;
+
+                    // msg[i % 4] holds the schedule words W[4i..4i+3] of the current group.
+                    __m128i msg[4];
+                    for (std::size_t group = 0; group < 16; ++group) {
+                        __m128i &current = msg[group % 4];
+                        if (group < 4) {
+                            current = _mm_shuffle_epi8(
+                                _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * group)), byte_swap);
+                        } else {
+                            // W[t..t+3] = msg2(msg1(W[t-16..], W[t-12..]) + W[t-7..t-4], W[t-4..t-1])
+                            const __m128i &w12 = msg[(group + 1) % 4];
+                            const __m128i &w8 = msg[(group + 2) % 4];
+                            const __m128i &w4 = msg[(group + 3) % 4];
+                            current = _mm_sha256msg2_epu32(
+                                _mm_add_epi32(_mm_sha256msg1_epu32(current, w12), _mm_alignr_epi8(w4, w8, 4)), w4);
+                        }
+
+                        __m128i round = _mm_add_epi32(
+                            current, _mm_load_si128(reinterpret_cast<const __m128i *>(&K[4 * group])));
+                        state1 = _mm_sha256rnds2_epu32(state1, state0, round);
+                        round = _mm_shuffle_epi32(round, 0x0E);
+                        state0 = _mm_sha256rnds2_epu32(state0, state1, round);
+                    }
+
+                    state0 = _mm_add_epi32(state0, abef_save);
+                    state1 = _mm_add_epi32(state1, cdgh_save);
+                }
+
+                tmp = _mm_shuffle_epi32(state0, 0x1B);          // FEBA
+                state1 = _mm_shuffle_epi32(state1, 0xB1);       // DCHG
+                state0 = _mm_blend_epi16(tmp, state1, 0xF0);    // DCBA
+                state1 = _mm_alignr_epi8(state1, tmp, 8);       // ABEF
+
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+            }
+
+            namespace detail {
+                __attribute__((target("avx2"))) inline __m256i rotr8(__m256i x, int n) {
+                    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+                }
+            }    // namespace detail
+
+            /// Eight-lane AVX2 compression of eight independent messages of `blocks` blocks each.
+            __attribute__((target("avx2"))) inline void compress_avx2_x8(std::array<state_type, LANES> &states,
+                                                                         const std::uint8_t *const data[LANES],
+                                                                         std::size_t blocks) {
+                using detail::rotr8;
+
+                __m256i s[8];
+                for (std::size_t i = 0; i < 8; ++i) {
+                    s[i] = _mm256_set_epi32(states[7][i], states[6][i], states[5][i], states[4][i], states[3][i],
+                                            states[2][i], states[1][i], states[0][i]);
+                }
+
+                for (std::size_t block = 0; block < blocks; ++block) {
+                    const std::size_t offset = block * BLOCK_SIZE;
+
+                    __m256i w[16];
+                    for (std::size_t t = 0; t < 16; ++t) {
+                        const std::size_t at = offset + 4 * t;
+                        w[t] = _mm256_set_epi32(
+                            detail::load_be32(data[7] + at), detail::load_be32(data[6] + at),
+                            detail::load_be32(data[5] + at), detail::load_be32(data[4] + at),
+                            detail::load_be32(data[3] + at), detail::load_be32(data[2] + at),
+                            detail::load_be32(data[1] + at), detail::load_be32(data[0] + at));
+                    }
+
+                    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+                    for (std::size_t t = 0; t < 64; ++t) {
+                        __m256i &wt = w[t % 16];
+                        if (t >= 16) {
+                            const __m256i w15 = w[(t - 15) % 16];
+                            const __m256i w2 = w[(t - 2) % 16];
+                            const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w15, 7), rotr8(w15, 18)),
+                                                                _mm256_srli_epi32(w15, 3));
+                            const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w2, 17), rotr8(w2, 19)),
+                                                                _mm256_srli_epi32(w2, 10));
+                            wt = _mm256_add_epi32(_mm256_add_epi32(wt, s0),
+                                                  _mm256_add_epi32(w[(t - 7) % 16], s1));
+                        }
+
+                        const __m256i big_s1 =
+                            _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+                        const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+                        const __m256i t1 = _mm256_add_epi32(
+                            _mm256_add_epi32(_mm256_add_epi32(h, big_s1), _mm256_add_epi32(ch, wt)),
+                            _mm256_set1_epi32(static_cast<int>(K[t])));
+                        const __m256i big_s0 =
+                            _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+                        const __m256i maj = _mm256_xor_si256(
+                            _mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+                        const __m256i t2 = _mm256_add_epi32(big_s0, maj);
+
+                        h = g;
+                        g = f;
+                        f = e;
+                        e = _mm256_add_epi32(d, t1);
+                        d = c;
+                        c = b;
+                        b = a;
+                        a = _mm256_add_epi32(t1, t2);
+                    }
+
+                    s[0] = _mm256_add_epi32(s[0], a);
+                    s[1] = _mm256_add_epi32(s[1], b);
+                    s[2] = _mm256_add_epi32(s[2], c);
+                    s[3] = _mm256_add_epi32(s[3], d);
+                    s[4] = _mm256_add_epi32(s[4], e);
+                    s[5] = _mm256_add_epi32(s[5], f);
+                    s[6] = _mm256_add_epi32(s[6], g);
+                    s[7] = _mm256_add_epi32(s[7], h);
+                }
+
+                for (std::size_t i = 0; i < 8; ++i) {
+                    alignas(32) std::uint32_t lanes[LANES];
+                    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), s[i]);
+                    for (std::size_t lane = 0; lane < LANES; ++lane) {
+                        states[lane][i] = lanes[lane];
+                    }
+                }
+            }
+#endif
+
+            /// Whether the running CPU (and OS) can execute the kernel of `kind`.
+            inline bool supports(backend kind) {
+                if (kind == backend::portable) {
+                    return true;
+                }
+#ifdef FILECOIN_SHA256_X86_KERNELS
+                unsigned int eax, ebx, ecx, edx;
+                if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+                    return false;
+                }
+                const bool has_sha = (ebx >> 29) & 1;
+                const bool has_avx2 = (ebx >> 5) & 1;
+
+                unsigned int ecx1 = 0;
+                __get_cpuid(1, &eax, &ebx, &ecx1, &edx);
+                const bool has_sse41 = (ecx1 >> 19) & 1;
+                const bool has_osxsave = (ecx1 >> 27) & 1;
+
+                if (kind == backend::sha_ni) {
+                    return has_sha && has_sse41;
+                }
+                if (has_avx2 && has_osxsave) {
+                    // The OS has to preserve the YMM registers for AVX2 to be usable.
+                    std::uint32_t xcr0_lo, xcr0_hi;
+                    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+                    return (xcr0_lo & 0x6) == 0x6;
+                }
+#endif
+                return false;
+            }
+
+            /// Picks the fastest kernel supported by the running CPU.
+            inline backend detect_backend() {
+                if (supports(backend::sha_ni)) {
+                    return backend::sha_ni;
+                }
+                if (supports(backend::avx2)) {
+                    return backend::avx2;
+                }
+                return backend::portable;
+            }
+
+            /// The kernel selected for this process, detected once on first use.
+            inline backend active_backend() {
+                static const backend selected = detect_backend();
+                return selected;
+            }
+
+            /// Compresses `blocks` consecutive blocks of a single message.
+            inline void compress(state_type &state, const std::uint8_t *data, std::size_t blocks) {
+#ifdef FILECOIN_SHA256_X86_KERNELS
+                if (active_backend() == backend::sha_ni) {
+                    compress_sha_ni(state, data, blocks);
+                    return;
+                }
+#endif
+                compress_portable(state, data, blocks);
+            }
+
+            /// Compresses eight independent messages of `blocks` blocks each. SHA-NI is used lane by lane
+            /// since it outperforms the AVX2 multi-buffer kernel; AVX2 is used where SHA-NI is absent.
+            inline void compress_x8(std::array<state_type, LANES> &states, const std::uint8_t *const data[LANES],
+                                    std::size_t blocks) {
+#ifdef FILECOIN_SHA256_X86_KERNELS
+                if (active_backend() == backend::avx2) {
+                    compress_avx2_x8(states, data, blocks);
+                    return;
+                }
+#endif
+                for (std::size_t lane = 0; lane < LANES; ++lane) {
+                    compress(states[lane], data[lane], blocks);
+                }
+            }
+
+            /// Number of blocks of a message of `length` bytes once padded.
+            constexpr std::size_t padded_blocks(std::size_t length) {
+                return (length + 1 + 8 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            }
+
+            /// Appends the SHA-256 padding to a message of `length` bytes stored at the front of `buffer`,
+            /// which must hold `padded_blocks(length)` blocks. Returns the number of blocks.
+            ///
+            /// `message_length` is the length of the whole message when `buffer` only holds its tail
+            /// that follows already compressed blocks.
+            inline std::size_t pad(std::uint8_t *buffer, std::size_t length, std::uint64_t message_length) {
+                const std::size_t blocks = padded_blocks(length);
+                const std::size_t end = blocks * BLOCK_SIZE;
+
+                buffer[length] = 0x80;
+                std::memset(buffer + length + 1, 0, end - length - 1 - 8);
+
+                const std::uint64_t bits = message_length * 8;
+                for (std::size_t i = 0; i < 8; ++i) {
+                    buffer[end - 1 - i] = static_cast<std::uint8_t>(bits >> (8 * i));
+                }
+                return blocks;
+            }
+
+            inline std::size_t pad(std::uint8_t *buffer, std::size_t length) {
+                return pad(buffer, length, length);
+            }
+
+            /// Writes the big-endian digest of `state` to `out`.
+            inline void store_digest(const state_type &state, std::uint8_t *out) {
+                for (std::size_t i = 0; i < 8; ++i) {
+                    out[4 * i] = static_cast<std::uint8_t>(state[i] >> 24);
+                    out[4 * i + 1] = static_cast<std::uint8_t>(state[i] >> 16);
+                    out[4 * i + 2] = static_cast<std::uint8_t>(state[i] >> 8);
+                    out[4 * i + 3] = static_cast<std::uint8_t>(state[i]);
+                }
+            }
+
+            /// SHA-256 of a contiguous message of arbitrary length. The full blocks are compressed in
+            /// place, only the tail is copied for padding.
+            inline std::array<std::uint8_t, DIGEST_SIZE> digest(const std::uint8_t *data, std::size_t length) {
+                state_type state = INITIAL_STATE;
+                const std::size_t full_blocks = length / BLOCK_SIZE;
+                compress(state, data, full_blocks);
+
+                std::uint8_t tail[2 * BLOCK_SIZE];
+                const std::size_t tail_length = length - full_blocks * BLOCK_SIZE;
+                std::memcpy(tail, data + full_blocks * BLOCK_SIZE, tail_length);
+                compress(state, tail, pad(tail, tail_length, length));
+
+                std::array<std::uint8_t, DIGEST_SIZE> out;
+                store_digest(state, out.data());
+                return out;
+            }
+        }    // namespace sha256
+    }        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_CORE_CRYPTO_SHA256_COMPRESS_HPP
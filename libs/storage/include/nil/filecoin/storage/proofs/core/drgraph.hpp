@@ -27,9 +27,12 @@
 #ifndef FILECOIN_STORAGE_PROOFS_CORE_DRGRAPH_HPP
 #define FILECOIN_STORAGE_PROOFS_CORE_DRGRAPH_HPP
 
-#include <boost/graph/directed_graph.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
 
-#include <nil/crypto3/random/chacha.hpp>
+#include <boost/assert.hpp>
+#include <boost/graph/directed_graph.hpp>
 
 #include <nil/crypto3/hash/sha2.hpp>
 #include <nil/crypto3/hash/algorithm/hash.hpp>
@@ -37,6 +40,7 @@
 #include <nil/filecoin/storage/proofs/core/utilities.hpp>
 #include <nil/filecoin/storage/proofs/core/parameter_cache.hpp>
 
+#include <nil/filecoin/storage/proofs/core/crypto/chacha8.hpp>
 #include <nil/filecoin/storage/proofs/core/crypto/domain_seed.hpp>
 
 namespace nil {
@@ -130,61 +134,52 @@ namespace nil {
                 return Graph<Hash, typename Hash::digest_type>::merkle_tree_depth();
             }
             inline virtual void parents(std::size_t node, std::vector<uint32_t> &parents) const override {
-                std::size_t m = degree();
+                std::array<chacha8::block_type, MAX_KEYSTREAM_BLOCKS> keystream;
+                if (node > 1) {
+                    const chacha8::key_type key = node_key(node);
+                    for (std::size_t block = 0; block < keystream_blocks(); ++block) {
+                        chacha8::block(key, block, keystream[block]);
+                    }
+                }
+                node_parents(node, keystream[0].data(), parents.data());
+            }
 
-                if (node == 0 || node == 1) {
-                    // There are special cases for the first and second node: the first node self
-                    // references, the second node only references the first node.
-                    // Use the degree of the current graph (`m`) as `parents.len()` might be bigger than
-                    // that (that's the case for Stacked Graph).
-                    for (auto parent = parents.begin(); parent < parents.begin() + m; ++parent) {
-                        *parent = 0;
+            /// Computes the parents of the `count` consecutive nodes starting at `start` into `out`,
+            /// `degree()` entries per node, identical to calling `parents` for each node.
+            ///
+            /// The keystreams of eight nodes are generated together on the 8-lane ChaCha8 kernel and
+            /// the bucket sampling only uses integer arithmetic, which makes this the preferred entry
+            /// point for bulk consumers such as the parents cache generation.
+            void parents_range(std::size_t start, std::size_t count, std::uint32_t *out) const {
+                const std::size_t m = degree();
+
+                std::array<chacha8::key_type, chacha8::LANES> keys;
+                std::array<std::array<chacha8::block_type, MAX_KEYSTREAM_BLOCKS>, chacha8::LANES> keystreams;
+                std::array<chacha8::block_type, chacha8::LANES> blocks;
+
+                for (std::size_t first = start; first < start + count; first += chacha8::LANES) {
+                    const std::size_t lanes = std::min<std::size_t>(chacha8::LANES, start + count - first);
+                    for (std::size_t lane = 0; lane < chacha8::LANES; ++lane) {
+                        keys[lane] = node_key(first + std::min(lane, lanes - 1));
                     }
-                } else {
-                    // DRG node indexes are guaranteed to fit within a `u32`.
-                    std::array<std::uint8_t, 32> s32;
-                    boost::copy(seed, s32);
-                    crypto3::detail::pack_to<crypto3::stream_endian::little_octet_big_bit>({node}, seed);
-                    crypto3::random::chacha rng(seed);
-
-                    std::size_t m_prime = m - 1;
-                    // Large sector sizes require that metagraph node indexes are `u64`.
-                    std::size_t metagraph_node = node * m_prime;
-                    std::size_t n_buckets = std::ceil(std::log2(static_cast<double>(metagraph_node)));
-
-                    for (typename std::vector<uint32_t>::iterator parent = parents.begin();
-                         parent < parents.begin() + m_prime;
-                         ++parent) {
-                        std::uint64_t bucket_index = (rng() % n_buckets) + 1;
-                        std::size_t largest_distance_in_bucket = std::min(metagraph_node, 1UL << bucket_index);
-                        std::size_t smallest_distance_in_bucket = std::max(2UL, largest_distance_in_bucket >> 1UL);
-
-                        // Add 1 becuase the number of distances in the bucket is inclusive.
-                        std::size_t n_distances_in_bucket =
-                            largest_distance_in_bucket - smallest_distance_in_bucket + 1;
-
-                        std::size_t distance = smallest_distance_in_bucket + (rng() % n_distances_in_bucket);
-
-                        std::uint32_t metagraph_parent = metagraph_node - distance;
-
-                        // Any metagraph node mapped onto the DRG can be safely cast back to `u32`.
-                        std::uint32_t mapped_parent = (metagraph_parent / m_prime);
-
-                        if (mapped_parent == node) {
-                            *parent = node - 1;
-                        } else {
-                            *parent = mapped_parent;
+
+                    for (std::size_t block = 0; block < keystream_blocks(); ++block) {
+                        chacha8::block_x8(keys.data(), block, blocks.data());
+                        for (std::size_t lane = 0; lane < lanes; ++lane) {
+                            keystreams[lane][block] = blocks[lane];
                         }
                     }
 
-                    parents[m_prime] = node - 1;
+                    for (std::size_t lane = 0; lane < lanes; ++lane) {
+                        node_parents(first + lane, keystreams[lane][0].data(), out + (first + lane - start) * m);
+                    }
                 }
             }
             virtual size_t size() const override {
-                return 0;
+                return nodes;
             }
             virtual size_t degree() const override {
-                return 0;
+                return base_degree;
             }
             virtual key_type create_key(const typename hash_type::digest_type &id, std::size_t node,
                                         const std::vector<uint32_t> &parents, const std::vector<uint8_t> &parents_data,
@@ -215,6 +210,81 @@ namespace nil {
             std::size_t nodes;
             std::size_t base_degree;
             std::array<std::uint8_t, 28> seed;
+
+        private:
+            /// Keystream blocks kept per node, enough for graphs with up to 33 parents per node.
+            constexpr static const std::size_t MAX_KEYSTREAM_BLOCKS = 4;
+
+            /// Number of keystream blocks needed to sample the `degree() - 1` random parents of a node,
+            /// two 64-bit draws each.
+            std::size_t keystream_blocks() const {
+                const std::size_t words = 4 * (degree() - 1);
+                BOOST_ASSERT_MSG(words <= MAX_KEYSTREAM_BLOCKS * chacha8::BLOCK_WORDS, "degree is too large");
+                return (words + chacha8::BLOCK_WORDS - 1) / chacha8::BLOCK_WORDS;
+            }
+
+            /// The parents rng of a node is keyed by the graph seed followed by the node index as u32 LE.
+            chacha8::key_type node_key(std::size_t node) const {
+                std::array<std::uint8_t, 32> node_seed;
+                std::copy(seed.begin(), seed.end(), node_seed.begin());
+                for (std::size_t i = 0; i < 4; ++i) {
+                    node_seed[28 + i] = static_cast<std::uint8_t>(node >> (8 * i));
+                }
+                return chacha8::key_from_seed(node_seed.data());
+            }
+
+            /// Samples the parents of `node` from its rng keystream `words` into `parents`.
+            void node_parents(std::size_t node, const std::uint32_t *words, std::uint32_t *parents) const {
+                std::size_t m = degree();
+
+                if (node == 0 || node == 1) {
+                    // There are special cases for the first and second node: the first node self
+                    // references, the second node only references the first node.
+                    // Use the degree of the current graph (`m`) as the parents storage might be bigger than
+                    // that (that's the case for Stacked Graph).
+                    std::fill(parents, parents + m, 0);
+                    return;
+                }
+
+                // Draws the next u64 of the rng, low word first.
+                const auto next = [&words]() {
+                    const std::uint64_t value = std::uint64_t(words[0]) | std::uint64_t(words[1]) << 32;
+                    words += 2;
+                    return value;
+                };
+
+                std::size_t m_prime = m - 1;
+                // Large sector sizes require that metagraph node indexes are `u64`.
+                std::uint64_t metagraph_node = std::uint64_t(node) * m_prime;
+                // ceil(log2(metagraph_node)), computed on integers.
+                std::uint64_t n_buckets = std::bit_width(metagraph_node - 1);
+
+                for (std::size_t i = 0; i < m_prime; ++i) {
+                    std::uint64_t bucket_index = (next() % n_buckets) + 1;
+                    std::uint64_t largest_distance_in_bucket = std::min(metagraph_node, std::uint64_t(1) << bucket_index);
+                    std::uint64_t smallest_distance_in_bucket =
+                        std::max<std::uint64_t>(2, largest_distance_in_bucket >> 1);
+
+                    // Add 1 becuase the number of distances in the bucket is inclusive.
+                    std::uint64_t n_distances_in_bucket =
+                        largest_distance_in_bucket - smallest_distance_in_bucket + 1;
+
+                    std::uint64_t distance = smallest_distance_in_bucket + (next() % n_distances_in_bucket);
+
+                    std::uint64_t metagraph_parent = metagraph_node - distance;
+
+                    // Any metagraph node mapped onto the DRG can be safely cast back to `u32`.
+                    std::uint32_t mapped_parent = static_cast<std::uint32_t>(metagraph_parent / m_prime);
+
+                    if (mapped_parent == node) {
+                        parents[i] = node - 1;
+                    } else {
+                        parents[i] = mapped_parent;
+                    }
+                }
+
+                parents[m_prime] = node - 1;
+            }
         };
     }    // namespace filecoin
 }    // namespace nil
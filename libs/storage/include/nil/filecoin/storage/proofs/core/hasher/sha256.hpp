@@ -27,8 +27,73 @@
 #ifndef FILECOIN_STORAGE_PROOFS_CORE_HASHER_SHA256_HPP
 #define FILECOIN_STORAGE_PROOFS_CORE_HASHER_SHA256_HPP
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include <nil/filecoin/storage/proofs/core/crypto/sha256_compress.hpp>
+
 namespace nil {
-    namespace filecoin { }
+    namespace filecoin {
+        namespace sha256 {
+            /// Size of a tree node, and of a pair of them.
+            constexpr static const std::size_t NODE_SIZE = DIGEST_SIZE;
+            constexpr static const std::size_t PAIR_SIZE = 2 * NODE_SIZE;
+
+            /// Node function of the piece hasher, used for tree_d and piece commitments: SHA-256 of two
+            /// concatenated nodes with the two most significant bits of the digest cleared, so that every node
+            /// is a valid field element.
+            ///
+            /// Hashes the `n` pairs at `in` into the `n` nodes at `out`, eight pairs at a time with the
+            /// multi-buffer kernel. `out` may alias the first half of `in`.
+            inline void hash_pairs(const std::uint8_t *in, std::uint8_t *out, std::size_t n) {
+                // Every pair is exactly one block, followed by the same padding block.
+                static const std::array<std::uint8_t, BLOCK_SIZE> padding = [] {
+                    std::array<std::uint8_t, BLOCK_SIZE> block = {};
+                    block[0] = 0x80;
+                    block[BLOCK_SIZE - 2] = (PAIR_SIZE * 8) >> 8;
+                    return block;
+                }();
+
+                std::size_t i = 0;
+                for (; i + LANES <= n; i += LANES) {
+                    std::array<state_type, LANES> states;
+                    states.fill(INITIAL_STATE);
+                    const std::uint8_t *data[LANES];
+                    const std::uint8_t *tail[LANES];
+                    for (std::size_t lane = 0; lane < LANES; ++lane) {
+                        data[lane] = in + (i + lane) * PAIR_SIZE;
+                        tail[lane] = padding.data();
+                    }
+                    compress_x8(states, data, 1);
+                    compress_x8(states, tail, 1);
+                    for (std::size_t lane = 0; lane < LANES; ++lane) {
+                        std::uint8_t *node = out + (i + lane) * NODE_SIZE;
+                        store_digest(states[lane], node);
+                        node[NODE_SIZE - 1] &= 0x3f;
+                    }
+                }
+                for (; i < n; ++i) {
+                    state_type state = INITIAL_STATE;
+                    compress(state, in + i * PAIR_SIZE, 1);
+                    compress(state, padding.data(), 1);
+                    std::uint8_t *node = out + i * NODE_SIZE;
+                    store_digest(state, node);
+                    node[NODE_SIZE - 1] &= 0x3f;
+                }
+            }
+
+            /// `hash_pairs` of a single pair.
+            inline std::array<std::uint8_t, NODE_SIZE> hash_pair(const std::uint8_t *left, const std::uint8_t *right) {
+                std::array<std::uint8_t, PAIR_SIZE> pair;
+                std::copy(left, left + NODE_SIZE, pair.begin());
+                std::copy(right, right + NODE_SIZE, pair.begin() + NODE_SIZE);
+                std::array<std::uint8_t, NODE_SIZE> node;
+                hash_pairs(pair.data(), node.data(), 1);
+                return node;
+            }
+        }    // namespace sha256
+    }        // namespace filecoin
 }    // namespace nil
 
-#endif
+#endif    // FILECOIN_STORAGE_PROOFS_CORE_HASHER_SHA256_HPP
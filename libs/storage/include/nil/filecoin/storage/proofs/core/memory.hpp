@@ -0,0 +1,347 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_CORE_MEMORY_HPP
+#define FILECOIN_STORAGE_PROOFS_CORE_MEMORY_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define FILECOIN_LINUX_MEMORY_CONTROL
+#endif
+
+#include <boost/log/trivial.hpp>
+
+namespace nil {
+    namespace filecoin {
+        /// Page backing used by a `huge_page_buffer`.
+        enum class page_backing { huge_1g, huge_2m, transparent, regular };
+
+        /// Large, zero-initialized, page-aligned byte buffer for the SDR label layers.
+        ///
+        /// Labeling does random parent lookups over tens of gigabytes, so the buffer is backed by
+        /// explicit huge pages when the kernel has them reserved (`MAP_HUGETLB`): 1 GiB pages when the
+        /// size is a whole number of them, 2 MiB pages otherwise. It falls back to transparent huge pages
+        /// and finally to regular pages. When `numa_node` is not negative the pages are bound to that
+        /// node before they are first touched.
+        class huge_page_buffer {
+        public:
+            huge_page_buffer() = default;
+
+            huge_page_buffer(std::size_t size, bool huge_pages, int numa_node = -1) : size_(size) {
+                if (size_ == 0) {
+                    return;
+                }
+#ifdef FILECOIN_LINUX_MEMORY_CONTROL
+                if (huge_pages) {
+                    for (const auto &[backing, shift] :
+                         {std::pair {page_backing::huge_1g, 30}, std::pair {page_backing::huge_2m, 21}}) {
+                        const std::size_t page_size = std::size_t(1) << shift;
+                        if (backing == page_backing::huge_1g && size_ % page_size != 0) {
+                            continue;
+                        }
+                        if (map_huge_pages(page_size, shift, numa_node)) {
+                            backing_ = backing;
+                            break;
+                        }
+                    }
+                }
+
+                if (data_ == nullptr) {
+                    mapped_size_ = size_;
+                    void *ptr = ::mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                    if (ptr == MAP_FAILED) {
+                        throw std::bad_alloc();
+                    }
+                    data_ = static_cast<std::uint8_t *>(ptr);
+                    backing_ = page_backing::regular;
+#ifdef MADV_HUGEPAGE
+                    if (huge_pages && ::madvise(ptr, mapped_size_, MADV_HUGEPAGE) == 0) {
+                        backing_ = page_backing::transparent;
+                    }
+#endif
+                    if (numa_node >= 0) {
+                        bind_to_numa_node(numa_node);
+                    }
+                }
+#else
+                heap_.assign(size_, 0);
+                data_ = heap_.data();
+#endif
+                BOOST_LOG_TRIVIAL(info) << std::format("allocated {} bytes of label buffer (backing {}, numa node {})",
+                                                       size_, static_cast<int>(backing_), numa_node);
+            }
+
+            huge_page_buffer(const huge_page_buffer &) = delete;
+            huge_page_buffer &operator=(const huge_page_buffer &) = delete;
+
+            huge_page_buffer(huge_page_buffer &&other) noexcept {
+                swap(other);
+            }
+
+            huge_page_buffer &operator=(huge_page_buffer &&other) noexcept {
+                huge_page_buffer(std::move(other)).swap(*this);
+                return *this;
+            }
+
+            ~huge_page_buffer() {
+#ifdef FILECOIN_LINUX_MEMORY_CONTROL
+                if (data_ != nullptr) {
+                    ::munmap(data_, mapped_size_);
+                }
+#endif
+            }
+
+            void swap(huge_page_buffer &other) noexcept {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+                std::swap(mapped_size_, other.mapped_size_);
+                std::swap(backing_, other.backing_);
+                heap_.swap(other.heap_);
+            }
+
+            std::uint8_t *data() {
+                return data_;
+            }
+
+            const std::uint8_t *data() const {
+                return data_;
+            }
+
+            std::size_t size() const {
+                return size_;
+            }
+
+            page_backing backing() const {
+                return backing_;
+            }
+
+            std::uint8_t &operator[](std::size_t i) {
+                return data_[i];
+            }
+
+            const std::uint8_t &operator[](std::size_t i) const {
+                return data_[i];
+            }
+
+            std::uint8_t *begin() {
+                return data_;
+            }
+
+            std::uint8_t *end() {
+                return data_ + size_;
+            }
+
+            const std::uint8_t *begin() const {
+                return data_;
+            }
+
+            const std::uint8_t *end() const {
+                return data_ + size_;
+            }
+
+        private:
+#ifdef FILECOIN_LINUX_MEMORY_CONTROL
+            /// Maps the buffer on explicit huge pages of `page_size` and faults them in, once bound to
+            /// `numa_node`. Faulting a huge page the pool cannot supply raises SIGBUS, so the mapping does
+            /// not reserve pages up front and is populated with `MADV_POPULATE_WRITE`, which reports the
+            /// shortage as an error instead. Kernels before Linux 5.14 reject that advice with EINVAL; there
+            /// the pages are reserved by `mmap` itself, which fails when the pool is short, and touched
+            /// once bound. Returns false, with nothing mapped, if any step fails.
+            bool map_huge_pages(std::size_t page_size, int shift, int numa_node) {
+                constexpr const int POPULATE_WRITE = 23;    // MADV_POPULATE_WRITE, Linux 5.14
+                static std::atomic<bool> populate_write(true);
+
+                const std::size_t mapped_size = (size_ + page_size - 1) & ~(page_size - 1);
+                const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT);
+                if (populate_write) {
+                    if (!map_pages(mapped_size, flags | MAP_NORESERVE, numa_node)) {
+                        return false;
+                    }
+                    if (::madvise(data_, mapped_size, POPULATE_WRITE) == 0) {
+                        return true;
+                    }
+                    const int error = errno;
+                    unmap_pages();
+                    if (error != EINVAL) {
+                        BOOST_LOG_TRIVIAL(warning) << std::format(
+                            "could not populate {} bytes of {} byte huge pages: {}", mapped_size, page_size,
+                            std::strerror(error));
+                        return false;
+                    }
+                    if (populate_write.exchange(false)) {
+                        BOOST_LOG_TRIVIAL(info) << "MADV_POPULATE_WRITE is not supported (Linux 5.14 or later is "
+                                                   "needed), reserving huge pages when mapping them instead";
+                    }
+                }
+
+                // Reservations are taken from the pool of all nodes, so the bound node is checked to have
+                // the free pages the buffer will fault in.
+                if (numa_node >= 0 && free_huge_pages(page_size, numa_node) < mapped_size / page_size) {
+                    BOOST_LOG_TRIVIAL(warning) << std::format("numa node {} has fewer than {} free {} byte huge pages",
+                                                              numa_node, mapped_size / page_size, page_size);
+                    return false;
+                }
+                if (!map_pages(mapped_size, flags, numa_node)) {
+                    return false;
+                }
+                for (std::size_t offset = 0; offset < mapped_size; offset += page_size) {
+                    static_cast<volatile std::uint8_t *>(data_)[offset] = 0;
+                }
+                return true;
+            }
+
+            /// Maps `mapped_size` bytes with `flags` and binds them to `numa_node` if it is not negative.
+            bool map_pages(std::size_t mapped_size, int flags, int numa_node) {
+                void *ptr = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+                if (ptr == MAP_FAILED) {
+                    return false;
+                }
+                data_ = static_cast<std::uint8_t *>(ptr);
+                mapped_size_ = mapped_size;
+                if (numa_node >= 0 && !bind_to_numa_node(numa_node)) {
+                    unmap_pages();
+                    return false;
+                }
+                return true;
+            }
+
+            void unmap_pages() {
+                ::munmap(data_, mapped_size_);
+                data_ = nullptr;
+                mapped_size_ = 0;
+            }
+
+            /// Free huge pages of `page_size` on `numa_node`, as listed in sysfs, 0 if unknown.
+            static std::size_t free_huge_pages(std::size_t page_size, int numa_node) {
+                std::ifstream free(std::format("/sys/devices/system/node/node{}/hugepages/hugepages-{}kB/"
+                                               "free_hugepages",
+                                               numa_node, page_size >> 10));
+                std::size_t pages = 0;
+                return (free >> pages) ? pages : 0;
+            }
+
+            bool bind_to_numa_node(int numa_node) {
+                // mbind(2) through the raw syscall keeps libnuma out of the dependencies.
+                constexpr const int MPOL_BIND = 2;
+                constexpr const std::size_t MASK_BITS = 1024;
+                std::uint64_t mask[MASK_BITS / 64] = {};
+                if (static_cast<std::size_t>(numa_node) >= MASK_BITS) {
+                    return false;
+                }
+                mask[numa_node / 64] |= std::uint64_t(1) << (numa_node % 64);
+
+                if (::syscall(SYS_mbind, data_, mapped_size_, MPOL_BIND, mask, MASK_BITS + 1, 0) != 0) {
+                    BOOST_LOG_TRIVIAL(warning) << std::format("failed to bind label buffer to numa node {}: {}",
+                                                              numa_node, std::strerror(errno));
+                    return false;
+                }
+                return true;
+            }
+#endif
+
+            std::uint8_t *data_ = nullptr;
+            std::size_t size_ = 0;
+            std::size_t mapped_size_ = 0;
+            page_backing backing_ = page_backing::regular;
+            std::vector<std::uint8_t> heap_;
+        };
+
+        /// Returns the CPUs of `numa_node` as listed in sysfs, empty if the node is unknown.
+        inline std::vector<int> numa_node_cpus(int numa_node) {
+            std::vector<int> cpus;
+            std::ifstream cpulist(std::format("/sys/devices/system/node/node{}/cpulist", numa_node));
+            std::string range;
+            while (std::getline(cpulist, range, ',')) {
+                int first = 0, last = 0;
+                char dash = 0;
+                std::istringstream parser(range);
+                parser >> first;
+                last = (parser >> dash >> last) ? last : first;
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+            return cpus;
+        }
+
+        /// Restricts the calling thread, and every thread it spawns while the guard is alive, to the
+        /// CPUs of `numa_node`. The previous affinity is restored on destruction. A negative node or a
+        /// node without CPUs leaves the affinity untouched.
+        class numa_thread_binding {
+        public:
+            explicit numa_thread_binding(int numa_node) {
+#ifdef FILECOIN_LINUX_MEMORY_CONTROL
+                const std::vector<int> cpus = numa_node >= 0 ? numa_node_cpus(numa_node) : std::vector<int>();
+                if (cpus.empty() || ::pthread_getaffinity_np(::pthread_self(), sizeof(previous_), &previous_) != 0) {
+                    return;
+                }
+
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu : cpus) {
+                    CPU_SET(cpu, &set);
+                }
+                bound_ = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+#endif
+            }
+
+            numa_thread_binding(const numa_thread_binding &) = delete;
+            numa_thread_binding &operator=(const numa_thread_binding &) = delete;
+
+            ~numa_thread_binding() {
+#ifdef FILECOIN_LINUX_MEMORY_CONTROL
+                if (bound_) {
+                    ::pthread_setaffinity_np(::pthread_self(), sizeof(previous_), &previous_);
+                }
+#endif
+            }
+
+        private:
+#ifdef FILECOIN_LINUX_MEMORY_CONTROL
+            cpu_set_t previous_;
+#endif
+            bool bound_ = false;
+        };
+    }    // namespace filecoin
+}    // namespace nil
+
+#endif
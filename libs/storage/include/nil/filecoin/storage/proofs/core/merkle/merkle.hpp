@@ -26,6 +26,18 @@
 #ifndef FILECOIN_MERKLE_HPP
 #define FILECOIN_MERKLE_HPP
 
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <nil/crypto3/hash/sha2.hpp>
+#include <nil/crypto3/hash/algorithm/hash.hpp>
+
+#include <nil/filecoin/storage/proofs/core/hasher/sha256.hpp>
 #include <nil/filecoin/storage/proofs/core/merkle/storage/utilities.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/optional.hpp>
@@ -42,6 +54,127 @@ namespace nil {
             // populating from the data leaves.
             const size_t BUILD_DATA_BLOCK_SIZE = 64 * BUILD_CHUNK_NODES;
 
+            template<typename Hash>
+            struct MerkleTree_basic_policy {
+                typedef std::array<uint8_t, Hash::digest_size> hash_result_type;
+                constexpr static const std::size_t hash_digest_size = Hash::digest_size;
+            };
+
+            namespace detail {
+                // Free list of node buffers shared by the tree building threads, so that building a level
+                // does not allocate once per chunk.
+                class buffer_pool {
+                public:
+                    std::vector<uint8_t> acquire(size_t size) {
+                        std::vector<uint8_t> buffer;
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            if (!free.empty()) {
+                                buffer = std::move(free.back());
+                                free.pop_back();
+                            }
+                        }
+                        buffer.resize(size);
+                        return buffer;
+                    }
+
+                    void release(std::vector<uint8_t> buffer) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        free.push_back(std::move(buffer));
+                    }
+
+                    static buffer_pool &instance() {
+                        static buffer_pool pool;
+                        return pool;
+                    }
+
+                private:
+                    std::mutex mutex;
+                    std::vector<std::vector<uint8_t>> free;
+                };
+
+                // Buffer borrowed from the pool for the lifetime of the object.
+                class pooled_buffer {
+                public:
+                    explicit pooled_buffer(size_t size) : buffer(buffer_pool::instance().acquire(size)) {
+                    }
+
+                    ~pooled_buffer() {
+                        buffer_pool::instance().release(std::move(buffer));
+                    }
+
+                    uint8_t *data() {
+                        return buffer.data();
+                    }
+
+                private:
+                    std::vector<uint8_t> buffer;
+                };
+
+                // Calls `f(chunk)` for every chunk in `[0, chunks)` on up to one thread per core. Threads claim
+                // the next unprocessed chunk when done with theirs, so that uneven chunks balance out. The
+                // first exception is rethrown once all threads have stopped.
+                template<typename F>
+                void parallel_chunks(size_t chunks, F f) {
+                    const size_t threads =
+                        std::min<size_t>(chunks, std::max(1U, std::thread::hardware_concurrency()));
+                    std::atomic<size_t> next(0);
+                    std::atomic<bool> failed(false);
+                    std::exception_ptr error;
+                    std::mutex mutex;
+
+                    const auto work = [&]() {
+                        try {
+                            for (size_t chunk; !failed && (chunk = next.fetch_add(1)) < chunks;) {
+                                f(chunk);
+                            }
+                        } catch (...) {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            if (!failed.exchange(true)) {
+                                error = std::current_exception();
+                            }
+                        }
+                    };
+
+                    std::vector<std::thread> workers;
+                    try {
+                        for (size_t i = 1; i < threads; ++i) {
+                            workers.emplace_back(work);
+                        }
+                    } catch (...) {
+                        // Stop the workers already started and join them before unwinding.
+                        failed = true;
+                        for (std::thread &worker : workers) {
+                            worker.join();
+                        }
+                        throw;
+                    }
+                    work();
+                    for (std::thread &worker : workers) {
+                        worker.join();
+                    }
+                    if (error) {
+                        std::rethrow_exception(error);
+                    }
+                }
+
+                // Hashes `count` groups of `Arity` consecutive nodes at `in` into the `count` nodes at `out`, which
+                // may alias `in`. Binary SHA-256 trees, tree_d, go through the multi-lane piece hasher.
+                template<typename Hash, std::size_t Arity>
+                void hash_nodes(const uint8_t *in, uint8_t *out, size_t count) {
+                    constexpr size_t element_size = MerkleTree_basic_policy<Hash>::hash_digest_size;
+                    if constexpr (Arity == 2 && std::is_same<Hash, crypto3::hashes::sha2<256>>::value) {
+                        sha256::hash_pairs(in, out, count);
+                    } else {
+                        for (size_t j = 0; j < count; ++j) {
+                            typename MerkleTree_basic_policy<Hash>::hash_result_type h =
+                                crypto3::hash<Hash>(in + j * Arity * element_size, in + (j + 1) * Arity * element_size);
+                            std::copy(h.begin(), h.end(), out + j * element_size);
+                        }
+                    }
+                }
+            }    // namespace detail
+
             // Merkle Tree.
             //
             // All leafs and nodes are stored in a linear array (vec).
@@ -97,12 +230,6 @@ namespace nil {
             // With N and R defaulting to 0, the tree performs as a single base
             // layer merkle tree without layers (i.e. a conventional merkle
             // tree).
-            template<typename Hash>
-            struct MerkleTree_basic_policy {
-                typedef std::array<uint8_t, Hash::digest_size> hash_result_type;
-                constexpr static const std::size_t hash_digest_size = Hash::digest_size;
-            };
-
             template<typename Hash, typename Store, size_t BaseTreeArity = 2>
             struct MerkleTree {
                 Store data;
@@ -131,8 +258,6 @@ namespace nil {
                     size_t level = 0;
                     size_t width = leafs;
                     size_t level_node_index = 0;
-                    size_t branches = Arity;
-                    size_t shift = (size_t)std::log(branches);
 
                     size_t read_start;
                     size_t write_start;
@@ -146,20 +271,19 @@ namespace nil {
                             write_start = level_node_index + width;
                         }
 
-                        std::array<uint8_t, width * element_size> buf;
-                        std::array<uint8_t, width * element_size / Arity> buf_result;
+                        std::vector<uint8_t> buf(width * element_size);
+                        std::vector<uint8_t> buf_result(width * element_size / Arity);
                         std::pair<size_t, size_t> r =
                             std::make_pair(read_start * element_size, (read_start + width) * element_size);
-                        data.read(r, buf.begin());
-                        BOOST_ASSERT_MSG((buf.size() / element_size) % Arity != 0, "Invalid count data for hashing");
-                        for (size_t i = 0; i < buf.size() - element_size * Arity; i += element_size * Arity) {
-                            root = crypto3::hash<Hash>(buf.begin() + i, buf.begin() + i + element_size * Arity);
-                            std::copy(root.begin(), root.end(), buf_result.begin() + buf_result.size());
-                        }
-                        data.write(std::make_pair(buf_result.begin(), buf_result.end()), write_start * element_size);
+                        data.read(r, buf.data());
+                        BOOST_ASSERT_MSG(width % Arity == 0, "Invalid count data for hashing");
+                        detail::hash_nodes<Hash, Arity>(buf.data(), buf_result.data(), width / Arity);
+                        std::copy(buf_result.end() - element_size, buf_result.end(), root.begin());
+                        data.write(std::make_pair(buf_result.data(), buf_result.data() + buf_result.size()),
+                                   write_start * element_size);
                         level_node_index += width;
                         level += 1;
-                        width >>= shift;    // width /= branches;
+                        width /= Arity;
                     };
                     BOOST_ASSERT_MSG(row_count == level + 1, "Invalid tree row_count");
                     // The root isn't part of the previous loop so `row_count` is
@@ -170,35 +294,95 @@ namespace nil {
 
                 template<std::size_t Arity = 2>
                 void process_layer(size_t width, size_t level, size_t read_start, size_t write_start) {
-                    size_t branches = Arity;
+                    process_layers<Arity>(width, level, read_start, write_start, 1);
+                };
 
-                    // Allocate `width` indexes during operation (which is a negligible memory bloat
-                    // compared to the 32-bytes size of the nodes stored in the `Store`s) and hash each
-                    // pair of nodes to write them to the next level in concurrent threads.
-                    // Process `BUILD_CHUNK_NODES` nodes in each thread at a time to reduce contention,
-                    // optimized for big sector sizes (small ones will just have one thread doing all
-                    // the work).
-                    BOOST_ASSERT_MSG(BUILD_CHUNK_NODES % branches == 0, "Invalid chunk size");
-                    for (size_t chunk_index = read_start; chunk_index < read_start + width;
-                         chunk_index += BUILD_CHUNK_NODES) {
-                        size_t chunk_size = std::min(BUILD_CHUNK_NODES, read_start + width - chunk_index);
-                        std::array<uint8_t, BUILD_CHUNK_NODES * element_size> buf;
-                        std::array<uint8_t, BUILD_CHUNK_NODES * element_size / Arity> buf_result;
-                        data.read(std::make_pair(chunk_index * element_size, (chunk_index + chunk_size) * element_size),
-                                  buf.begin());
-                        BOOST_ASSERT_MSG((buf.size() / element_size) % Arity != 0, "Invalid count data for hashing");
-                        for (size_t i = 0; i < buf.size() - element_size * Arity; i += element_size * Arity) {
-                            root = crypto3::hash<Hash>(buf.begin() + i, buf.begin() + i + element_size * Arity);
-                            std::copy(root.begin(), root.end(), buf_result.begin() + buf_result.size());
-                        }
-                        // We write the hashed nodes to the next level in the
-                        // position that would be "in the middle" of the
-                        // previous pair (dividing by branches).
-                        size_t write_delta = (chunk_index - read_start) / branches;
-                        size_t nodes_size = (buf.size() / element_size / branches) * element_size;
-                        // Check that we correctly pre-allocated the space.
-                        data.write(std::make_pair<buf.begin(), buf.end()>, (write_start + write_delta) * element_size);
+                // Number of levels `process_layers` can build at once above a level of `width` nodes: as
+                // many as fit in a tile of `BUILD_CHUNK_NODES` nodes.
+                template<std::size_t Arity = 2>
+                static size_t tile_levels(size_t width) {
+                    size_t levels = 0;
+                    for (size_t span = Arity; span <= std::min(width, BUILD_CHUNK_NODES); span *= Arity) {
+                        ++levels;
+                    }
+                    return std::max<size_t>(levels, 1);
+                }
+
+                // Builds the `levels` levels above the level of `width` nodes starting at `read_start`,
+                // writing the first of them at `write_start` and the others right after each other.
+                //
+                // The level is split into tiles of up to `BUILD_CHUNK_NODES` nodes which worker threads
+                // claim one at a time. A worker reads its tile into a buffer taken from a pool and hashes
+                // all `levels` levels of the tile while it is hot in cache. Only the hashing runs in
+                // parallel: the stores keep a shared cursor and length, so reads and writes are serialized
+                // by a mutex, and tiles write their levels in tile order. `levels` must not exceed
+                // `tile_levels(width)`.
+                template<std::size_t Arity = 2>
+                void process_layers(size_t width, size_t level, size_t read_start, size_t write_start,
+                                    size_t levels) {
+                    size_t span = 1;
+                    for (size_t i = 0; i < levels; ++i) {
+                        span *= Arity;
                     }
+                    const size_t tile = std::max(span, std::min(width, BUILD_CHUNK_NODES));
+                    BOOST_ASSERT_MSG(tile % span == 0 && width % tile == 0, "Invalid tile size");
+
+                    std::vector<size_t> level_starts(levels);
+                    for (size_t i = 0, start = write_start, w = width / Arity; i < levels; ++i, w /= Arity) {
+                        level_starts[i] = start;
+                        start += w;
+                    }
+
+                    std::mutex store_mutex;
+                    std::condition_variable written;
+                    size_t next_write = 0;
+                    bool aborted = false;
+
+                    detail::parallel_chunks(width / tile, [&](size_t chunk) {
+                        try {
+                            detail::pooled_buffer nodes(tile * element_size);
+                            {
+                                std::lock_guard<std::mutex> lock(store_mutex);
+                                data.read(std::make_pair((read_start + chunk * tile) * element_size,
+                                                         (read_start + (chunk + 1) * tile) * element_size),
+                                          nodes.data());
+                            }
+
+                            // The levels of the tile are kept one after the other, they take fewer nodes
+                            // than the tile itself.
+                            detail::pooled_buffer hashed(tile * element_size);
+                            const uint8_t *in = nodes.data();
+                            uint8_t *out = hashed.data();
+                            for (size_t i = 0, count = tile / Arity; i < levels; ++i, count /= Arity) {
+                                detail::hash_nodes<Hash, Arity>(in, out, count);
+                                in = out;
+                                out += count * element_size;
+                            }
+
+                            std::unique_lock<std::mutex> lock(store_mutex);
+                            written.wait(lock, [&]() { return next_write == chunk || aborted; });
+                            if (aborted) {
+                                return;
+                            }
+                            out = hashed.data();
+                            for (size_t i = 0, count = tile / Arity; i < levels; ++i, count /= Arity) {
+                                data.write(std::make_pair(out, out + count * element_size),
+                                           (level_starts[i] + chunk * count) * element_size);
+                                out += count * element_size;
+                            }
+                            if (width == span) {
+                                std::copy(in, in + element_size, root.begin());
+                            }
+                            ++next_write;
+                            written.notify_all();
+                        } catch (...) {
+                            // Tiles waiting for this one to be written would wait forever.
+                            std::lock_guard<std::mutex> lock(store_mutex);
+                            aborted = true;
+                            written.notify_all();
+                            throw;
+                        }
+                    });
                 };
 
                 // Default merkle-tree build, based on store type.
@@ -212,8 +396,6 @@ namespace nil {
                         return build_small_tree<Arity>(leafs, row_count);
                     }
 
-                    size_t shift = (size_t)std::log(branches);
-
                     // Process one `level` at a time of `width` nodes. Each level has half the nodes
                     // as the previous one; the first level, completely stored in `data`, has `leafs`
                     // nodes. We guarantee an even number of nodes per `level`, duplicating the last
@@ -235,10 +417,14 @@ namespace nil {
                             read_start = level_node_index;
                             write_start = level_node_index + width;
                         }
-                        process_layer<Arity>(width, level, read_start, write_start);
-                        level_node_index += width;
-                        level += 1;
-                        width >>= shift;    // width /= branches;
+                        // Build as many levels as fit in a tile at once.
+                        const size_t levels = tile_levels<Arity>(width);
+                        process_layers<Arity>(width, level, read_start, write_start, levels);
+                        for (size_t i = 0; i < levels; ++i) {
+                            level_node_index += width;
+                            level += 1;
+                            width /= branches;
+                        }
                     }
 
                     BOOST_ASSERT_MSG(row_count == level + 1, "Invalid tree row_count");
@@ -249,6 +435,18 @@ namespace nil {
                     return root;
                 };
 
+                /// Wraps a 'Store' holding only the base data leafs, to be
+                /// completed by 'build'.
+                explicit MerkleTree(Store data) {
+                    size_t branches = BaseTreeArity;
+                    this->leafs = data.len();
+                    BOOST_ASSERT_MSG(utilities::next_pow2(leafs) == leafs, "leafs MUST be a power of 2");
+
+                    this->data = data;
+                    this->len = utilities::get_merkle_tree_len(leafs, branches);
+                    this->row_count = utilities::get_merkle_tree_row_count(leafs, branches);
+                }
+
                 /// Creates new merkle tree from an already allocated 'Store'
                 /// (used with 'Store::new_from_disk').  The specified 'size' is
                 /// the number of base data leafs in the MT.
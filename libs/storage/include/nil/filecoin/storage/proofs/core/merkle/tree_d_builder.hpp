@@ -0,0 +1,211 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2020 Mikhail Komarov <nemo@nil.foundation>
+// Copyright (c) 2021 Aleksei Moskvin <alalmoskvin@gmail.com>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantfrom_store_configs_and_replicaial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#ifndef FILECOIN_STORAGE_PROOFS_CORE_MERKLE_TREE_D_BUILDER_HPP
+#define FILECOIN_STORAGE_PROOFS_CORE_MERKLE_TREE_D_BUILDER_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/assert.hpp>
+
+#include <nil/filecoin/storage/proofs/core/hasher/sha256.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace merkletree {
+            /// Number of nodes a level buffers before they are written out and hashed into the next level.
+            constexpr static const std::size_t TREE_D_FLUSH_NODES = 1 << 16;
+
+            /// Builds tree_d, the binary SHA-256 tree over the sector data, incrementally while the data is
+            /// being written, e.g. by `add_piece`, so that neither the staged sector has to be read back nor
+            /// copied into memory to commit to it.
+            ///
+            /// The tree is stored in the `DiskStore` layout, all levels from the leaves to the root, at
+            /// `path`, which is written as `path + ".partial"` and only renamed into place by `finish()`.
+            /// An empty `path` only computes the root.
+            class tree_d_builder {
+            public:
+                constexpr static const std::size_t NODE_SIZE = 32;
+
+                typedef std::array<std::uint8_t, NODE_SIZE> node_type;
+
+                tree_d_builder(std::uint64_t leaves, const std::string &path) : leaves_(leaves), path_(path) {
+                    BOOST_ASSERT_MSG(leaves > 0 && (leaves & (leaves - 1)) == 0, "leaves must be a power of two");
+
+                    std::uint64_t offset = 0;
+                    for (std::uint64_t width = leaves; width > 0; width /= 2) {
+                        level_offsets_.push_back(offset);
+                        offset += width;
+                    }
+                    pending_.resize(level_offsets_.size());
+                    written_.resize(level_offsets_.size());
+
+                    if (!path_.empty()) {
+                        const std::string partial = path_ + ".partial";
+                        fd_ = ::open(partial.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                        if (fd_ < 0) {
+                            throw std::system_error(errno, std::generic_category(), "could not create " + partial);
+                        }
+                        if (::ftruncate(fd_, offset * NODE_SIZE) != 0) {
+                            // The destructor does not run for a constructor that throws.
+                            const int error = errno;
+                            ::close(fd_);
+                            throw std::system_error(error, std::generic_category(), "could not size " + partial);
+                        }
+                    }
+                }
+
+                tree_d_builder(const tree_d_builder &) = delete;
+                tree_d_builder &operator=(const tree_d_builder &) = delete;
+
+                ~tree_d_builder() {
+                    if (fd_ >= 0) {
+                        ::close(fd_);
+                    }
+                }
+
+                /// Number of data bytes appended so far.
+                std::uint64_t appended() const {
+                    return appended_;
+                }
+
+                /// Appends the next `size` bytes of sector data, in any chunking.
+                void append(const std::uint8_t *data, std::size_t size) {
+                    BOOST_ASSERT_MSG(appended_ + size <= leaves_ * NODE_SIZE, "more data than tree_d leaves");
+                    appended_ += size;
+
+                    std::vector<std::uint8_t> &leaves = pending_[0];
+                    while (size > 0) {
+                        const std::size_t count = std::min(size, TREE_D_FLUSH_NODES * NODE_SIZE - leaves.size());
+                        leaves.insert(leaves.end(), data, data + count);
+                        data += count;
+                        size -= count;
+                        if (leaves.size() == TREE_D_FLUSH_NODES * NODE_SIZE) {
+                            flush(0);
+                        }
+                    }
+                }
+
+                /// Zero-pads the data to the full sector, completes the tree and moves it into place.
+                /// Returns the root, i.e. comm_d.
+                node_type finish() {
+                    const std::vector<std::uint8_t> zeros(TREE_D_FLUSH_NODES * NODE_SIZE);
+                    while (appended_ < leaves_ * NODE_SIZE) {
+                        append(zeros.data(), std::min<std::uint64_t>(zeros.size(), leaves_ * NODE_SIZE - appended_));
+                    }
+                    for (std::size_t level = 0; level < pending_.size(); ++level) {
+                        flush(level);
+                    }
+
+                    node_type root;
+                    std::copy(root_.begin(), root_.end(), root.begin());
+                    if (fd_ >= 0) {
+                        const std::string partial = path_ + ".partial";
+                        const int fd = fd_;
+                        fd_ = -1;
+                        if (::fsync(fd) != 0 || ::close(fd) != 0 || ::rename(partial.c_str(), path_.c_str()) != 0) {
+                            throw std::system_error(errno, std::generic_category(), "could not persist " + path_);
+                        }
+                    }
+                    return root;
+                }
+
+            private:
+                /// Writes the complete pairs buffered at `level` and hashes them into the next level.
+                void flush(std::size_t level) {
+                    std::vector<std::uint8_t> &nodes = pending_[level];
+                    const std::size_t count = nodes.size() / NODE_SIZE;
+                    if (level + 1 == pending_.size()) {
+                        BOOST_ASSERT_MSG(count <= 1, "more than one root");
+                        if (count == 1) {
+                            write(level, nodes.data(), 1);
+                            std::copy(nodes.begin(), nodes.end(), root_.begin());
+                            nodes.clear();
+                        }
+                        return;
+                    }
+
+                    const std::size_t pairs = count / 2;
+                    write(level, nodes.data(), 2 * pairs);
+
+                    std::vector<std::uint8_t> parents(pairs * NODE_SIZE);
+                    sha256::hash_pairs(nodes.data(), parents.data(), pairs);
+                    nodes.erase(nodes.begin(), nodes.begin() + 2 * pairs * NODE_SIZE);
+
+                    std::vector<std::uint8_t> &next = pending_[level + 1];
+                    next.insert(next.end(), parents.begin(), parents.end());
+                    if (next.size() >= TREE_D_FLUSH_NODES * NODE_SIZE) {
+                        flush(level + 1);
+                    }
+                }
+
+                void write(std::size_t level, const std::uint8_t *nodes, std::size_t count) {
+                    std::uint64_t offset = (level_offsets_[level] + written_[level]) * NODE_SIZE;
+                    written_[level] += count;
+                    if (fd_ < 0) {
+                        return;
+                    }
+
+                    std::size_t size = count * NODE_SIZE;
+                    while (size > 0) {
+                        const ssize_t n = ::pwrite(fd_, nodes, size, offset);
+                        if (n < 0) {
+                            if (errno == EINTR) {
+                                continue;
+                            }
+                            throw std::system_error(errno, std::generic_category(), "could not write " + path_);
+                        }
+                        nodes += n;
+                        size -= n;
+                        offset += n;
+                    }
+                }
+
+                std::uint64_t leaves_;
+                std::string path_;
+                int fd_ = -1;
+                std::uint64_t appended_ = 0;
+                std::vector<std::uint64_t> level_offsets_;
+                /// Nodes of each level not yet written and hashed, at most `TREE_D_FLUSH_NODES` plus one.
+                std::vector<std::vector<std::uint8_t>> pending_;
+                std::vector<std::uint64_t> written_;
+                std::array<std::uint8_t, NODE_SIZE> root_ = {};
+            };
+        }    // namespace merkletree
+    }        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_CORE_MERKLE_TREE_D_BUILDER_HPP
@@ -29,6 +29,17 @@
 
 #define BOOST_FILESYSTEM_NO_DEPRECATED
 
+#include <future>
+#include <numeric>
+#include <optional>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include <boost/assert.hpp>
+#include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/log/trivial.hpp>
 
@@ -41,8 +52,12 @@
 #include <nil/crypto3/hash/sha2.hpp>
 
 #include <nil/filecoin/storage/proofs/core/parameter_cache.hpp>
+#include <nil/filecoin/storage/proofs/core/crypto/feistel.hpp>
 
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_codec.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_writer.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/graph.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/shared_cache.hpp>
 
 namespace nil {
     namespace filecoin {
@@ -54,6 +69,9 @@ namespace nil {
                 /// u32 = 4 bytes
                 constexpr static const std::size_t NODE_BYTES = 4;
 
+                /// Number of nodes decoded at once when a compressed cache is walked window by window.
+                constexpr static const std::uint32_t COMPRESSED_CACHE_WINDOW_NODES = 1 << 20;
+
                 struct CacheData {
                     /// Change the cache to point to the newly passed in offset.
                     ///
@@ -64,6 +82,17 @@ namespace nil {
                             return;
                         }
 
+                        if (shared) {
+                            offset = new_offset;
+                            return;
+                        }
+
+                        if (compressed) {
+                            compressed->decode_range(new_offset, len, window.data());
+                            offset = new_offset;
+                            return;
+                        }
+
                         std::size_t offset = new_offset * DEGREE * NODE_BYTES;
                         std::size_t len = len * DEGREE * NODE_BYTES;
 
@@ -76,21 +105,37 @@ namespace nil {
                     }
 
                     /// Returns true if this node is in the cached range.
-                    bool contains(std::uint32_t node) {
+                    bool contains(std::uint32_t node) const {
                         return node >= offset && node < offset + len;
                     }
 
                     /// Read the parents for the given node from cache.
                     ///
                     /// Panics if the `node` is not in the cache.
-                    std::array<std::uint32_t, DEGREE> read(std::uint32_t node) {
+                    std::array<std::uint32_t, DEGREE> read(std::uint32_t node) const {
                         BOOST_ASSERT_MSG(node >= offset, "node not in cache");
+                        if (shared) {
+                            std::array<std::uint32_t, DEGREE> res;
+                            const std::uint32_t *entry = shared->entries() + std::size_t(node) * DEGREE;
+                            std::copy(entry, entry + DEGREE, res.begin());
+                            return res;
+                        }
+
+                        if (compressed) {
+                            std::array<std::uint32_t, DEGREE> res;
+                            const auto entry = window.begin() + std::size_t(node - offset) * DEGREE;
+                            std::copy(entry, entry + DEGREE, res.begin());
+                            return res;
+                        }
+
                         std::size_t start = (node - offset) * DEGREE * NODE_BYTES;
-                        std::size_t end = start + DEGREE * NODE_BYTES;
 
                         std::array<std::uint32_t, DEGREE> res;
-                        res.fill(0);
-                        crypto3::detail::pack_to<crypto3::stream_endian::little_octet_big_bit>(data, res);
+                        auto it = data.begin() + start;
+                        for (std::size_t i = 0; i < DEGREE; ++i, it += NODE_BYTES) {
+                            res[i] = std::uint32_t(it[0]) | std::uint32_t(it[1]) << 8 | std::uint32_t(it[2]) << 16 |
+                                     std::uint32_t(it[3]) << 24;
+                        }
                         return res;
                     }
 
@@ -102,8 +147,46 @@ namespace nil {
                         shift(0);
                     }
 
+                    /// Faults the window into memory, so that reading it later does not block on I/O.
+                    /// Shared caches are resident and compressed windows are decoded on open, they need
+                    /// nothing.
+                    void prefault() const {
+                        if (shared || compressed || data.len() == 0) {
+                            return;
+                        }
+#ifdef MADV_WILLNEED
+                        ::madvise(const_cast<std::uint8_t *>(data.as_ptr()), data.len(), MADV_WILLNEED);
+#endif
+                        // Touch every page to populate the page tables as well.
+                        std::uint8_t sum = 0;
+                        for (std::size_t i = 0; i < data.len(); i += 4096) {
+                            sum ^= *static_cast<const volatile std::uint8_t *>(data.as_ptr() + i);
+                        }
+                        (void)sum;
+                    }
+
                     static CacheData open(std::uint32_t offset, std::uint32_t len,
                                           const boost::filesystem::path &path) {
+                        // A copy published by a shared cache daemon is used in place, whatever its window.
+                        if (const auto shared = attach_shared(path)) {
+                            return open_shared(shared, offset, len, path);
+                        }
+
+                        // Compressed caches are decoded into an in-memory window instead of being mapped.
+                        if (compressed_cache_reader::is_compressed(path.string())) {
+                            CacheData cache;
+                            cache.compressed = std::make_shared<compressed_cache_reader>(path.string());
+                            if (cache.compressed->nodes() < std::uint64_t(offset) + len) {
+                                bail !("corrupted cache: {}, expected at least {} nodes, got {}", path.display(),
+                                       offset + len, cache.compressed->nodes());
+                            }
+                            cache.window.resize(std::size_t(len) * DEGREE);
+                            cache.compressed->decode_range(offset, len, cache.window.data());
+                            cache.offset = offset;
+                            cache.len = len;
+                            return cache;
+                        }
+
                         std::size_t min_cache_size = (offset + len) * DEGREE * NODE_BYTES;
 
                         const auto file = LockedFile::open_shared_read(path).with_context(
@@ -127,6 +210,33 @@ namespace nil {
                         return {data, file, len, offset};
                     }
 
+                    /// Window `[offset, offset + len)` of the attached shared copy `shared` of the cache at `path`.
+                    static CacheData open_shared(const std::shared_ptr<shared_parent_cache> &shared,
+                                                 std::uint32_t offset, std::uint32_t len,
+                                                 const boost::filesystem::path &path) {
+                        if (shared->nodes() < std::uint64_t(offset) + len) {
+                            bail !("corrupted shared cache of {}, expected at least {} nodes, got {}",
+                                   path.display(), offset + len, shared->nodes());
+                        }
+                        CacheData cache;
+                        cache.shared = shared;
+                        cache.offset = offset;
+                        cache.len = len;
+                        return cache;
+                    }
+
+                    /// Returns the published shared copy of the cache at `path`, if shared caches are enabled and
+                    /// a matching one is published. With `verify_cache` its entries are verified as well, once
+                    /// per process.
+                    static std::shared_ptr<shared_parent_cache> attach_shared(const boost::filesystem::path &path) {
+                        const auto settings = settings::SETTINGS.lock();
+                        if (!settings.parent_cache_shared) {
+                            return nullptr;
+                        }
+                        return shared_parent_cache::attach(settings.parent_cache_shared_dir, path.string(),
+                                                           settings.verify_cache);
+                    }
+
                     /// This is a large list of fixed (parent) sized arrays.
                     memmap::mmap data;
                     /// Offset in nodes.
@@ -135,6 +245,12 @@ namespace nil {
                     std::uint32_t len;
                     /// The underlyling file.
                     LockedFile file;
+                    /// Reader of a compressed (format 2) cache, null for raw caches.
+                    std::shared_ptr<compressed_cache_reader> compressed;
+                    /// Decoded parents of `[offset, offset + len)` for compressed caches.
+                    std::vector<std::uint32_t> window;
+                    /// Published shared copy of the whole cache, used instead of `data` or `window`.
+                    std::shared_ptr<shared_parent_cache> shared;
                 };
 
                 // StackedGraph will hold two different (but related) `ParentCache`,
@@ -147,43 +263,92 @@ namespace nil {
                         } else {
                             generate(len, cache_entries, graph, path);
                         }
+                        prefetch_next();
                     }
 
                     /// Opens an existing cache from disk.
                     static ParentCache open(std::uint32_t len, std::uint32_t cache_entries,
                                             const boost::filesystem::path &path) {
+                        // A shared copy is verified when attached to, the cache file is then not read at all.
+                        if (const auto shared = CacheData::attach_shared(path)) {
+                            return {path, cache_entries, CacheData::open_shared(shared, 0, len, path)};
+                        }
+
+                        if (settings::SETTINGS.lock().verify_cache) {
+                            if (compressed_cache_reader::is_compressed(path.string())) {
+                                // The per-block checksums cover every entry, the digest record would only
+                                // hash the whole file again.
+                                if (!compressed_cache_reader(path.string()).verify()) {
+                                    bail !("corrupted cache: {}, block checksum mismatch", path.display());
+                                }
+                            } else {
+                                const std::optional<bool> digest_matches = verify_parent_cache_digest(path.string());
+                                if (digest_matches && !*digest_matches) {
+                                    bail !("corrupted cache: {}, digest mismatch", path.display());
+                                }
+                            }
+                        }
 
                         CacheData cache = CacheData::open(0, len, path);
 
                         return {path, cache_entries, cache};
                     }
 
+                    /// Computes the DEGREE parents of nodes `[first, first + count)` into `parents`. Base
+                    /// parents come from the batched `parents_range`. Expander parent `i` of a node is its
+                    /// feistel index `node * EXP_DEGREE + i` permuted, then divided by `EXP_DEGREE`, as in
+                    /// `generate_expanded_parents`; the indices of the whole run are consecutive and go
+                    /// through `permute_batch` together.
+                    template<template<typename, typename> class StackedGraph, typename Hash, typename Graph>
+                    static void generate_parents(StackedGraph<Hash, Graph> &graph, std::uint64_t first,
+                                                 std::size_t count, std::uint32_t *parents) {
+                        BOOST_ASSERT_MSG(graph.expansion_degree() == EXP_DEGREE, "unexpected expansion degree");
+
+                        std::vector<std::uint32_t> base_parents(count * BASE_DEGREE);
+                        graph.base_graph().parents_range(first, count, base_parents.data());
+
+                        std::vector<Index> exp_indices(count * EXP_DEGREE);
+                        std::iota(exp_indices.begin(), exp_indices.end(), Index(first) * EXP_DEGREE);
+                        std::vector<Index> exp_permuted(exp_indices.size());
+                        permute_batch(Index(graph.size()) * EXP_DEGREE, exp_indices.data(), exp_indices.size(),
+                                      graph.feistel_keys, graph.feistel_precomputed, exp_permuted.data());
+
+                        for (std::size_t i = 0; i < count; ++i) {
+                            std::uint32_t *node_parents = parents + i * DEGREE;
+                            std::copy(base_parents.begin() + i * BASE_DEGREE,
+                                      base_parents.begin() + (i + 1) * BASE_DEGREE, node_parents);
+                            for (std::size_t j = 0; j < EXP_DEGREE; ++j) {
+                                node_parents[BASE_DEGREE + j] =
+                                    static_cast<std::uint32_t>(exp_permuted[i * EXP_DEGREE + j] / EXP_DEGREE);
+                            }
+                        }
+                    }
+
                     /// Generates a new cache and stores it on disk.
                     template<template<typename, typename> class StackedGraph, typename Hash, typename Graph>
                     static ParentCache generate(std::uint32_t len, std::uint32_t cache_entries,
                                                 StackedGraph<Hash, Graph> &graph, const boost::filesystem::path &path) {
 
                         with_exclusive_lock(path, [&](const boost::filesystem::path &file) {
-                            std::size_t cache_size = cache_entries * NODE_BYTES * DEGREE;
-                            file.set_len(cache_size);
-
-                            auto data = unsafe {memmap::MmapOptions().map_mut(file).with_context(
-                                || std::format("could not mmap path={}", path.display()))};
-
-                            data.par_chunks_mut(DEGREE * NODE_BYTES)
-                                .enumerate()
-                                .try_for_each(| (node, entry) |->Result<()> {
-                                    auto parents = [0u32; DEGREE];
-                                    graph.base_graph().parents(node, parents[..BASE_DEGREE]);
-                                    graph.generate_expanded_parents(node, parents[BASE_DEGREE..]);
-
-                                    LittleEndian::write_u32_into(&parents, entry);
-                                    Ok(())
-                                });
-
-                            BOOST_LOG_TRIVIAL(info) << "parent cache: generated";
-                            data.flush().context("failed to flush parent cache");
-                            drop(data);
+                            const std::uint32_t format = settings::SETTINGS.lock().parent_cache_format;
+                            const std::size_t threads = std::max(1U, std::thread::hardware_concurrency());
+
+                            // Log roughly every percent.
+                            std::uint64_t logged = 0;
+                            const auto progress = [&](std::uint64_t done, std::uint64_t total) {
+                                if (done == total || (done - logged) * 100 >= total) {
+                                    BOOST_LOG_TRIVIAL(info) << std::format("parent cache: generated {}/{} nodes ({}%)",
+                                                                           done, total, done * 100 / total);
+                                    logged = done;
+                                }
+                            };
+
+                            write_parent_cache(
+                                file.string(), format, cache_entries,
+                                [&](std::uint64_t first, std::size_t count, std::uint32_t *parents) {
+                                    generate_parents(graph, first, count, parents);
+                                },
+                                threads, progress);
 
                             BOOST_LOG_TRIVIAL(info) << "parent cache: written to disk";
                         });
@@ -202,14 +367,49 @@ namespace nil {
 
                         // Shift cache by its current size.
                         std::size_t new_offset = (num_cache_entries - cache.len).min(cache.offset + cache.len);
-                        cache.shift(new_offset);
+                        if (prefetched.valid() && prefetched_offset == new_offset) {
+                            // The next window was read ahead, swap it in and let the background thread drop the
+                            // consumed one.
+                            CacheData consumed = std::move(cache);
+                            cache = prefetched.get();
+                            prefetch_next(std::move(consumed));
+                        } else {
+                            cache.shift(new_offset);
+                            prefetch_next();
+                        }
 
                         return cache.read(node);
                     }
 
                     /// Resets the partial cache to the beginning.
                     void reset() {
+                        if (prefetched.valid()) {
+                            prefetched.wait();
+                            prefetched = {};
+                        }
                         cache.reset();
+                        prefetch_next();
+                    }
+
+                    /// Starts reading the window following the current one on a background thread, which
+                    /// first releases `consumed`, the window just left behind. Does nothing on the last window,
+                    /// for shared caches, which shift in place, or when `sdr_parents_cache_prefetch` is off.
+                    void prefetch_next(CacheData consumed = {}) {
+                        const std::uint32_t next_offset =
+                            std::min(num_cache_entries - cache.len, cache.offset + cache.len);
+                        if (next_offset == cache.offset || cache.shared ||
+                            !settings::SETTINGS.lock().sdr_parents_cache_prefetch) {
+                            return;
+                        }
+
+                        prefetched_offset = next_offset;
+                        prefetched = std::async(std::launch::async, [path = path, next_offset, len = cache.len,
+                                                                     consumed = std::move(consumed)]() mutable {
+                            consumed = CacheData();
+                            CacheData next = CacheData::open(next_offset, len, path);
+                            next.prefault();
+                            return next;
+                        });
                     }
 
                     /// Disk path for the cache.
@@ -217,8 +417,39 @@ namespace nil {
                     /// The total number of cache entries.
                     std::uint32_t num_cache_entries;
                     CacheData cache;
+                    /// The window following `cache`, being read ahead.
+                    std::future<CacheData> prefetched;
+                    /// Offset in nodes of `prefetched`.
+                    std::uint32_t prefetched_offset = 0;
                 };
 
+                /// Calls `f(window, first, last)` for consecutive parents cache windows covering nodes
+                /// `[0, num_nodes)`, `window` holding the parents of at least `[first, last)`. Raw and shared
+                /// caches are used as a single window, compressed caches are decoded `window_nodes` nodes at
+                /// a time so that only one window is held in memory.
+                template<typename F>
+                void for_each_parent_cache_window(const ParentCache &cache, std::uint64_t num_nodes, F f,
+                                                  std::uint32_t window_nodes = COMPRESSED_CACHE_WINDOW_NODES) {
+                    // The shared copy the cache is attached to already holds every node.
+                    if (cache.cache.shared) {
+                        const CacheData window =
+                            CacheData::open_shared(cache.cache.shared, 0, cache.num_cache_entries, cache.path);
+                        f(window, 0, num_nodes);
+                        return;
+                    }
+                    if (!compressed_cache_reader::is_compressed(cache.path.string())) {
+                        const CacheData window = CacheData::open(0, cache.num_cache_entries, cache.path);
+                        f(window, 0, num_nodes);
+                        return;
+                    }
+
+                    for (std::uint64_t first = 0; first < num_nodes; first += window_nodes) {
+                        const std::uint64_t last = std::min<std::uint64_t>(first + window_nodes, num_nodes);
+                        const CacheData window = CacheData::open(first, last - first, cache.path);
+                        f(window, first, last);
+                    }
+                }
+
                 std::string parent_cache_dir_name() {
                     return settings::SETTINGS.lock().parent_cache.clone();
                 }
@@ -241,8 +472,25 @@ namespace nil {
                     hash<FormatHash>(cache_entries, acc);
 
                     typename FormatHash::digest_type h = accumulators::extract::hash<FormatHash>(acc);
-                    return boost::filesystem::path(parent_cache_dir_name() + "v" + std::to_string(VERSION) +
-                                                   "-sdr-parent-" + encode<codec::hex>(h) + ".cache");
+
+                    // Raw caches keep their historical name, other formats are told apart by their suffix.
+                    const std::uint32_t format = settings::SETTINGS.lock().parent_cache_format;
+                    const std::string name = parent_cache_dir_name() + "v" + std::to_string(VERSION) +
+                                             "-sdr-parent-" + encode<codec::hex>(h);
+                    const boost::filesystem::path raw_path(name + ".cache");
+                    if (format == RAW_PARENT_CACHE_FORMAT) {
+                        return raw_path;
+                    }
+
+                    // An existing raw cache is used as is rather than generating the same parents again in
+                    // another format; readers tell the formats apart by their contents.
+                    const boost::filesystem::path path(name + "-f" + std::to_string(format) + ".cache");
+                    boost::system::error_code ec;
+                    if (!boost::filesystem::exists(path, ec) && boost::filesystem::exists(raw_path, ec)) {
+                        BOOST_LOG_TRIVIAL(info) << std::format("using existing raw parent cache {}", raw_path.string());
+                        return raw_path;
+                    }
+                    return path;
                 }
             }    // namespace vanilla
         }        // namespace stacked
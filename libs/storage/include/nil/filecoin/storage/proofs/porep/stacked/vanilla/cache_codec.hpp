@@ -0,0 +1,353 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_CACHE_CODEC_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_CACHE_CODEC_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <nil/filecoin/storage/proofs/core/crypto/sha256_compress.hpp>
+
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/graph.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                /// Compressed parents cache (format 2).
+                ///
+                /// The raw format stores DEGREE little-endian u32 per node. Format 2 groups nodes into blocks of
+                /// `COMPRESSED_BLOCK_NODES`; inside a block the base parents of every node are stored as LEB128
+                /// varints of their distance to the node (the last one is always 1, most others are short),
+                /// and the expander parents are bit-packed with just enough bits to address the graph.
+                ///
+                /// File layout, all integers little-endian:
+                ///   header: magic u64 | degree u32 | block nodes u32 | nodes u64 | expander bits u32 | 0 u32
+                ///   index:  per block, payload offset u64 | payload size u32 | checksum u32
+                ///   payloads: base section size u32 | base varints | expander bit stream
+                ///
+                /// The checksum of a block is the first four bytes of the SHA-256 of its payload, so every
+                /// block is verified as it is decoded and a damaged cache is detected block by block.
+
+                constexpr static const std::uint64_t COMPRESSED_PARENT_CACHE_MAGIC = 0x3263706564726473;    // "sdrdepc2"
+
+                constexpr static const std::size_t COMPRESSED_BLOCK_NODES = 4096;
+
+                constexpr static const std::size_t COMPRESSED_HEADER_SIZE = 32;
+                constexpr static const std::size_t COMPRESSED_INDEX_ENTRY_SIZE = 16;
+
+                struct compressed_cache_error : public std::runtime_error {
+                    using std::runtime_error::runtime_error;
+                };
+
+                namespace cache_codec {
+                    inline void put_le(std::vector<std::uint8_t> &out, std::uint64_t value, std::size_t bytes) {
+                        for (std::size_t i = 0; i < bytes; ++i) {
+                            out.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+                        }
+                    }
+
+                    inline std::uint64_t get_le(const std::uint8_t *in, std::size_t bytes) {
+                        std::uint64_t value = 0;
+                        for (std::size_t i = 0; i < bytes; ++i) {
+                            value |= std::uint64_t(in[i]) << (8 * i);
+                        }
+                        return value;
+                    }
+
+                    inline std::uint32_t checksum(const std::uint8_t *payload, std::size_t size) {
+                        const std::array<std::uint8_t, sha256::DIGEST_SIZE> digest = sha256::digest(payload, size);
+                        return static_cast<std::uint32_t>(get_le(digest.data(), 4));
+                    }
+
+                    /// Bits needed to store any node index of a graph with `nodes` nodes.
+                    inline std::uint32_t expander_bits(std::uint64_t nodes) {
+                        return std::max<std::uint32_t>(1, std::bit_width(nodes - 1));
+                    }
+
+                    /// Header of a compressed cache of `nodes` nodes.
+                    inline std::vector<std::uint8_t> compressed_header(std::uint64_t nodes) {
+                        std::vector<std::uint8_t> header;
+                        put_le(header, COMPRESSED_PARENT_CACHE_MAGIC, 8);
+                        put_le(header, DEGREE, 4);
+                        put_le(header, COMPRESSED_BLOCK_NODES, 4);
+                        put_le(header, nodes, 8);
+                        put_le(header, expander_bits(nodes), 4);
+                        put_le(header, 0, 4);
+                        return header;
+                    }
+
+                    /// Encodes the parents of nodes `[first_node, first_node + count)`, DEGREE per node.
+                    inline std::vector<std::uint8_t> encode_block(const std::uint32_t *parents, std::uint64_t first_node,
+                                                                  std::size_t count, std::uint32_t exp_bits) {
+                        std::vector<std::uint8_t> base;
+                        base.reserve(count * BASE_DEGREE * 2);
+                        for (std::size_t i = 0; i < count; ++i) {
+                            const std::uint64_t node = first_node + i;
+                            for (std::size_t j = 0; j < BASE_DEGREE; ++j) {
+                                std::uint64_t distance = node - parents[i * DEGREE + j];
+                                for (; distance >= 0x80; distance >>= 7) {
+                                    base.push_back(static_cast<std::uint8_t>(distance | 0x80));
+                                }
+                                base.push_back(static_cast<std::uint8_t>(distance));
+                            }
+                        }
+
+                        std::vector<std::uint8_t> payload;
+                        payload.reserve(4 + base.size() + (count * EXP_DEGREE * exp_bits + 7) / 8);
+                        put_le(payload, base.size(), 4);
+                        payload.insert(payload.end(), base.begin(), base.end());
+
+                        std::uint64_t bits = 0;
+                        std::size_t pending = 0;
+                        for (std::size_t i = 0; i < count; ++i) {
+                            for (std::size_t j = BASE_DEGREE; j < DEGREE; ++j) {
+                                bits |= std::uint64_t(parents[i * DEGREE + j]) << pending;
+                                pending += exp_bits;
+                                for (; pending >= 8; pending -= 8, bits >>= 8) {
+                                    payload.push_back(static_cast<std::uint8_t>(bits));
+                                }
+                            }
+                        }
+                        if (pending > 0) {
+                            payload.push_back(static_cast<std::uint8_t>(bits));
+                        }
+                        return payload;
+                    }
+
+                    /// Decodes a block produced by `encode_block` into `parents`. Throws on malformed input.
+                    inline void decode_block(const std::uint8_t *payload, std::size_t size, std::uint64_t first_node,
+                                             std::size_t count, std::uint32_t exp_bits, std::uint32_t *parents) {
+                        if (size < 4) {
+                            throw compressed_cache_error("truncated parents cache block");
+                        }
+                        const std::size_t base_size = get_le(payload, 4);
+                        const std::uint8_t *in = payload + 4;
+                        const std::uint8_t *base_end = in + base_size;
+                        const std::uint8_t *end = payload + size;
+                        if (base_size > size - 4 ||
+                            std::size_t(end - base_end) < (count * EXP_DEGREE * exp_bits + 7) / 8) {
+                            throw compressed_cache_error("truncated parents cache block");
+                        }
+
+                        for (std::size_t i = 0; i < count; ++i) {
+                            const std::uint64_t node = first_node + i;
+                            for (std::size_t j = 0; j < BASE_DEGREE; ++j) {
+                                std::uint64_t distance = 0;
+                                for (unsigned shift = 0;; shift += 7) {
+                                    if (in == base_end || shift > 35) {
+                                        throw compressed_cache_error("malformed parents cache block");
+                                    }
+                                    const std::uint8_t byte = *in++;
+                                    distance |= std::uint64_t(byte & 0x7f) << shift;
+                                    if (!(byte & 0x80)) {
+                                        break;
+                                    }
+                                }
+                                if (distance > node) {
+                                    throw compressed_cache_error("malformed parents cache block");
+                                }
+                                parents[i * DEGREE + j] = static_cast<std::uint32_t>(node - distance);
+                            }
+                        }
+
+                        const std::uint64_t mask = (std::uint64_t(1) << exp_bits) - 1;
+                        std::uint64_t bits = 0;
+                        std::size_t available = 0;
+                        in = base_end;
+                        for (std::size_t i = 0; i < count; ++i) {
+                            for (std::size_t j = BASE_DEGREE; j < DEGREE; ++j) {
+                                for (; available < exp_bits; available += 8) {
+                                    bits |= std::uint64_t(*in++) << available;
+                                }
+                                parents[i * DEGREE + j] = static_cast<std::uint32_t>(bits & mask);
+                                bits >>= exp_bits;
+                                available -= exp_bits;
+                            }
+                        }
+                    }
+                }    // namespace cache_codec
+
+                /// Streams a compressed parents cache to disk. `fill(first_node, count, parents)` is called
+                /// for consecutive blocks and has to store the DEGREE parents of each of the `count` nodes.
+                template<typename FillParents>
+                void write_compressed_parent_cache(const std::string &path, std::uint64_t nodes, FillParents &&fill) {
+                    const std::uint32_t exp_bits = cache_codec::expander_bits(nodes);
+                    const std::uint64_t blocks = (nodes + COMPRESSED_BLOCK_NODES - 1) / COMPRESSED_BLOCK_NODES;
+
+                    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+                    const std::vector<std::uint8_t> header = cache_codec::compressed_header(nodes);
+                    out.write(reinterpret_cast<const char *>(header.data()), header.size());
+
+                    // The index is rewritten once all payload sizes are known.
+                    std::vector<std::uint8_t> index(blocks * COMPRESSED_INDEX_ENTRY_SIZE, 0);
+                    out.write(reinterpret_cast<const char *>(index.data()), index.size());
+                    index.clear();
+
+                    std::uint64_t offset = COMPRESSED_HEADER_SIZE + blocks * COMPRESSED_INDEX_ENTRY_SIZE;
+                    std::vector<std::uint32_t> parents(COMPRESSED_BLOCK_NODES * DEGREE);
+                    for (std::uint64_t block = 0; block < blocks; ++block) {
+                        const std::uint64_t first_node = block * COMPRESSED_BLOCK_NODES;
+                        const std::size_t count = std::min<std::uint64_t>(COMPRESSED_BLOCK_NODES, nodes - first_node);
+
+                        fill(first_node, count, parents.data());
+                        const std::vector<std::uint8_t> payload =
+                            cache_codec::encode_block(parents.data(), first_node, count, exp_bits);
+                        out.write(reinterpret_cast<const char *>(payload.data()), payload.size());
+
+                        cache_codec::put_le(index, offset, 8);
+                        cache_codec::put_le(index, payload.size(), 4);
+                        cache_codec::put_le(index, cache_codec::checksum(payload.data(), payload.size()), 4);
+                        offset += payload.size();
+                    }
+
+                    out.seekp(COMPRESSED_HEADER_SIZE);
+                    out.write(reinterpret_cast<const char *>(index.data()), index.size());
+                    if (!out.flush()) {
+                        throw compressed_cache_error("failed to write parents cache " + path);
+                    }
+                }
+
+                /// Random access to a compressed parents cache: decodes and verifies the blocks covering a
+                /// node range.
+                class compressed_cache_reader {
+                public:
+                    /// Returns whether the file at `path` is a compressed parents cache.
+                    static bool is_compressed(const std::string &path) {
+                        std::ifstream in(path, std::ios::binary);
+                        std::array<std::uint8_t, 8> magic;
+                        return in.read(reinterpret_cast<char *>(magic.data()), magic.size()) &&
+                               cache_codec::get_le(magic.data(), 8) == COMPRESSED_PARENT_CACHE_MAGIC;
+                    }
+
+                    explicit compressed_cache_reader(const std::string &path) : path_(path), in_(path, std::ios::binary) {
+                        std::array<std::uint8_t, COMPRESSED_HEADER_SIZE> header;
+                        if (!in_.read(reinterpret_cast<char *>(header.data()), header.size()) ||
+                            cache_codec::get_le(header.data(), 8) != COMPRESSED_PARENT_CACHE_MAGIC) {
+                            throw compressed_cache_error("not a compressed parents cache: " + path);
+                        }
+                        if (cache_codec::get_le(header.data() + 8, 4) != DEGREE) {
+                            throw compressed_cache_error("parents cache degree mismatch: " + path);
+                        }
+                        block_nodes_ = cache_codec::get_le(header.data() + 12, 4);
+                        nodes_ = cache_codec::get_le(header.data() + 16, 8);
+                        exp_bits_ = cache_codec::get_le(header.data() + 24, 4);
+                        if (block_nodes_ == 0 || exp_bits_ == 0 || exp_bits_ > 32) {
+                            throw compressed_cache_error("corrupted parents cache header: " + path);
+                        }
+
+                        const std::uint64_t blocks = (nodes_ + block_nodes_ - 1) / block_nodes_;
+                        index_.resize(blocks * COMPRESSED_INDEX_ENTRY_SIZE);
+                        if (!in_.read(reinterpret_cast<char *>(index_.data()), index_.size())) {
+                            throw compressed_cache_error("truncated parents cache index: " + path);
+                        }
+                    }
+
+                    std::uint64_t nodes() const {
+                        return nodes_;
+                    }
+
+                    /// Decodes the parents of nodes `[first_node, first_node + count)` into `parents`, DEGREE
+                    /// per node, reading the blocks in order. Throws if a block fails its checksum.
+                    void decode_range(std::uint64_t first_node, std::uint64_t count, std::uint32_t *parents) {
+                        if (first_node + count > nodes_) {
+                            throw compressed_cache_error("parents cache range out of bounds");
+                        }
+
+                        std::vector<std::uint32_t> block_parents(block_nodes_ * DEGREE);
+                        for (std::uint64_t node = first_node; node < first_node + count;) {
+                            const std::uint64_t block = node / block_nodes_;
+                            const std::uint64_t block_first = block * block_nodes_;
+                            const std::uint64_t block_count = std::min<std::uint64_t>(block_nodes_, nodes_ - block_first);
+
+                            decode(block, block_first, block_count, block_parents.data());
+
+                            const std::uint64_t take = std::min(block_first + block_count, first_node + count) - node;
+                            std::copy(block_parents.begin() + (node - block_first) * DEGREE,
+                                      block_parents.begin() + (node - block_first + take) * DEGREE,
+                                      parents + (node - first_node) * DEGREE);
+                            node += take;
+                        }
+                    }
+
+                    /// Checks the checksum of every block.
+                    bool verify() {
+                        try {
+                            std::vector<std::uint8_t> payload;
+                            for (std::uint64_t block = 0; block < index_.size() / COMPRESSED_INDEX_ENTRY_SIZE; ++block) {
+                                read_payload(block, payload);
+                            }
+                            return true;
+                        } catch (const compressed_cache_error &) {
+                            return false;
+                        }
+                    }
+
+                private:
+                    void read_payload(std::uint64_t block, std::vector<std::uint8_t> &payload) {
+                        const std::uint8_t *entry = index_.data() + block * COMPRESSED_INDEX_ENTRY_SIZE;
+                        const std::uint64_t offset = cache_codec::get_le(entry, 8);
+                        const std::size_t size = cache_codec::get_le(entry + 8, 4);
+
+                        payload.resize(size);
+                        in_.clear();
+                        in_.seekg(offset);
+                        if (!in_.read(reinterpret_cast<char *>(payload.data()), size) ||
+                            cache_codec::checksum(payload.data(), size) != cache_codec::get_le(entry + 12, 4)) {
+                            throw compressed_cache_error("corrupted parents cache block " + std::to_string(block) +
+                                                         " in " + path_);
+                        }
+                    }
+
+                    void decode(std::uint64_t block, std::uint64_t first_node, std::uint64_t count,
+                                std::uint32_t *parents) {
+                        read_payload(block, payload_);
+                        cache_codec::decode_block(payload_.data(), payload_.size(), first_node, count, exp_bits_,
+                                                  parents);
+                    }
+
+                    std::string path_;
+                    std::ifstream in_;
+                    std::uint64_t block_nodes_ = 0;
+                    std::uint64_t nodes_ = 0;
+                    std::uint32_t exp_bits_ = 0;
+                    std::vector<std::uint8_t> index_;
+                    std::vector<std::uint8_t> payload_;
+                };
+            }    // namespace vanilla
+        }        // namespace stacked
+    }            // namespace filecoin
+}    // namespace nil
+
+#endif
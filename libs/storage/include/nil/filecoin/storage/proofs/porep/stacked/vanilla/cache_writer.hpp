@@ -0,0 +1,485 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_CACHE_WRITER_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_CACHE_WRITER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <nil/filecoin/storage/proofs/core/crypto/sha256_compress.hpp>
+
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_codec.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                /// Resumable parents cache generation.
+                ///
+                /// The cache is generated in segments of `GENERATION_SEGMENT_NODES` nodes, computed in
+                /// parallel and appended in order to `<path>.partial`. Every `GENERATION_CHECKPOINT_SEGMENTS`
+                /// segments the data is synced and a `<path>.progress` record (segments done, end of data and
+                /// the digest so far) is renamed into place, so an interrupted generation resumes from the last
+                /// record instead of starting over.
+                ///
+                /// The digest chains the SHA-256 of every segment's bytes: d_i = SHA-256(d_{i-1} || SHA-256(s_i)).
+                /// Once all segments are written it is stored in `<path>.digest`, and only then the partial file
+                /// is renamed to `path`; a cache file at `path` is therefore always complete.
+
+                /// On-disk formats of the parents cache, selected by the `parent_cache_format` setting.
+                constexpr static const std::uint32_t RAW_PARENT_CACHE_FORMAT = 1;
+                constexpr static const std::uint32_t COMPRESSED_PARENT_CACHE_FORMAT = 2;
+
+                /// Nodes per generation segment, a multiple of `COMPRESSED_BLOCK_NODES`.
+                constexpr static const std::size_t GENERATION_SEGMENT_NODES = 1 << 16;
+                /// Segments between two progress records.
+                constexpr static const std::size_t GENERATION_CHECKPOINT_SEGMENTS = 64;
+
+                constexpr static const std::uint64_t PARENT_CACHE_PROGRESS_MAGIC = 0x3167727064726473;    // "sdrdprg1"
+                constexpr static const std::uint64_t PARENT_CACHE_DIGEST_MAGIC = 0x3167696464726473;      // "sdrddig1"
+
+                /// Called with the number of nodes written so far and the total number of nodes.
+                typedef std::function<void(std::uint64_t, std::uint64_t)> parent_cache_progress_type;
+
+                inline std::string parent_cache_partial_path(const std::string &path) {
+                    return path + ".partial";
+                }
+
+                inline std::string parent_cache_progress_path(const std::string &path) {
+                    return path + ".progress";
+                }
+
+                inline std::string parent_cache_digest_path(const std::string &path) {
+                    return path + ".digest";
+                }
+
+                namespace cache_writer {
+                    typedef std::array<std::uint8_t, sha256::DIGEST_SIZE> digest_type;
+
+                    /// State of a generation, persisted as the progress record and, once complete, as the
+                    /// digest record.
+                    /// Layout (LE): magic u64 | format u32 | segment nodes u32 | nodes u64 | segments done u64 |
+                    /// end of data u64 | digest.
+                    struct generation_state {
+                        std::uint32_t format = RAW_PARENT_CACHE_FORMAT;
+                        std::uint32_t segment_nodes = GENERATION_SEGMENT_NODES;
+                        std::uint64_t nodes = 0;
+                        std::uint64_t segments_done = 0;
+                        std::uint64_t data_end = 0;
+                        digest_type digest = {};
+                    };
+
+                    constexpr static const std::size_t STATE_SIZE = 8 + 4 + 4 + 8 + 8 + 8 + sha256::DIGEST_SIZE;
+
+                    inline void write_state(const std::string &path, std::uint64_t magic,
+                                            const generation_state &state) {
+                        std::vector<std::uint8_t> record;
+                        cache_codec::put_le(record, magic, 8);
+                        cache_codec::put_le(record, state.format, 4);
+                        cache_codec::put_le(record, state.segment_nodes, 4);
+                        cache_codec::put_le(record, state.nodes, 8);
+                        cache_codec::put_le(record, state.segments_done, 8);
+                        cache_codec::put_le(record, state.data_end, 8);
+                        record.insert(record.end(), state.digest.begin(), state.digest.end());
+
+                        const std::string tmp_path = path + ".tmp";
+                        {
+                            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+                            out.write(reinterpret_cast<const char *>(record.data()), record.size());
+                            if (!out.flush()) {
+                                throw std::runtime_error("failed to write " + tmp_path);
+                            }
+                        }
+                        boost::filesystem::rename(tmp_path, path);
+                    }
+
+                    inline std::optional<generation_state> read_state(const std::string &path, std::uint64_t magic) {
+                        std::array<std::uint8_t, STATE_SIZE> record;
+                        std::ifstream in(path, std::ios::binary);
+                        if (!in.read(reinterpret_cast<char *>(record.data()), record.size()) ||
+                            cache_codec::get_le(record.data(), 8) != magic) {
+                            return std::nullopt;
+                        }
+
+                        generation_state state;
+                        state.format = cache_codec::get_le(record.data() + 8, 4);
+                        state.segment_nodes = cache_codec::get_le(record.data() + 12, 4);
+                        state.nodes = cache_codec::get_le(record.data() + 16, 8);
+                        state.segments_done = cache_codec::get_le(record.data() + 24, 8);
+                        state.data_end = cache_codec::get_le(record.data() + 32, 8);
+                        std::copy(record.begin() + 40, record.end(), state.digest.begin());
+                        return state;
+                    }
+
+                    inline digest_type chain(const digest_type &digest, const digest_type &segment_digest) {
+                        std::array<std::uint8_t, 2 * sha256::DIGEST_SIZE> data;
+                        std::copy(digest.begin(), digest.end(), data.begin());
+                        std::copy(segment_digest.begin(), segment_digest.end(), data.begin() + sha256::DIGEST_SIZE);
+                        return sha256::digest(data.data(), data.size());
+                    }
+
+                    inline void pwrite_all(int fd, const std::uint8_t *data, std::size_t size, std::uint64_t offset,
+                                           const std::string &path) {
+                        while (size > 0) {
+                            const ssize_t written = ::pwrite(fd, data, size, offset);
+                            if (written < 0) {
+                                if (errno == EINTR) {
+                                    continue;
+                                }
+                                throw std::system_error(errno, std::generic_category(), "could not write " + path);
+                            }
+                            data += written;
+                            size -= written;
+                            offset += written;
+                        }
+                    }
+
+                    inline void pread_all(int fd, std::uint8_t *data, std::size_t size, std::uint64_t offset,
+                                          const std::string &path) {
+                        while (size > 0) {
+                            const ssize_t read = ::pread(fd, data, size, offset);
+                            if (read < 0) {
+                                if (errno == EINTR) {
+                                    continue;
+                                }
+                                throw std::system_error(errno, std::generic_category(), "could not read " + path);
+                            }
+                            if (read == 0) {
+                                throw std::runtime_error("unexpected end of file " + path);
+                            }
+                            data += read;
+                            size -= read;
+                            offset += read;
+                        }
+                    }
+
+                    inline std::uint64_t data_start(std::uint32_t format, std::uint64_t nodes) {
+                        if (format == RAW_PARENT_CACHE_FORMAT) {
+                            return 0;
+                        }
+                        const std::uint64_t blocks = (nodes + COMPRESSED_BLOCK_NODES - 1) / COMPRESSED_BLOCK_NODES;
+                        return COMPRESSED_HEADER_SIZE + blocks * COMPRESSED_INDEX_ENTRY_SIZE;
+                    }
+
+                    /// A generated segment: its bytes, appended at the end of data, and for compressed caches
+                    /// the sizes and checksums of its blocks.
+                    struct segment_type {
+                        std::vector<std::uint8_t> data;
+                        std::vector<std::uint8_t> blocks;
+                        digest_type digest;
+                    };
+
+                    template<typename FillParents>
+                    segment_type generate_segment(std::uint32_t format, std::uint64_t nodes, std::uint64_t segment,
+                                                  FillParents &fill) {
+                        const std::uint64_t first = segment * GENERATION_SEGMENT_NODES;
+                        const std::size_t count = std::min<std::uint64_t>(GENERATION_SEGMENT_NODES, nodes - first);
+
+                        std::vector<std::uint32_t> parents(count * DEGREE);
+                        fill(first, count, parents.data());
+
+                        segment_type result;
+                        if (format == RAW_PARENT_CACHE_FORMAT) {
+                            result.data.reserve(parents.size() * sizeof(std::uint32_t));
+                            for (std::uint32_t parent : parents) {
+                                cache_codec::put_le(result.data, parent, sizeof(std::uint32_t));
+                            }
+                        } else {
+                            const std::uint32_t exp_bits = cache_codec::expander_bits(nodes);
+                            for (std::size_t block = 0; block < count; block += COMPRESSED_BLOCK_NODES) {
+                                const std::size_t block_count = std::min(COMPRESSED_BLOCK_NODES, count - block);
+                                const std::vector<std::uint8_t> payload = cache_codec::encode_block(
+                                    parents.data() + block * DEGREE, first + block, block_count, exp_bits);
+                                cache_codec::put_le(result.blocks, payload.size(), 4);
+                                const std::uint32_t checksum = cache_codec::checksum(payload.data(), payload.size());
+                                cache_codec::put_le(result.blocks, checksum, 4);
+                                result.data.insert(result.data.end(), payload.begin(), payload.end());
+                            }
+                        }
+                        result.digest = sha256::digest(result.data.data(), result.data.size());
+                        return result;
+                    }
+                }    // namespace cache_writer
+
+                /// Generates the parents cache of `nodes` nodes at `path` in `format` with `threads` threads,
+                /// resuming an interrupted generation of the same cache. `fill(first_node, count, parents)` has
+                /// to store the DEGREE parents of each of the `count` nodes and is called concurrently.
+                template<typename FillParents>
+                void write_parent_cache(const std::string &path, std::uint32_t format, std::uint64_t nodes,
+                                        FillParents &&fill, std::size_t threads,
+                                        const parent_cache_progress_type &progress = {}) {
+                    using namespace cache_writer;
+
+                    const std::string partial_path = parent_cache_partial_path(path);
+                    const std::string progress_path = parent_cache_progress_path(path);
+                    const std::uint64_t segments = (nodes + GENERATION_SEGMENT_NODES - 1) / GENERATION_SEGMENT_NODES;
+
+                    generation_state state;
+                    state.format = format;
+                    state.nodes = nodes;
+                    state.data_end = data_start(format, nodes);
+
+                    int fd = -1;
+                    const std::optional<generation_state> resumed =
+                        read_state(progress_path, PARENT_CACHE_PROGRESS_MAGIC);
+                    if (resumed && resumed->format == format && resumed->nodes == nodes &&
+                        resumed->segment_nodes == GENERATION_SEGMENT_NODES && resumed->segments_done <= segments) {
+                        fd = ::open(partial_path.c_str(), O_RDWR | O_CLOEXEC);
+                    }
+                    if (fd >= 0) {
+                        state = *resumed;
+                        BOOST_LOG_TRIVIAL(info) << std::format("parent cache: resuming generation at segment {} of {}",
+                                                               state.segments_done, segments);
+                    } else {
+                        fd = ::open(partial_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                        if (fd < 0) {
+                            throw std::system_error(errno, std::generic_category(), "could not create " + partial_path);
+                        }
+                        if (format == COMPRESSED_PARENT_CACHE_FORMAT) {
+                            const std::vector<std::uint8_t> header = cache_codec::compressed_header(nodes);
+                            pwrite_all(fd, header.data(), header.size(), 0, partial_path);
+                        }
+                        write_state(progress_path, PARENT_CACHE_PROGRESS_MAGIC, state);
+                    }
+
+                    // Segments are generated by `threads` workers, at most `window` of them ahead of the
+                    // segment being written, and committed in order by the calling thread.
+                    const std::uint64_t window = 2 * threads;
+                    std::atomic<std::uint64_t> next_segment(state.segments_done);
+                    std::uint64_t committed = state.segments_done;
+                    std::map<std::uint64_t, segment_type> ready;
+                    std::exception_ptr error;
+                    bool failed = false;
+                    std::mutex mutex;
+                    std::condition_variable changed;
+
+                    const auto work = [&]() {
+                        try {
+                            for (;;) {
+                                const std::uint64_t segment = next_segment.fetch_add(1);
+                                if (segment >= segments) {
+                                    return;
+                                }
+                                {
+                                    std::unique_lock<std::mutex> lock(mutex);
+                                    changed.wait(lock, [&] { return failed || segment < committed + window; });
+                                    if (failed) {
+                                        return;
+                                    }
+                                }
+
+                                segment_type result = generate_segment(format, nodes, segment, fill);
+
+                                std::lock_guard<std::mutex> lock(mutex);
+                                ready.emplace(segment, std::move(result));
+                                changed.notify_all();
+                            }
+                        } catch (...) {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            if (!failed) {
+                                failed = true;
+                                error = std::current_exception();
+                            }
+                            changed.notify_all();
+                        }
+                    };
+
+                    std::vector<std::thread> workers;
+                    const auto stop = [&]() {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            failed = true;
+                            changed.notify_all();
+                        }
+                        for (std::thread &worker : workers) {
+                            worker.join();
+                        }
+                        ::close(fd);
+                    };
+
+                    try {
+                        for (std::size_t i = 0; i < threads; ++i) {
+                            workers.emplace_back(work);
+                        }
+
+                        while (state.segments_done < segments) {
+                            segment_type segment;
+                            {
+                                std::unique_lock<std::mutex> lock(mutex);
+                                changed.wait(lock, [&] { return error || ready.count(state.segments_done) != 0; });
+                                if (ready.count(state.segments_done) == 0) {
+                                    // Keep what was written so far for the next attempt.
+                                    lock.unlock();
+                                    if (::fdatasync(fd) == 0) {
+                                        write_state(progress_path, PARENT_CACHE_PROGRESS_MAGIC, state);
+                                    }
+                                    std::rethrow_exception(error);
+                                }
+                                auto it = ready.find(state.segments_done);
+                                segment = std::move(it->second);
+                                ready.erase(it);
+                            }
+
+                            pwrite_all(fd, segment.data.data(), segment.data.size(), state.data_end, partial_path);
+                            if (format == COMPRESSED_PARENT_CACHE_FORMAT) {
+                                // Complete the index entries of the segment's blocks with their offsets.
+                                std::vector<std::uint8_t> index;
+                                std::uint64_t offset = state.data_end;
+                                for (std::size_t i = 0; i < segment.blocks.size(); i += 8) {
+                                    const std::uint64_t size = cache_codec::get_le(segment.blocks.data() + i, 4);
+                                    cache_codec::put_le(index, offset, 8);
+                                    index.insert(index.end(), segment.blocks.begin() + i,
+                                                 segment.blocks.begin() + i + 8);
+                                    offset += size;
+                                }
+                                const std::uint64_t first_block =
+                                    state.segments_done * GENERATION_SEGMENT_NODES / COMPRESSED_BLOCK_NODES;
+                                pwrite_all(fd, index.data(), index.size(),
+                                           COMPRESSED_HEADER_SIZE + first_block * COMPRESSED_INDEX_ENTRY_SIZE,
+                                           partial_path);
+                            }
+
+                            state.data_end += segment.data.size();
+                            state.digest = chain(state.digest, segment.digest);
+                            ++state.segments_done;
+                            {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                committed = state.segments_done;
+                                changed.notify_all();
+                            }
+
+                            if (state.segments_done % GENERATION_CHECKPOINT_SEGMENTS == 0 ||
+                                state.segments_done == segments) {
+                                if (::fdatasync(fd) != 0) {
+                                    throw std::system_error(errno, std::generic_category(),
+                                                            "could not sync " + partial_path);
+                                }
+                                write_state(progress_path, PARENT_CACHE_PROGRESS_MAGIC, state);
+                            }
+                            if (progress) {
+                                progress(std::min<std::uint64_t>(state.segments_done * GENERATION_SEGMENT_NODES, nodes),
+                                         nodes);
+                            }
+                        }
+                        // A resumed generation may have written past the last record, drop anything beyond
+                        // the data.
+                        if (::ftruncate(fd, state.data_end) != 0 || ::fsync(fd) != 0) {
+                            throw std::system_error(errno, std::generic_category(), "could not sync " + partial_path);
+                        }
+                    } catch (...) {
+                        stop();
+                        throw;
+                    }
+                    stop();
+
+                    // The digest record goes first: a cache at `path` always has its digest next to it.
+                    write_state(parent_cache_digest_path(path), PARENT_CACHE_DIGEST_MAGIC, state);
+                    boost::filesystem::rename(partial_path, path);
+                    boost::system::error_code ec;
+                    boost::filesystem::remove(progress_path, ec);
+                }
+
+                /// Recomputes the digest of the parents cache at `path` and compares it with its digest record.
+                /// Returns `std::nullopt` if the cache has no digest record.
+                inline std::optional<bool> verify_parent_cache_digest(const std::string &path) {
+                    using namespace cache_writer;
+
+                    const std::optional<generation_state> expected =
+                        read_state(parent_cache_digest_path(path), PARENT_CACHE_DIGEST_MAGIC);
+                    if (!expected) {
+                        return std::nullopt;
+                    }
+
+                    std::ifstream in(path, std::ios::binary);
+                    std::vector<std::uint8_t> index;
+                    if (expected->format == COMPRESSED_PARENT_CACHE_FORMAT) {
+                        index.resize(data_start(expected->format, expected->nodes) - COMPRESSED_HEADER_SIZE);
+                        in.seekg(COMPRESSED_HEADER_SIZE);
+                        if (!in.read(reinterpret_cast<char *>(index.data()), index.size())) {
+                            return false;
+                        }
+                    }
+
+                    const std::uint64_t segments =
+                        (expected->nodes + expected->segment_nodes - 1) / expected->segment_nodes;
+                    const std::uint64_t blocks_per_segment = expected->segment_nodes / COMPRESSED_BLOCK_NODES;
+                    const std::uint64_t blocks = index.size() / COMPRESSED_INDEX_ENTRY_SIZE;
+
+                    digest_type digest = {};
+                    std::uint64_t offset = data_start(expected->format, expected->nodes);
+                    std::vector<std::uint8_t> data;
+                    for (std::uint64_t segment = 0; segment < segments; ++segment) {
+                        const std::uint64_t first = segment * expected->segment_nodes;
+                        const std::uint64_t count =
+                            std::min<std::uint64_t>(expected->segment_nodes, expected->nodes - first);
+
+                        std::uint64_t size = count * DEGREE * sizeof(std::uint32_t);
+                        if (expected->format == COMPRESSED_PARENT_CACHE_FORMAT) {
+                            size = 0;
+                            for (std::uint64_t block = segment * blocks_per_segment;
+                                 block < std::min(blocks, (segment + 1) * blocks_per_segment); ++block) {
+                                size += cache_codec::get_le(index.data() + block * COMPRESSED_INDEX_ENTRY_SIZE + 8, 4);
+                            }
+                        }
+
+                        data.resize(size);
+                        in.clear();
+                        in.seekg(offset);
+                        if (!in.read(reinterpret_cast<char *>(data.data()), size)) {
+                            return false;
+                        }
+                        digest = chain(digest, sha256::digest(data.data(), size));
+                        offset += size;
+                    }
+                    return digest == expected->digest;
+                }
+            }    // namespace vanilla
+        }        // namespace stacked
+    }            // namespace filecoin
+}    // namespace nil
+
+#endif
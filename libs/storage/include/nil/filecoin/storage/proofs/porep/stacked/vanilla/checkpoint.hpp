@@ -0,0 +1,152 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_CHECKPOINT_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_CHECKPOINT_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <nil/filecoin/storage/proofs/core/crypto/sha256_compress.hpp>
+#include <nil/filecoin/storage/proofs/core/merkle/storage/utilities.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                /// Label layers are persisted under `cache_key::label_layer(layer)` as soon as they are
+                /// generated. A checkpoint sidecar written next to each layer file records which replica and
+                /// layer it belongs to together with the SHA-256 of its contents, so an interrupted
+                /// `generate_labels` can pick up after the last intact layer instead of starting over.
+                ///
+                /// The sidecar is written only once the layer data is on disk and is renamed into place, so
+                /// a layer without a valid sidecar is never trusted.
+
+                /// Sidecar layout: replica id || layer index (u32 LE) || layer size (u64 LE) || digest.
+                constexpr static const std::size_t LAYER_CHECKPOINT_SIZE = 32 + 4 + 8 + sha256::DIGEST_SIZE;
+
+                typedef std::array<std::uint8_t, LAYER_CHECKPOINT_SIZE> layer_checkpoint_type;
+
+                inline boost::filesystem::path layer_checkpoint_path(const StoreConfig &layer_config) {
+                    boost::filesystem::path path(StoreConfig::data_path(layer_config.path, layer_config.id));
+                    path += ".checkpoint";
+                    return path;
+                }
+
+                template<typename ReplicaIdType>
+                layer_checkpoint_type make_layer_checkpoint(const ReplicaIdType &replica_id, std::uint32_t layer,
+                                                            const std::uint8_t *layer_data, std::uint64_t layer_size) {
+                    layer_checkpoint_type checkpoint = {};
+                    auto out = std::copy(std::begin(replica_id), std::end(replica_id), checkpoint.begin());
+                    for (std::size_t i = 0; i < 4; ++i) {
+                        *out++ = static_cast<std::uint8_t>(layer >> (8 * i));
+                    }
+                    for (std::size_t i = 0; i < 8; ++i) {
+                        *out++ = static_cast<std::uint8_t>(layer_size >> (8 * i));
+                    }
+                    const std::array<std::uint8_t, sha256::DIGEST_SIZE> digest = sha256::digest(layer_data, layer_size);
+                    std::copy(digest.begin(), digest.end(), out);
+                    return checkpoint;
+                }
+
+                /// Records `layer_data`, already persisted under `layer_config`, as a complete layer. The
+                /// checkpoint only saves relabeling on resume, so failing to write it is logged, not thrown.
+                template<typename ReplicaIdType>
+                void write_layer_checkpoint(const StoreConfig &layer_config, const ReplicaIdType &replica_id,
+                                            std::uint32_t layer, const std::uint8_t *layer_data,
+                                            std::uint64_t layer_size) {
+                    const layer_checkpoint_type checkpoint =
+                        make_layer_checkpoint(replica_id, layer, layer_data, layer_size);
+
+                    const boost::filesystem::path path = layer_checkpoint_path(layer_config);
+                    boost::filesystem::path tmp_path = path;
+                    tmp_path += ".tmp";
+                    {
+                        std::ofstream out(tmp_path.string(), std::ios::binary | std::ios::trunc);
+                        out.write(reinterpret_cast<const char *>(checkpoint.data()), checkpoint.size());
+                        if (!out.flush()) {
+                            BOOST_LOG_TRIVIAL(warning) << std::format("failed to write checkpoint of layer {}", layer);
+                            return;
+                        }
+                    }
+                    boost::system::error_code ec;
+                    boost::filesystem::rename(tmp_path, path, ec);
+                    if (ec) {
+                        BOOST_LOG_TRIVIAL(warning)
+                            << std::format("failed to write checkpoint of layer {}: {}", layer, ec.message());
+                        boost::filesystem::remove(tmp_path, ec);
+                    }
+                }
+
+                /// Loads the layer persisted under `layer_config` into `layer_data` if it has a checkpoint
+                /// matching `replica_id`, `layer` and its contents. Returns whether the layer can be reused;
+                /// `layer_data` is unspecified otherwise.
+                template<typename ReplicaIdType>
+                bool read_layer_checkpoint(const StoreConfig &layer_config, const ReplicaIdType &replica_id,
+                                           std::uint32_t layer, std::uint8_t *layer_data, std::uint64_t layer_size) {
+                    const boost::filesystem::path data_path(StoreConfig::data_path(layer_config.path, layer_config.id));
+                    const boost::filesystem::path path = layer_checkpoint_path(layer_config);
+
+                    boost::system::error_code ec;
+                    if (!boost::filesystem::exists(path, ec) ||
+                        boost::filesystem::file_size(data_path, ec) != layer_size || ec) {
+                        return false;
+                    }
+
+                    layer_checkpoint_type expected;
+                    std::ifstream sidecar(path.string(), std::ios::binary);
+                    if (!sidecar.read(reinterpret_cast<char *>(expected.data()), expected.size())) {
+                        return false;
+                    }
+
+                    std::ifstream data(data_path.string(), std::ios::binary);
+                    if (!data.read(reinterpret_cast<char *>(layer_data), layer_size)) {
+                        return false;
+                    }
+
+                    if (make_layer_checkpoint(replica_id, layer, layer_data, layer_size) != expected) {
+                        BOOST_LOG_TRIVIAL(warning) << std::format("checkpoint of layer {} does not match its data", layer);
+                        return false;
+                    }
+                    return true;
+                }
+
+                inline void remove_layer_checkpoint(const StoreConfig &layer_config) {
+                    boost::system::error_code ec;
+                    boost::filesystem::remove(layer_checkpoint_path(layer_config), ec);
+                }
+            }    // namespace vanilla
+        }        // namespace stacked
+    }            // namespace filecoin
+}    // namespace nil
+
+#endif
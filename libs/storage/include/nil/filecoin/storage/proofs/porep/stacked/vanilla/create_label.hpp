@@ -27,30 +27,73 @@
 #ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_CREATE_LABEL_HPP
 #define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_CREATE_LABEL_HPP
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+
 #include <nil/crypto3/hash/sha2.hpp>
 #include <nil/crypto3/hash/algorithm/hash.hpp>
 
 #include <nil/crypto3/detail/pack.hpp>
 
+#include <nil/filecoin/storage/proofs/core/utilities.hpp>
+
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/graph.hpp>
 
 namespace nil {
     namespace filecoin {
         namespace stacked {
             namespace vanilla {
-                template<template<typename> class StackedBucketGraph, typename GraphHash,
-                         typename LabelHash = crypto3::hashes::sha2<256>>
-                void create_label(const StackedBucketGraph<GraphHash> &graph, ParentCache &cache,
-                                  const typename GraphHash::digest_type &replica_id,
-                                  std::vector<std::uint8_t> &layer_labels, std::uint32_t layer_index,
-                                  std::uint64_t node) {
+                /// Size of the `layer_index || node` prefix hashed in front of every label.
+                constexpr static const std::size_t LABEL_PREFIX_SIZE = 12;
+
+                /// Builds the big-endian `layer_index || node` prefix of a label. Every labeling
+                /// implementation has to go through this to produce identical labels.
+                inline std::array<std::uint8_t, LABEL_PREFIX_SIZE> label_prefix(std::uint32_t layer_index,
+                                                                                std::uint64_t node) {
+                    std::array<std::uint8_t, LABEL_PREFIX_SIZE> buffer;
+                    for (std::size_t i = 0; i < 4; ++i) {
+                        buffer[i] = static_cast<std::uint8_t>(layer_index >> (24 - 8 * i));
+                    }
+                    for (std::size_t i = 0; i < 8; ++i) {
+                        buffer[4 + i] = static_cast<std::uint8_t>(node >> (56 - 8 * i));
+                    }
+                    return buffer;
+                }
+
+                /// Hashes the parent labels gathered in `parents_data` into `acc`, repeating them until
+                /// `TOTAL_PARENTS` labels were hashed.
+                template<typename LabelHash, typename Accumulator>
+                void hash_parents_data(const std::uint8_t *parents_data, std::size_t parents_count,
+                                       Accumulator &acc) {
                     using namespace nil::crypto3;
 
-                    std::array<std::uint8_t, 12> buffer;
-                    buffer.fill(0);
+                    for (std::size_t i = 0; i < TOTAL_PARENTS; ++i) {
+                        const std::uint8_t *parent = parents_data + (i % parents_count) * NODE_SIZE;
+                        hash<LabelHash>(parent, parent + NODE_SIZE, acc);
+                    }
+                }
 
-                    crypto3::detail::pack({layer_index}, buffer);
-                    crypto3::detail::pack({node}, buffer);
+                /// Stores `digest` as the label of `node`, stripping the last two bits to keep it in Fr.
+                template<typename Digest>
+                void store_label(const Digest &digest, std::uint8_t *layer_labels, std::uint64_t node) {
+                    std::uint8_t *label = layer_labels + data_at_node_offset(node);
+                    std::copy(std::begin(digest), std::begin(digest) + NODE_SIZE, label);
+                    label[NODE_SIZE - 1] &= 0b00111111;
+                }
+
+                /// Labels `node` of the first layer. `parents` is the `ParentCache` or, without it, a
+                /// `graph_parents` of `graph`.
+                template<template<typename> class StackedBucketGraph, typename GraphHash, typename Parents,
+                         typename LabelHash = crypto3::hashes::sha2<256>>
+                void create_label(const StackedBucketGraph<GraphHash> &graph, Parents &parents,
+                                  const typename GraphHash::digest_type &replica_id, std::uint8_t *layer_labels,
+                                  std::uint32_t layer_index, std::uint64_t node) {
+                    using namespace nil::crypto3;
+
+                    const std::array<std::uint8_t, LABEL_PREFIX_SIZE> buffer = label_prefix(layer_index, node);
 
                     accumulator_set<LabelHash> acc;
 
@@ -58,39 +101,32 @@ namespace nil {
                     hash<LabelHash>(replica_id, acc);
 
                     // hash parents for all non 0 nodes
-                    typename LabelHash::digest_type hash;
                     if (node > 0) {
                         // prefetch previous node, which is always a parent
-                        const auto prev = &layer_labels[(node - 1) * NODE_SIZE..node * NODE_SIZE];
-                        _mm_prefetch(prev, _MM_HINT_T0);
-                        hash = graph.copy_parents_data(node, layer_labels, hasher, cache);
-                    } else {
-                        hash = accumulators::extract::hash<LabelHash>(acc);
+                        _mm_prefetch(reinterpret_cast<const char *>(layer_labels + data_at_node_offset(node - 1)),
+                                     _MM_HINT_T0);
+
+                        std::array<std::uint8_t, BASE_DEGREE * NODE_SIZE> parents_data;
+                        copy_parents_data(parents.read(node), layer_labels, parents_data.data());
+                        hash_parents_data<LabelHash>(parents_data.data(), BASE_DEGREE, acc);
                     }
 
                     // store the newly generated key
-                    const auto start = data_at_node_offset(node);
-                    const auto end = start + NODE_SIZE;
-                    layer_labels[start..end].copy_from_slice(&hash[..]);
-
-                    // strip last two bits, to ensure result is in Fr.
-                    layer_labels[end - 1] &= 0b00111111;
+                    store_label(accumulators::extract::hash<LabelHash>(acc), layer_labels, node);
                 }
 
-                template<template<typename> class StackedBucketGraph, typename GraphHash,
-                         typename LabelHash = hashes::sha2<256>>
-                void create_label_exp(const StackedBucketGraph<GraphHash> &graph, ParentCache &cache,
+                /// Labels `node` of a layer above the first one. `exp_labels` holds the previous layer and
+                /// is a buffer independent of `layer_labels`, so callers can alternate the two between
+                /// layers instead of copying the finished layer into the expander position.
+                template<template<typename> class StackedBucketGraph, typename GraphHash, typename Parents,
+                         typename LabelHash = crypto3::hashes::sha2<256>>
+                void create_label_exp(const StackedBucketGraph<GraphHash> &graph, Parents &parents,
                                       const typename GraphHash::digest_type &replica_id,
-                                      const std::vector<std::uint8_t> &exp_parents_data,
-                                      std::vector<std::uint8_t> &layer_labels, std::uint32_t layer_index,
-                                      std::uint64_t node) {
+                                      const std::uint8_t *exp_labels, std::uint8_t *layer_labels,
+                                      std::uint32_t layer_index, std::uint64_t node) {
                     using namespace nil::crypto3;
 
-                    std::array<std::uint8_t, 12> buffer;
-                    buffer.fill(0);
-
-                    crypto3::detail::pack({layer_index}, buffer);
-                    crypto3::detail::pack({node}, buffer);
+                    const std::array<std::uint8_t, LABEL_PREFIX_SIZE> buffer = label_prefix(layer_index, node);
 
                     accumulator_set<LabelHash> acc;
 
@@ -98,24 +134,18 @@ namespace nil {
                     hash<LabelHash>(replica_id, acc);
 
                     // hash parents for all non 0 nodes
-                    typename LabelHash::digest_type hash;
                     if (node > 0) {
                         // prefetch previous node, which is always a parent
-                        const auto prev = &layer_labels[(node - 1) * NODE_SIZE..node * NODE_SIZE];
-                        _mm_prefetch(prev, _MM_HINT_T0);
+                        _mm_prefetch(reinterpret_cast<const char *>(layer_labels + data_at_node_offset(node - 1)),
+                                     _MM_HINT_T0);
 
-                        hash = graph.copy_parents_data_exp(node, layer_labels, exp_parents_data, hasher, cache);
-                    } else {
-                        hash = accumulators::extract::hash<LabelHash>(acc);
+                        std::array<std::uint8_t, DEGREE * NODE_SIZE> parents_data;
+                        copy_parents_data_exp(parents.read(node), layer_labels, exp_labels, parents_data.data());
+                        hash_parents_data<LabelHash>(parents_data.data(), DEGREE, acc);
                     }
 
                     // store the newly generated key
-                    const auto start = data_at_node_offset(node);
-                    const auto end = start + NODE_SIZE;
-                    layer_labels[start..end].copy_from_slice(&hash[..]);
-
-                    // strip last two bits, to ensure result is in Fr.
-                    layer_labels[end - 1] &= 0b00111111;
+                    store_label(accumulators::extract::hash<LabelHash>(acc), layer_labels, node);
                 }
             }    // namespace vanilla
         }        // namespace stacked
@@ -0,0 +1,247 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_COLUMN_HASHES_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_COLUMN_HASHES_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                namespace detail {
+                    namespace processing {
+                        namespace multicore {
+
+                            /// Number of column batches in flight.
+                            constexpr static const std::size_t COLUMN_PIPELINE_DEPTH = 3;
+                            /// Number of columns a hashing worker claims at a time.
+                            constexpr static const std::size_t COLUMN_HASH_CHUNK = 1024;
+
+                            /// Columns of `batch_nodes` consecutive nodes, node-major so that the column of
+                            /// every node is contiguous, and their hashes.
+                            template<typename Digest>
+                            struct ColumnBatch {
+                                std::vector<Digest> columns;
+                                std::vector<Digest> hashes;
+                                /// Number of layers already scattered into `columns`.
+                                std::size_t layers_read = 0;
+                                /// Number of `COLUMN_HASH_CHUNK` chunks already hashed.
+                                std::size_t chunks_hashed = 0;
+                            };
+
+                            /// Computes the column hashes of nodes `[0, nodes)` of `layers` layers in a pipeline:
+                            ///
+                            /// - one reader thread per layer reads `batch_nodes` consecutive labels at a time with
+                            ///   `read_layer(layer, first_node, count, out)`, a sequential read, and scatters them
+                            ///   into the node-major batch,
+                            /// - `hash_threads` workers hash the columns of complete batches, up to
+                            ///   `COLUMN_HASH_CHUNK` at a time, with `hash_columns(columns, count, hashes)`, the
+                            ///   `count` columns being contiguous, so that they can be hashed in SIMD lanes,
+                            /// - the calling thread hands hashed batches in order to
+                            ///   `sink(first_node, count, hashes)`, e.g. to build trees, while the following
+                            ///   batches are being read and hashed.
+                            ///
+                            /// At most `COLUMN_PIPELINE_DEPTH` batches are in flight. `layer` is 0-based.
+                            template<typename Digest, typename ReadLayer, typename HashColumns, typename Sink>
+                            void build_column_hashes(std::size_t layers, std::uint64_t nodes, std::size_t batch_nodes,
+                                                     std::size_t hash_threads, ReadLayer read_layer,
+                                                     HashColumns hash_columns, Sink sink) {
+                                BOOST_ASSERT_MSG(layers > 0, "at least one layer is required");
+                                BOOST_ASSERT_MSG(batch_nodes > 0, "batch size must not be zero");
+                                BOOST_ASSERT_MSG(hash_threads > 0, "at least one hashing thread is required");
+
+                                const std::uint64_t batches = (nodes + batch_nodes - 1) / batch_nodes;
+                                const std::size_t chunks_per_batch =
+                                    (batch_nodes + COLUMN_HASH_CHUNK - 1) / COLUMN_HASH_CHUNK;
+                                const auto batch_count = [&](std::uint64_t batch) {
+                                    return std::min<std::uint64_t>(batch_nodes, nodes - batch * batch_nodes);
+                                };
+                                const auto batch_chunks = [&](std::uint64_t batch) {
+                                    return (batch_count(batch) + COLUMN_HASH_CHUNK - 1) / COLUMN_HASH_CHUNK;
+                                };
+
+                                std::vector<ColumnBatch<Digest>> slots(COLUMN_PIPELINE_DEPTH);
+                                for (ColumnBatch<Digest> &slot : slots) {
+                                    slot.columns.resize(std::min<std::uint64_t>(batch_nodes, nodes) * layers);
+                                    slot.hashes.resize(std::min<std::uint64_t>(batch_nodes, nodes));
+                                }
+
+                                std::mutex mutex;
+                                std::condition_variable changed;
+                                // Number of batches handed to the sink, their slots are free again.
+                                std::uint64_t sunk = 0;
+                                bool failed = false;
+                                std::exception_ptr error;
+
+                                const auto fail = [&]() {
+                                    std::lock_guard<std::mutex> lock(mutex);
+                                    if (!failed) {
+                                        failed = true;
+                                        error = std::current_exception();
+                                    }
+                                    changed.notify_all();
+                                };
+
+                                const auto read = [&](std::size_t layer) {
+                                    try {
+                                        std::vector<Digest> row(std::min<std::uint64_t>(batch_nodes, nodes));
+                                        for (std::uint64_t batch = 0; batch < batches; ++batch) {
+                                            ColumnBatch<Digest> &slot = slots[batch % COLUMN_PIPELINE_DEPTH];
+                                            {
+                                                std::unique_lock<std::mutex> lock(mutex);
+                                                changed.wait(lock, [&] {
+                                                    return failed || batch < sunk + COLUMN_PIPELINE_DEPTH;
+                                                });
+                                                if (failed) {
+                                                    return;
+                                                }
+                                            }
+
+                                            const std::uint64_t count = batch_count(batch);
+                                            read_layer(layer, batch * batch_nodes, count, row.data());
+                                            for (std::uint64_t i = 0; i < count; ++i) {
+                                                slot.columns[i * layers + layer] = row[i];
+                                            }
+
+                                            std::lock_guard<std::mutex> lock(mutex);
+                                            ++slot.layers_read;
+                                            changed.notify_all();
+                                        }
+                                    } catch (...) {
+                                        fail();
+                                    }
+                                };
+
+                                std::atomic<std::uint64_t> next_chunk(0);
+                                const auto hash = [&]() {
+                                    try {
+                                        for (;;) {
+                                            const std::uint64_t unit = next_chunk.fetch_add(1);
+                                            const std::uint64_t batch = unit / chunks_per_batch;
+                                            const std::size_t chunk = unit % chunks_per_batch;
+                                            if (batch >= batches) {
+                                                return;
+                                            }
+                                            if (chunk >= batch_chunks(batch)) {
+                                                continue;
+                                            }
+
+                                            ColumnBatch<Digest> &slot = slots[batch % COLUMN_PIPELINE_DEPTH];
+                                            {
+                                                std::unique_lock<std::mutex> lock(mutex);
+                                                changed.wait(lock, [&] {
+                                                    return failed || (batch < sunk + COLUMN_PIPELINE_DEPTH &&
+                                                                      slot.layers_read == layers);
+                                                });
+                                                if (failed) {
+                                                    return;
+                                                }
+                                            }
+
+                                            const std::uint64_t first = chunk * COLUMN_HASH_CHUNK;
+                                            const std::uint64_t last =
+                                                std::min<std::uint64_t>(first + COLUMN_HASH_CHUNK, batch_count(batch));
+                                            hash_columns(slot.columns.data() + first * layers, last - first,
+                                                         slot.hashes.data() + first);
+
+                                            std::lock_guard<std::mutex> lock(mutex);
+                                            ++slot.chunks_hashed;
+                                            changed.notify_all();
+                                        }
+                                    } catch (...) {
+                                        fail();
+                                    }
+                                };
+
+                                std::vector<std::thread> threads;
+                                const auto join = [&]() {
+                                    {
+                                        std::lock_guard<std::mutex> lock(mutex);
+                                        failed = failed || sunk < batches;
+                                        changed.notify_all();
+                                    }
+                                    for (std::thread &thread : threads) {
+                                        thread.join();
+                                    }
+                                };
+
+                                try {
+                                    for (std::size_t layer = 0; layer < layers; ++layer) {
+                                        threads.emplace_back(read, layer);
+                                    }
+                                    for (std::size_t i = 0; i < hash_threads; ++i) {
+                                        threads.emplace_back(hash);
+                                    }
+
+                                    for (std::uint64_t batch = 0; batch < batches; ++batch) {
+                                        ColumnBatch<Digest> &slot = slots[batch % COLUMN_PIPELINE_DEPTH];
+                                        {
+                                            std::unique_lock<std::mutex> lock(mutex);
+                                            changed.wait(lock, [&] {
+                                                return failed || slot.chunks_hashed == batch_chunks(batch);
+                                            });
+                                            if (failed) {
+                                                break;
+                                            }
+                                        }
+
+                                        sink(batch * batch_nodes, batch_count(batch), slot.hashes.data());
+
+                                        std::lock_guard<std::mutex> lock(mutex);
+                                        slot.layers_read = 0;
+                                        slot.chunks_hashed = 0;
+                                        ++sunk;
+                                        changed.notify_all();
+                                    }
+                                } catch (...) {
+                                    fail();
+                                }
+
+                                join();
+                                if (error) {
+                                    std::rethrow_exception(error);
+                                }
+                            }
+                        }    // namespace multicore
+                    }        // namespace processing
+                }            // namespace detail
+            }                // namespace vanilla
+        }                    // namespace stacked
+    }                        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_COLUMN_HASHES_HPP
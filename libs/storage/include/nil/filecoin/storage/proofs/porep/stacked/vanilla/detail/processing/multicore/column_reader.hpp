@@ -0,0 +1,227 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_COLUMN_READER_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_COLUMN_READER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/assert.hpp>
+
+#include <nil/filecoin/storage/proofs/core/utilities.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_writer.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                namespace detail {
+                    namespace processing {
+                        namespace multicore {
+
+                            /// Requested nodes at most this many nodes apart are read with a single pread, the
+                            /// labels in between being read and dropped: 2 KiB more cost less than another read.
+                            constexpr static const std::size_t COLUMN_READ_GAP_NODES = 64;
+                            /// Upper bound on the nodes of a single pread, 128 KiB.
+                            constexpr static const std::size_t COLUMN_READ_MAX_NODES = 1 << 12;
+
+                            /// Reads the columns of `count` nodes from the label files of all layers, in order,
+                            /// into `columns`: the label of `nodes[i]` on layer `layer` (0-based) is stored at
+                            /// `columns + (i * layer_paths.size() + layer) * NODE_SIZE`, so the column of every
+                            /// node is contiguous.
+                            ///
+                            /// Instead of one read per node and layer, the distinct nodes are sorted and nearby
+                            /// ones coalesced into runs, every run is read from every layer with one pread, and
+                            /// the reads are issued by up to `threads` threads, which caps the I/O in flight.
+                            /// Nodes requested several times are read once.
+                            inline void read_columns(const std::vector<std::string> &layer_paths,
+                                                     const std::uint64_t *nodes, std::size_t count,
+                                                     std::uint8_t *columns, std::size_t threads) {
+                                BOOST_ASSERT_MSG(!layer_paths.empty(), "at least one layer is required");
+                                BOOST_ASSERT_MSG(threads > 0, "at least one thread is required");
+                                if (count == 0) {
+                                    return;
+                                }
+                                const std::size_t layers = layer_paths.size();
+
+                                std::vector<std::uint64_t> distinct(nodes, nodes + count);
+                                std::sort(distinct.begin(), distinct.end());
+                                distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+                                // Runs of distinct nodes `[first, last)` read together.
+                                std::vector<std::pair<std::size_t, std::size_t>> runs;
+                                for (std::size_t first = 0, last = 1; last <= distinct.size(); ++last) {
+                                    if (last == distinct.size() ||
+                                        distinct[last] - distinct[last - 1] > COLUMN_READ_GAP_NODES ||
+                                        distinct[last] - distinct[first] >= COLUMN_READ_MAX_NODES) {
+                                        runs.emplace_back(first, last);
+                                        first = last;
+                                    }
+                                }
+
+                                std::vector<int> fds(layers, -1);
+                                const auto close_all = [&]() {
+                                    for (int fd : fds) {
+                                        if (fd >= 0) {
+                                            ::close(fd);
+                                        }
+                                    }
+                                };
+                                for (std::size_t layer = 0; layer < layers; ++layer) {
+                                    fds[layer] = ::open(layer_paths[layer].c_str(), O_RDONLY | O_CLOEXEC);
+                                    if (fds[layer] < 0) {
+                                        const int error = errno;
+                                        close_all();
+                                        throw std::system_error(error, std::generic_category(),
+                                                                "could not open " + layer_paths[layer]);
+                                    }
+                                }
+
+                                // Columns of the distinct nodes, node-major.
+                                std::vector<std::uint8_t> distinct_columns(distinct.size() * layers * NODE_SIZE);
+
+                                const std::size_t tasks = runs.size() * layers;
+                                std::atomic<std::size_t> next_task(0);
+                                std::mutex error_mutex;
+                                std::exception_ptr error;
+
+                                const auto work = [&]() {
+                                    std::vector<std::uint8_t> buffer;
+                                    for (std::size_t task = next_task++; task < tasks; task = next_task++) {
+                                        const std::size_t layer = task % layers;
+                                        const auto [first, last] = runs[task / layers];
+                                        const std::uint64_t first_node = distinct[first];
+                                        const std::uint64_t span = distinct[last - 1] - first_node + 1;
+                                        try {
+                                            buffer.resize(span * NODE_SIZE);
+                                            cache_writer::pread_all(fds[layer], buffer.data(), buffer.size(),
+                                                                    first_node * NODE_SIZE, layer_paths[layer]);
+                                        } catch (...) {
+                                            std::lock_guard<std::mutex> lock(error_mutex);
+                                            if (!error) {
+                                                error = std::current_exception();
+                                            }
+                                            next_task = tasks;
+                                            return;
+                                        }
+                                        for (std::size_t i = first; i < last; ++i) {
+                                            std::memcpy(distinct_columns.data() + (i * layers + layer) * NODE_SIZE,
+                                                        buffer.data() + (distinct[i] - first_node) * NODE_SIZE,
+                                                        NODE_SIZE);
+                                        }
+                                    }
+                                };
+
+                                std::vector<std::thread> workers;
+                                try {
+                                    for (std::size_t i = 1; i < std::min(threads, tasks); ++i) {
+                                        workers.emplace_back(work);
+                                    }
+                                } catch (...) {
+                                    // Stop the workers already started and join them before unwinding.
+                                    next_task = tasks;
+                                    for (std::thread &worker : workers) {
+                                        worker.join();
+                                    }
+                                    close_all();
+                                    throw;
+                                }
+                                work();
+                                for (std::thread &worker : workers) {
+                                    worker.join();
+                                }
+                                close_all();
+                                if (error) {
+                                    std::rethrow_exception(error);
+                                }
+
+                                const std::size_t column_size = layers * NODE_SIZE;
+                                for (std::size_t i = 0; i < count; ++i) {
+                                    const std::size_t index =
+                                        std::lower_bound(distinct.begin(), distinct.end(), nodes[i]) - distinct.begin();
+                                    std::memcpy(columns + i * column_size,
+                                                distinct_columns.data() + index * column_size, column_size);
+                                }
+                            }
+
+                            /// The columns of a set of nodes, read at once with `read_columns` and looked up by
+                            /// node. Nodes given several times, e.g. parents shared by several challenges, are
+                            /// read once.
+                            template<typename Digest>
+                            class column_set {
+                                static_assert(sizeof(Digest) == NODE_SIZE, "labels must be single nodes");
+
+                            public:
+                                column_set(const std::vector<std::string> &layer_paths,
+                                           std::vector<std::uint64_t> nodes, std::size_t threads) :
+                                    nodes(std::move(nodes)), layers(layer_paths.size()) {
+                                    std::sort(this->nodes.begin(), this->nodes.end());
+                                    this->nodes.erase(std::unique(this->nodes.begin(), this->nodes.end()),
+                                                      this->nodes.end());
+                                    matrix.resize(this->nodes.size() * layers);
+                                    read_columns(layer_paths, this->nodes.data(), this->nodes.size(),
+                                                 reinterpret_cast<std::uint8_t *>(matrix.data()), threads);
+                                }
+
+                                /// The `layers` labels of the column of `node`, which must be in the set.
+                                const Digest *column(std::uint64_t node) const {
+                                    const auto it = std::lower_bound(nodes.begin(), nodes.end(), node);
+                                    BOOST_ASSERT_MSG(it != nodes.end() && *it == node, "node is not in the set");
+                                    return matrix.data() + (it - nodes.begin()) * layers;
+                                }
+
+                                /// Number of distinct nodes read.
+                                std::size_t size() const {
+                                    return nodes.size();
+                                }
+
+                            private:
+                                std::vector<std::uint64_t> nodes;
+                                std::size_t layers;
+                                std::vector<Digest> matrix;
+                            };
+                        }    // namespace multicore
+                    }        // namespace processing
+                }            // namespace detail
+            }                // namespace vanilla
+        }                    // namespace stacked
+    }                        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_COLUMN_READER_HPP
@@ -0,0 +1,364 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_CREATE_LABEL_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_CREATE_LABEL_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <nil/filecoin/storage/proofs/core/configuration.hpp>
+#include <nil/filecoin/storage/proofs/core/utilities.hpp>
+
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/graph.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/label_hasher.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                namespace detail {
+                    namespace processing {
+                        namespace multicore {
+
+                            /*************************  Ring buffer  ***********************************/
+
+                            /// One lookahead slot: the parents of a single node and their gathered labels.
+                            struct RingSlot {
+                                /// `node + 1` once the producer has filled the slot, 0 while it is empty.
+                                std::atomic<std::uint64_t> ready;
+                                /// Base parents which were not labeled yet when the producer ran. The
+                                /// consumer copies them itself right before hashing.
+                                std::uint32_t pending;
+                                std::array<std::uint32_t, DEGREE> parents;
+                                std::array<std::uint8_t, DEGREE * NODE_SIZE> data;
+                            };
+
+                            /// Fixed-size ring of `lookahead` slots, node `n` lives in slot `n % lookahead`.
+                            struct RingBuf {
+                                RingBuf(std::size_t lookahead) : slots(lookahead) {
+                                    for (RingSlot &slot : slots) {
+                                        slot.ready.store(0, std::memory_order_relaxed);
+                                    }
+                                }
+
+                                RingSlot &slot(std::uint64_t node) {
+                                    return slots[node % slots.size()];
+                                }
+
+                                std::size_t size() const {
+                                    return slots.size();
+                                }
+
+                                std::vector<RingSlot> slots;
+                            };
+
+                            /*************************  Layer labeling  ***********************************/
+
+                            /// Generates the labels of one layer with `num_producers` threads gathering parent
+                            /// labels into a lookahead ring buffer and the calling thread hashing them in order
+                            /// with `label_hasher`.
+                            ///
+                            /// Producers claim `producer_stride` nodes at a time and never run more than
+                            /// `lookahead` nodes ahead of the consumer. Expander parents come from the previous
+                            /// layer (`exp_labels`) and are always available; base parents which the consumer has
+                            /// not reached yet are left to the consumer.
+                            ///
+                            /// `exp_labels` must be `nullptr` for the first layer, which only has base parents.
+                            ///
+                            /// Only nodes `[first_node, num_nodes)` are labeled, the labels of the nodes before
+                            /// `first_node` must already be in `layer_labels`. `parents_cache` must cover the
+                            /// labeled range.
+                            template<typename ReplicaIdType>
+                            void create_layer_labels(const CacheData &parents_cache, const ReplicaIdType &replica_id,
+                                                     std::uint8_t *layer_labels, const std::uint8_t *exp_labels,
+                                                     std::uint64_t num_nodes, std::uint32_t layer_index,
+                                                     std::size_t num_producers, std::size_t producer_stride,
+                                                     std::size_t lookahead, std::uint64_t first_node = 0) {
+                                BOOST_ASSERT_MSG(num_producers > 0, "at least one producer is required");
+                                BOOST_ASSERT_MSG(producer_stride > 0, "producer stride must not be zero");
+                                BOOST_ASSERT_MSG(lookahead > 0, "lookahead must not be zero");
+                                BOOST_ASSERT_MSG((layer_index == 1) == (exp_labels == nullptr),
+                                                 "expander labels are required for all but the first layer");
+                                BOOST_ASSERT_MSG(parents_cache.offset <= first_node &&
+                                                     parents_cache.offset + parents_cache.len >= num_nodes,
+                                                 "parents cache must cover the labeled nodes");
+
+                                const std::size_t parents_count = exp_labels == nullptr ? BASE_DEGREE : DEGREE;
+
+                                std::array<std::uint8_t, NODE_SIZE> replica_id_bytes;
+                                std::copy(std::begin(replica_id), std::end(replica_id), replica_id_bytes.begin());
+
+                                RingBuf ring(lookahead);
+                                // Node 0 has no parents, so producers start at node 1 at the earliest.
+                                std::atomic<std::uint64_t> next_node(std::max<std::uint64_t>(first_node, 1));
+                                // Number of labels written so far.
+                                std::atomic<std::uint64_t> consumed(first_node);
+                                std::atomic<bool> stop(false);
+
+                                const auto produce = [&]() {
+                                    while (!stop.load(std::memory_order_relaxed)) {
+                                        const std::uint64_t start = next_node.fetch_add(producer_stride);
+                                        if (start >= num_nodes) {
+                                            return;
+                                        }
+                                        const std::uint64_t end = std::min<std::uint64_t>(start + producer_stride,
+                                                                                          num_nodes);
+
+                                        for (std::uint64_t node = start; node < end; ++node) {
+                                            // Wait until the consumer released the slot we are going to reuse.
+                                            while (node >= consumed.load(std::memory_order_acquire) + lookahead) {
+                                                if (stop.load(std::memory_order_relaxed)) {
+                                                    return;
+                                                }
+                                                std::this_thread::yield();
+                                            }
+
+                                            RingSlot &slot = ring.slot(node);
+                                            slot.parents = parents_cache.read(node);
+                                            slot.pending = 0;
+
+                                            const std::uint64_t labeled = consumed.load(std::memory_order_acquire);
+                                            for (std::size_t i = 0; i < parents_count; ++i) {
+                                                const std::uint32_t parent = slot.parents[i];
+                                                const std::uint8_t *source;
+                                                if (i < BASE_DEGREE) {
+                                                    if (parent >= labeled) {
+                                                        slot.pending |= 1U << i;
+                                                        continue;
+                                                    }
+                                                    source = layer_labels + data_at_node_offset(parent);
+                                                } else {
+                                                    source = exp_labels + data_at_node_offset(parent);
+                                                }
+                                                std::copy(source, source + NODE_SIZE,
+                                                          slot.data.begin() + i * NODE_SIZE);
+                                            }
+
+                                            slot.ready.store(node + 1, std::memory_order_release);
+                                        }
+                                    }
+                                };
+
+                                std::vector<std::thread> producers;
+                                producers.reserve(num_producers);
+
+                                try {
+                                    for (std::size_t i = 0; i < num_producers; ++i) {
+                                        producers.emplace_back(produce);
+                                    }
+
+                                    for (std::uint64_t node = first_node; node < num_nodes; ++node) {
+                                        std::uint8_t *label = layer_labels + data_at_node_offset(node);
+
+                                        if (node == 0) {
+                                            label_hasher::hash(replica_id_bytes.data(), layer_index, node, nullptr,
+                                                               parents_count, label);
+                                        } else {
+                                            RingSlot &slot = ring.slot(node);
+                                            while (slot.ready.load(std::memory_order_acquire) != node + 1) {
+                                                std::this_thread::yield();
+                                            }
+
+                                            for (std::size_t i = 0; slot.pending != 0; ++i, slot.pending >>= 1) {
+                                                if (slot.pending & 1U) {
+                                                    const std::uint8_t *source =
+                                                        layer_labels + data_at_node_offset(slot.parents[i]);
+                                                    std::copy(source, source + NODE_SIZE,
+                                                              slot.data.begin() + i * NODE_SIZE);
+                                                }
+                                            }
+
+                                            label_hasher::hash(replica_id_bytes.data(), layer_index, node,
+                                                               slot.data.data(), parents_count, label);
+                                        }
+
+                                        consumed.store(node + 1, std::memory_order_release);
+                                    }
+                                } catch (...) {
+                                    stop.store(true);
+                                    for (std::thread &producer : producers) {
+                                        producer.join();
+                                    }
+                                    throw;
+                                }
+
+                                for (std::thread &producer : producers) {
+                                    producer.join();
+                                }
+                            }
+
+                            /// Multicore counterpart of the per-node `create_label`/`create_label_exp` loop.
+                            template<typename ReplicaIdType>
+                            void create_layer_labels(const ParentCache &cache, const ReplicaIdType &replica_id,
+                                                     std::uint8_t *layer_labels, const std::uint8_t *exp_labels,
+                                                     std::uint64_t num_nodes, std::uint32_t layer_index,
+                                                     const configuration &config) {
+                                BOOST_LOG_TRIVIAL(debug)
+                                    << std::format("multicore labeling: layer {}, {} producers, stride {}, lookahead {}",
+                                                   layer_index, config.multicore_sdr_producers,
+                                                   config.multicore_sdr_producer_stride,
+                                                   config.multicore_sdr_lookahead);
+
+                                // Producers access parents out of order, so label window by window instead of
+                                // using the sliding window of `ParentCache::read`.
+                                for_each_parent_cache_window(
+                                    cache, num_nodes,
+                                    [&](const CacheData &parents_cache, std::uint64_t first, std::uint64_t last) {
+                                        create_layer_labels(parents_cache, replica_id, layer_labels, exp_labels, last,
+                                                            layer_index, config.multicore_sdr_producers,
+                                                            config.multicore_sdr_producer_stride,
+                                                            config.multicore_sdr_lookahead, first);
+                                    });
+                            }
+
+                            /*************************  Batch layer labeling  ***********************************/
+
+                            /// Labels one layer of several replicas of the same graph in lockstep. All replicas
+                            /// share the parents graph, so every parents entry read from the cache serves the
+                            /// whole batch, and the same node of up to `sha256::LANES` replicas is hashed in one
+                            /// multi-lane call.
+                            ///
+                            /// Replicas are split into groups of `sha256::LANES`, each group runs on its own
+                            /// thread over the shared (read-only) parents cache window.
+                            ///
+                            /// `exp_labels` must be empty for the first layer. As for `create_layer_labels`, only
+                            /// nodes `[first_node, num_nodes)` are labeled. `parents_cache` is a `CacheData`
+                            /// window or, when the parents cache is not kept, a `graph_parents`.
+                            template<typename Parents, typename ReplicaIdType>
+                            void create_batch_layer_labels(const Parents &parents_cache,
+                                                           const std::vector<ReplicaIdType> &replica_ids,
+                                                           const std::vector<std::uint8_t *> &layer_labels,
+                                                           const std::vector<const std::uint8_t *> &exp_labels,
+                                                           std::uint64_t num_nodes, std::uint32_t layer_index,
+                                                           std::uint64_t first_node = 0) {
+                                const std::size_t replicas = replica_ids.size();
+                                BOOST_ASSERT_MSG(layer_labels.size() == replicas, "one label buffer per replica");
+                                BOOST_ASSERT_MSG((layer_index == 1) == exp_labels.empty(),
+                                                 "expander labels are required for all but the first layer");
+                                BOOST_ASSERT_MSG(exp_labels.empty() || exp_labels.size() == replicas,
+                                                 "one expander buffer per replica");
+                                BOOST_ASSERT_MSG(parents_cache.offset <= first_node &&
+                                                     parents_cache.offset + parents_cache.len >= num_nodes,
+                                                 "parents cache must cover the labeled nodes");
+
+                                const std::size_t parents_count = exp_labels.empty() ? BASE_DEGREE : DEGREE;
+
+                                std::vector<std::array<std::uint8_t, NODE_SIZE>> replica_id_bytes(replicas);
+                                for (std::size_t r = 0; r < replicas; ++r) {
+                                    std::copy(std::begin(replica_ids[r]), std::end(replica_ids[r]),
+                                              replica_id_bytes[r].begin());
+                                }
+
+                                const auto label_group = [&](std::size_t first, std::size_t lanes) {
+                                    std::array<std::array<std::uint8_t, DEGREE * NODE_SIZE>, sha256::LANES> data;
+                                    const std::uint8_t *ids[sha256::LANES];
+                                    const std::uint8_t *parents_data[sha256::LANES];
+                                    std::uint8_t *labels[sha256::LANES];
+                                    std::uint64_t nodes[sha256::LANES];
+
+                                    for (std::size_t lane = 0; lane < lanes; ++lane) {
+                                        ids[lane] = replica_id_bytes[first + lane].data();
+                                        parents_data[lane] = data[lane].data();
+                                    }
+
+                                    for (std::uint64_t node = first_node; node < num_nodes; ++node) {
+                                        // One parents lookup for the whole group.
+                                        const std::array<std::uint32_t, DEGREE> parents =
+                                            node > 0 ? parents_cache.read(node) : std::array<std::uint32_t, DEGREE> {};
+
+                                        for (std::size_t lane = 0; lane < lanes; ++lane) {
+                                            const std::size_t replica = first + lane;
+                                            nodes[lane] = node;
+                                            labels[lane] = layer_labels[replica] + data_at_node_offset(node);
+
+                                            if (node > 0 && exp_labels.empty()) {
+                                                copy_parents_data(parents, layer_labels[replica], data[lane].data());
+                                            } else if (node > 0) {
+                                                copy_parents_data_exp(parents, layer_labels[replica],
+                                                                      exp_labels[replica], data[lane].data());
+                                            }
+                                        }
+
+                                        label_hasher::hash_lanes(lanes, ids, layer_index, nodes, parents_data,
+                                                                 parents_count, labels);
+                                    }
+                                };
+
+                                // The first exception of any group is rethrown once all groups have stopped.
+                                std::mutex mutex;
+                                std::exception_ptr error;
+                                const auto run_group = [&](std::size_t first, std::size_t lanes) {
+                                    try {
+                                        label_group(first, lanes);
+                                    } catch (...) {
+                                        std::lock_guard<std::mutex> lock(mutex);
+                                        if (!error) {
+                                            error = std::current_exception();
+                                        }
+                                    }
+                                };
+
+                                std::vector<std::thread> groups;
+                                const auto join = [&]() {
+                                    for (std::thread &group : groups) {
+                                        group.join();
+                                    }
+                                };
+                                try {
+                                    for (std::size_t first = 0; first < replicas; first += sha256::LANES) {
+                                        groups.emplace_back(run_group, first,
+                                                            std::min<std::size_t>(sha256::LANES, replicas - first));
+                                    }
+                                } catch (...) {
+                                    // The groups already started must be joined before unwinding.
+                                    join();
+                                    throw;
+                                }
+                                join();
+                                if (error) {
+                                    std::rethrow_exception(error);
+                                }
+                            }
+                        }    // namespace multicore
+                    }        // namespace processing
+                }            // namespace detail
+            }                // namespace vanilla
+        }                    // namespace stacked
+    }                        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_CREATE_LABEL_HPP
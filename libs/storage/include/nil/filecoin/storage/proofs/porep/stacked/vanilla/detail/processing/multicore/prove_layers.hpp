@@ -0,0 +1,105 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_PROVE_LAYERS_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_PROVE_LAYERS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                namespace detail {
+                    namespace processing {
+                        namespace multicore {
+
+                            /// Calls `prove(index)` for every challenge index in `[0, count)` on up to `threads`
+                            /// threads, the calling thread included, which bounds the proofs, and so the tree and
+                            /// label reads, in flight. A thread done with its challenge claims the next one, so
+                            /// that slow challenges balance out. `prove` stores its proof at `index`, which keeps
+                            /// the output order independent of the schedule. The first exception is rethrown once
+                            /// all threads have stopped.
+                            template<typename Prove>
+                            void prove_challenges(std::size_t count, std::size_t threads, const Prove &prove) {
+                                BOOST_ASSERT_MSG(threads > 0, "at least one thread is required");
+
+                                std::atomic<std::size_t> next(0);
+                                std::atomic<bool> failed(false);
+                                std::mutex mutex;
+                                std::exception_ptr error;
+
+                                const auto work = [&]() {
+                                    try {
+                                        for (std::size_t index; !failed && (index = next.fetch_add(1)) < count;) {
+                                            prove(index);
+                                        }
+                                    } catch (...) {
+                                        std::lock_guard<std::mutex> lock(mutex);
+                                        if (!failed.exchange(true)) {
+                                            error = std::current_exception();
+                                        }
+                                    }
+                                };
+
+                                std::vector<std::thread> workers;
+                                try {
+                                    for (std::size_t i = 1; i < std::min(threads, count); ++i) {
+                                        workers.emplace_back(work);
+                                    }
+                                } catch (...) {
+                                    // Stop the workers already started and join them before unwinding.
+                                    failed = true;
+                                    for (std::thread &worker : workers) {
+                                        worker.join();
+                                    }
+                                    throw;
+                                }
+                                work();
+                                for (std::thread &worker : workers) {
+                                    worker.join();
+                                }
+                                if (error) {
+                                    std::rethrow_exception(error);
+                                }
+                            }
+                        }    // namespace multicore
+                    }        // namespace processing
+                }            // namespace detail
+            }                // namespace vanilla
+        }                    // namespace stacked
+    }                        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_PROVE_LAYERS_HPP
@@ -0,0 +1,163 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_TREE_R_LAST_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_TREE_R_LAST_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                namespace detail {
+                    namespace processing {
+                        namespace multicore {
+
+                            /// Default number of leaves of a tile: 1 MiB of 32-byte leaves, a power of 2, 4 and 8,
+                            /// so that a tile and the levels above it stay in the L2 cache while being hashed.
+                            constexpr static const std::size_t TREE_R_LAST_TILE_LEAVES = 1 << 15;
+
+                            /// Builds a tree of arity `Arity` over `leaves` leaves in one pass, bottom-up in tiles:
+                            ///
+                            /// - a worker claims the next tile of `tile_leaves` consecutive leaves, produces them
+                            ///   with `encode_leaves(first_leaf, count, out)`, e.g. by encoding the last layer
+                            ///   labels into the sealed replica, and hashes the subtree of the tile while it is
+                            ///   still in cache with `hash_node(children, children_level)`,
+                            /// - the levels above the tile roots are hashed by the calling thread at the end.
+                            ///
+                            /// Every node of a level above `rows_to_discard` is handed to
+                            /// `write_level(level, first, count, nodes)`, concurrently for disjoint ranges, the
+                            /// leaves being level 0. `leaves` must be a power of `Arity`, `tile_leaves` is rounded
+                            /// down to one. Returns the root.
+                            template<typename Digest, std::size_t Arity, typename EncodeLeaves, typename HashNode,
+                                     typename WriteLevel>
+                            Digest build_tree_r_last(std::uint64_t leaves, std::size_t tile_leaves,
+                                                     std::size_t threads, std::size_t rows_to_discard,
+                                                     EncodeLeaves encode_leaves, HashNode hash_node,
+                                                     WriteLevel write_level) {
+                                BOOST_ASSERT_MSG(threads > 0, "at least one thread is required");
+
+                                std::size_t tile = 1;
+                                std::size_t tile_levels = 0;
+                                while (tile * Arity <= std::min<std::uint64_t>(std::max(tile_leaves, Arity), leaves)) {
+                                    tile *= Arity;
+                                    ++tile_levels;
+                                }
+                                BOOST_ASSERT_MSG(leaves % tile == 0, "leaves must be a power of the arity");
+                                const std::uint64_t tiles = leaves / tile;
+
+                                std::vector<Digest> roots(tiles);
+                                std::atomic<std::uint64_t> next_tile(0);
+                                std::atomic<bool> failed(false);
+                                std::mutex mutex;
+                                std::exception_ptr error;
+
+                                const auto work = [&]() {
+                                    try {
+                                        std::vector<Digest> level(tile);
+                                        std::vector<Digest> parents(tile / Arity);
+                                        for (;;) {
+                                            const std::uint64_t t = next_tile.fetch_add(1);
+                                            if (t >= tiles || failed) {
+                                                return;
+                                            }
+
+                                            Digest *children = level.data();
+                                            Digest *nodes = parents.data();
+                                            encode_leaves(t * tile, tile, children);
+                                            std::size_t width = tile;
+                                            for (std::size_t l = 1; l <= tile_levels; ++l) {
+                                                width /= Arity;
+                                                for (std::size_t i = 0; i < width; ++i) {
+                                                    nodes[i] = hash_node(children + i * Arity, l - 1);
+                                                }
+                                                if (l > rows_to_discard) {
+                                                    write_level(l, t * width, width, nodes);
+                                                }
+                                                std::swap(children, nodes);
+                                            }
+                                            roots[t] = children[0];
+                                        }
+                                    } catch (...) {
+                                        std::lock_guard<std::mutex> lock(mutex);
+                                        if (!failed.exchange(true)) {
+                                            error = std::current_exception();
+                                        }
+                                    }
+                                };
+
+                                std::vector<std::thread> workers;
+                                try {
+                                    for (std::size_t i = 1; i < std::min<std::uint64_t>(threads, tiles); ++i) {
+                                        workers.emplace_back(work);
+                                    }
+                                } catch (...) {
+                                    // Stop the workers already started and join them before unwinding.
+                                    failed = true;
+                                    for (std::thread &worker : workers) {
+                                        worker.join();
+                                    }
+                                    throw;
+                                }
+                                work();
+                                for (std::thread &worker : workers) {
+                                    worker.join();
+                                }
+                                if (error) {
+                                    std::rethrow_exception(error);
+                                }
+
+                                std::size_t level = tile_levels;
+                                while (roots.size() > 1) {
+                                    std::vector<Digest> parents(roots.size() / Arity);
+                                    for (std::size_t i = 0; i < parents.size(); ++i) {
+                                        parents[i] = hash_node(roots.data() + i * Arity, level);
+                                    }
+                                    ++level;
+                                    if (level > rows_to_discard) {
+                                        write_level(level, 0, parents.size(), parents.data());
+                                    }
+                                    roots = std::move(parents);
+                                }
+                                return roots[0];
+                            }
+                        }    // namespace multicore
+                    }        // namespace processing
+                }            // namespace detail
+            }                // namespace vanilla
+        }                    // namespace stacked
+    }                        // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROCESSING_MULTICORE_TREE_R_LAST_HPP
@@ -27,7 +27,13 @@
 #ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_GRAPH_HPP
 #define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_GRAPH_HPP
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
 #include <nil/filecoin/storage/proofs/core/drgraph.hpp>
+#include <nil/filecoin/storage/proofs/core/utilities.hpp>
 
 namespace nil {
     namespace filecoin {
@@ -37,6 +43,52 @@ namespace nil {
                 constexpr static const std::size_t EXP_DEGREE = 8;
 
                 constexpr static const std::size_t DEGREE = BASE_DEGREE + EXP_DEGREE;
+
+                /// The number of parent labels hashed into every label (parents are repeated to fill it).
+                constexpr static const std::size_t TOTAL_PARENTS = 37;
+
+                /// Gathers the labels of the base parents of a node, read from the layer being labeled.
+                inline void copy_parents_data(const std::array<std::uint32_t, DEGREE> &parents,
+                                              const std::uint8_t *base_data, std::uint8_t *target) {
+                    for (std::size_t i = 0; i < BASE_DEGREE; ++i) {
+                        const std::uint8_t *source = base_data + data_at_node_offset(parents[i]);
+                        std::copy(source, source + NODE_SIZE, target + i * NODE_SIZE);
+                    }
+                }
+
+                /// Gathers the labels of all parents of a node: base parents from the layer being labeled
+                /// (`base_data`), expander parents from the previous layer (`exp_data`). The two layers
+                /// may live in unrelated buffers.
+                inline void copy_parents_data_exp(const std::array<std::uint32_t, DEGREE> &parents,
+                                                  const std::uint8_t *base_data, const std::uint8_t *exp_data,
+                                                  std::uint8_t *target) {
+                    copy_parents_data(parents, base_data, target);
+                    for (std::size_t i = BASE_DEGREE; i < DEGREE; ++i) {
+                        const std::uint8_t *source = exp_data + data_at_node_offset(parents[i]);
+                        std::copy(source, source + NODE_SIZE, target + i * NODE_SIZE);
+                    }
+                }
+
+                /// Parents source that computes the parents of every node from the graph, for labeling
+                /// without the parents cache (`maximize_caching` off). It reads like a `CacheData` window
+                /// covering the whole graph.
+                template<typename Graph>
+                struct graph_parents {
+                    explicit graph_parents(const Graph &graph) : graph(graph), len(graph.size()) {
+                    }
+
+                    std::array<std::uint32_t, DEGREE> read(std::uint32_t node) const {
+                        std::vector<std::uint32_t> parents(DEGREE);
+                        graph.parents(node, parents);
+                        std::array<std::uint32_t, DEGREE> result;
+                        std::copy(parents.begin(), parents.end(), result.begin());
+                        return result;
+                    }
+
+                    const Graph &graph;
+                    std::uint64_t offset = 0;
+                    std::uint64_t len;
+                };
             }    // namespace vanilla
         }        // namespace stacked
     }            // namespace filecoin
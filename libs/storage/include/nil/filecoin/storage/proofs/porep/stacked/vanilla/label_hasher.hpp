@@ -0,0 +1,158 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_LABEL_HASHER_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_LABEL_HASHER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include <boost/assert.hpp>
+
+#include <nil/filecoin/storage/proofs/core/utilities.hpp>
+#include <nil/filecoin/storage/proofs/core/crypto/sha256_compress.hpp>
+
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/graph.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/create_label.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                /// Specialized SHA-256 for SDR labels. A label is always
+                /// `SHA256(prefix || replica_id || parents[0..TOTAL_PARENTS])`, so the padded message has a
+                /// fixed shape and is fed straight to the compression kernels (SHA-NI, AVX2 or portable,
+                /// selected by CPUID). The result is identical to hashing the same bytes with
+                /// `crypto3::hashes::sha2<256>` as `create_label` does.
+                struct label_hasher {
+                    /// Message size of a label with parents.
+                    constexpr static const std::size_t MESSAGE_SIZE =
+                        LABEL_PREFIX_SIZE + NODE_SIZE + TOTAL_PARENTS * NODE_SIZE;
+                    /// Message size of node 0, which has no parents.
+                    constexpr static const std::size_t ROOT_MESSAGE_SIZE = LABEL_PREFIX_SIZE + NODE_SIZE;
+
+                    constexpr static const std::size_t BLOCKS = sha256::padded_blocks(MESSAGE_SIZE);
+
+                    typedef std::array<std::uint8_t, BLOCKS * sha256::BLOCK_SIZE> message_type;
+
+                    /// Writes the padded message of one label into `message` and returns its block count.
+                    /// `parents_data` holds `parents_count` labels which are repeated up to `TOTAL_PARENTS`.
+                    static std::size_t build_message(message_type &message, const std::uint8_t *replica_id,
+                                                     std::uint32_t layer_index, std::uint64_t node,
+                                                     const std::uint8_t *parents_data, std::size_t parents_count) {
+                        const std::array<std::uint8_t, LABEL_PREFIX_SIZE> prefix = label_prefix(layer_index, node);
+
+                        std::uint8_t *out = std::copy(prefix.begin(), prefix.end(), message.begin());
+                        out = std::copy(replica_id, replica_id + NODE_SIZE, out);
+
+                        if (node == 0) {
+                            return sha256::pad(message.data(), ROOT_MESSAGE_SIZE);
+                        }
+
+                        BOOST_ASSERT_MSG(parents_count > 0 && parents_count <= DEGREE, "invalid parents count");
+                        for (std::size_t i = 0; i < TOTAL_PARENTS; ++i) {
+                            const std::uint8_t *parent = parents_data + (i % parents_count) * NODE_SIZE;
+                            out = std::copy(parent, parent + NODE_SIZE, out);
+                        }
+
+                        return sha256::pad(message.data(), MESSAGE_SIZE);
+                    }
+
+                    /// Stores the digest as a label, stripping the last two bits to ensure it is in Fr.
+                    static void store_label(const sha256::state_type &state, std::uint8_t *label) {
+                        sha256::store_digest(state, label);
+                        label[NODE_SIZE - 1] &= 0b00111111;
+                    }
+
+                    /// Hashes a single label into `label` (`NODE_SIZE` bytes).
+                    static void hash(const std::uint8_t *replica_id, std::uint32_t layer_index, std::uint64_t node,
+                                     const std::uint8_t *parents_data, std::size_t parents_count,
+                                     std::uint8_t *label) {
+                        message_type message;
+                        const std::size_t blocks =
+                            build_message(message, replica_id, layer_index, node, parents_data, parents_count);
+
+                        sha256::state_type state = sha256::INITIAL_STATE;
+                        sha256::compress(state, message.data(), blocks);
+                        store_label(state, label);
+                    }
+
+                    /// Hashes up to `sha256::LANES` independent labels of the same layer at once, e.g. the
+                    /// same node of several replicas. Labels of one replica cannot be batched this way, since
+                    /// every node depends on its predecessor.
+                    static void hash_lanes(std::size_t lanes, const std::uint8_t *const replica_ids[],
+                                           std::uint32_t layer_index, const std::uint64_t nodes[],
+                                           const std::uint8_t *const parents_data[], std::size_t parents_count,
+                                           std::uint8_t *const labels[]) {
+                        BOOST_ASSERT_MSG(lanes <= sha256::LANES, "too many lanes");
+
+                        std::array<message_type, sha256::LANES> messages;
+                        std::array<sha256::state_type, sha256::LANES> states;
+                        const std::uint8_t *data[sha256::LANES];
+
+                        std::size_t blocks = 0;
+                        bool uniform = true;
+                        for (std::size_t lane = 0; lane < lanes; ++lane) {
+                            const std::size_t lane_blocks = build_message(messages[lane], replica_ids[lane],
+                                                                          layer_index, nodes[lane],
+                                                                          parents_data[lane], parents_count);
+                            uniform = uniform && (lane == 0 || lane_blocks == blocks);
+                            blocks = lane_blocks;
+                        }
+
+                        // Only the AVX2 kernel gains from interleaving; node 0 has a shorter message, so such
+                        // mixed batches are hashed lane by lane as well.
+                        if (sha256::active_backend() != sha256::backend::avx2 || !uniform) {
+                            for (std::size_t lane = 0; lane < lanes; ++lane) {
+                                states[lane] = sha256::INITIAL_STATE;
+                                sha256::compress(states[lane], messages[lane].data(),
+                                                 sha256::padded_blocks(nodes[lane] == 0 ? ROOT_MESSAGE_SIZE :
+                                                                                           MESSAGE_SIZE));
+                                store_label(states[lane], labels[lane]);
+                            }
+                            return;
+                        }
+
+                        for (std::size_t lane = 0; lane < sha256::LANES; ++lane) {
+                            states[lane] = sha256::INITIAL_STATE;
+                            // Unused lanes rehash the first message.
+                            data[lane] = messages[lane < lanes ? lane : 0].data();
+                        }
+
+                        sha256::compress_x8(states, data, blocks);
+
+                        for (std::size_t lane = 0; lane < lanes; ++lane) {
+                            store_label(states[lane], labels[lane]);
+                        }
+                    }
+                };
+            }    // namespace vanilla
+        }        // namespace stacked
+    }            // namespace filecoin
+}    // namespace nil
+
+#endif    // FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_LABEL_HASHER_HPP
@@ -0,0 +1,195 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_LAYER_WRITER_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_LAYER_WRITER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <boost/log/trivial.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                /// Alignment of buffers, sizes and offsets required by `O_DIRECT`.
+                constexpr static const std::size_t DIRECT_IO_ALIGNMENT = 4096;
+
+                /// Writes `size` bytes of `data` to `path`, replacing its contents. With `direct_io` the page
+                /// cache is bypassed through `O_DIRECT` when the buffer and size are suitably aligned, which
+                /// keeps tens of gigabytes of label writes from evicting the parents cache; otherwise, or
+                /// when the file system refuses it, a regular buffered write is done.
+                inline void write_layer_file(const std::string &path, const std::uint8_t *data, std::size_t size,
+                                             bool direct_io) {
+#if defined(__linux__) && defined(O_DIRECT)
+                    const bool aligned = reinterpret_cast<std::uintptr_t>(data) % DIRECT_IO_ALIGNMENT == 0 &&
+                                         size % DIRECT_IO_ALIGNMENT == 0;
+                    const int fd = direct_io && aligned ?
+                                       ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644) :
+                                       -1;
+                    if (fd >= 0) {
+                        std::size_t written = 0;
+                        while (written < size) {
+                            const ::ssize_t n = ::write(fd, data + written, size - written);
+                            if (n <= 0) {
+                                break;
+                            }
+                            written += static_cast<std::size_t>(n);
+                        }
+                        const bool synced = ::fsync(fd) == 0;
+                        ::close(fd);
+                        if (written == size && synced) {
+                            return;
+                        }
+                        BOOST_LOG_TRIVIAL(warning) << std::format("direct write of {} failed, retrying buffered", path);
+                    }
+#endif
+                    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                    out.write(reinterpret_cast<const char *>(data), size);
+                    if (!out.flush()) {
+                        throw std::runtime_error(std::format("failed to write layer file {}", path));
+                    }
+                }
+
+                /// Background stage persisting label layers while the next layer is labeled.
+                ///
+                /// Jobs run in submission order on a dedicated thread. No data is copied: a job refers to
+                /// a layer buffer that the caller must keep untouched until `wait(ticket)` has returned for
+                /// it. At most one job waits behind the running one, so `submit` blocks rather than letting
+                /// writes pile up.
+                class layer_writer {
+                public:
+                    layer_writer() : thread_([this] { run(); }) {
+                    }
+
+                    layer_writer(const layer_writer &) = delete;
+                    layer_writer &operator=(const layer_writer &) = delete;
+
+                    ~layer_writer() {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex_);
+                            closed_ = true;
+                        }
+                        changed_.notify_all();
+                        thread_.join();
+                    }
+
+                    /// Queues `job` and returns its ticket.
+                    std::size_t submit(std::function<void()> job) {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        changed_.wait(lock, [this] { return jobs_.empty(); });
+                        jobs_.push_back(std::move(job));
+                        changed_.notify_all();
+                        return ++submitted_;
+                    }
+
+                    /// Blocks until the job with `ticket` and all jobs before it are done. Rethrows the
+                    /// first failure of any job.
+                    void wait(std::size_t ticket) {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        changed_.wait(lock, [this, ticket] { return completed_ >= ticket || error_; });
+                        if (error_) {
+                            std::rethrow_exception(error_);
+                        }
+                    }
+
+                    /// Blocks until every submitted job is done.
+                    void wait() {
+                        std::size_t last;
+                        {
+                            std::lock_guard<std::mutex> lock(mutex_);
+                            last = submitted_;
+                        }
+                        wait(last);
+                    }
+
+                private:
+                    void run() {
+                        for (;;) {
+                            std::function<void()> job;
+                            bool failed;
+                            {
+                                std::unique_lock<std::mutex> lock(mutex_);
+                                changed_.wait(lock, [this] { return closed_ || !jobs_.empty(); });
+                                if (jobs_.empty()) {
+                                    return;
+                                }
+                                job = std::move(jobs_.front());
+                                jobs_.pop_front();
+                                failed = error_ != nullptr;
+                            }
+                            changed_.notify_all();
+
+                            // Once a job failed the remaining ones are only drained.
+                            std::exception_ptr error;
+                            if (!failed) {
+                                try {
+                                    job();
+                                } catch (...) {
+                                    error = std::current_exception();
+                                }
+                            }
+
+                            {
+                                std::lock_guard<std::mutex> lock(mutex_);
+                                if (error && !error_) {
+                                    error_ = error;
+                                }
+                                ++completed_;
+                            }
+                            changed_.notify_all();
+                        }
+                    }
+
+                    std::mutex mutex_;
+                    std::condition_variable changed_;
+                    std::deque<std::function<void()>> jobs_;
+                    std::size_t submitted_ = 0;
+                    std::size_t completed_ = 0;
+                    std::exception_ptr error_;
+                    bool closed_ = false;
+                    std::thread thread_;
+                };
+            }    // namespace vanilla
+        }        // namespace stacked
+    }            // namespace filecoin
+}    // namespace nil
+
+#endif
@@ -37,10 +37,13 @@
 #include <nil/crypto3/hash/algorithm/hash.hpp>
 
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/challenges.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/checkpoint.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/column_proof.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/labelling_proof.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/encoding_proof.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/multicore/column_reader.hpp>
 
+#include <nil/filecoin/storage/proofs/core/cache_key.hpp>
 #include <nil/filecoin/storage/proofs/core/merkle/proof.hpp>
 #include <nil/filecoin/storage/proofs/core/merkle/builders.hpp>
 
@@ -252,8 +255,18 @@ namespace nil {
                             if (is_cached(cur_config)) {
                                 DiskStore<typename MerkleTreeType::hash_type::digest_type>::delete (cur_config)
                                     .with_context(|| std::format("labels %d", i));
+                                remove_layer_checkpoint(cur_config);
                                 BOOST_LOG_TRIVIAL(trace) << std::format("layer %d deleted", i);
                             }
+
+                            // Layers kept by `extract_range` for later unseals of this sector.
+                            const StoreConfig unseal_config =
+                                StoreConfig::from_config(&cur_config, cache_key::unseal_label_layer(i + 1), None);
+                            if (is_cached(unseal_config)) {
+                                boost::filesystem::remove(StoreConfig::data_path(unseal_config.path, unseal_config.id));
+                                remove_layer_checkpoint(unseal_config);
+                                BOOST_LOG_TRIVIAL(trace) << std::format("unseal layer {} deleted", i);
+                            }
                         }
                     }
 
@@ -303,6 +316,8 @@ namespace nil {
                         std::vector<DiskStore<typename tree_hash_type::digest_type>> disk_store_labels(labels.size());
                         for (int i = 0; i < labels.size(); i++) {
                             disk_store_labels.emplace_back(labels.labels_for_layer(i + 1));
+                            layer_paths.push_back(
+                                StoreConfig::data_path(labels.labels[i].path, labels.labels[i].id).string());
                         }
 
                         return {disk_store_labels};
@@ -345,7 +360,31 @@ namespace nil {
                         return {node, rows};
                     }
 
+                    /// Reads the columns of all `nodes` at once, with the I/O batched across the layer files, see
+                    /// `detail::processing::multicore::read_columns`. The column of `nodes[i]` is returned at
+                    /// `[i * layers(), (i + 1) * layers())`.
+                    std::vector<typename tree_hash_type::digest_type> columns(const std::vector<std::uint64_t> &nodes) {
+                        static_assert(sizeof(typename tree_hash_type::digest_type) == NODE_SIZE,
+                                      "labels must be single nodes");
+                        BOOST_ASSERT_MSG(layer_paths.size() == labels.size(), "layer files are unknown");
+
+                        std::vector<typename tree_hash_type::digest_type> matrix(nodes.size() * layers());
+                        detail::processing::multicore::read_columns(
+                            layer_paths, nodes.data(), nodes.size(), reinterpret_cast<std::uint8_t *>(matrix.data()),
+                            settings::SETTINGS.lock().column_read_threads);
+                        return matrix;
+                    }
+
+                    /// Reads the columns of all `nodes` at once, like `columns`, into a set looked up by node.
+                    detail::processing::multicore::column_set<typename tree_hash_type::digest_type>
+                        read_column_set(const std::vector<std::uint64_t> &nodes) {
+                        BOOST_ASSERT_MSG(layer_paths.size() == labels.size(), "layer files are unknown");
+                        return {layer_paths, nodes, settings::SETTINGS.lock().column_read_threads};
+                    }
+
                     std::vector<DiskStore<typename MerkleTreeType::hash_type::digest_type>> labels;
+                    /// The data files of `labels`, in layer order.
+                    std::vector<std::string> layer_paths;
                 };
 
                 /*************************  TemporaryAuxCache  ***********************************/
@@ -445,6 +484,16 @@ namespace nil {
                     Column<typename MerkleTreeType::hash_type> column(std::uint32_t column_index) {
                         return labels.column(column_index);
                     }
+
+                    std::vector<typename MerkleTreeType::hash_type::digest_type>
+                        columns(const std::vector<std::uint64_t> &nodes) {
+                        return labels.columns(nodes);
+                    }
+
+                    detail::processing::multicore::column_set<typename MerkleTreeType::hash_type::digest_type>
+                        read_column_set(const std::vector<std::uint64_t> &nodes) {
+                        return labels.read_column_set(nodes);
+                    }
                 };
 
                 /*************************  PrivateInputs  ***********************************/
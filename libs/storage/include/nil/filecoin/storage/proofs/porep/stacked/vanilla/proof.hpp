@@ -27,26 +27,48 @@
 #ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROOF_HPP
 #define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_PROOF_HPP
 
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <optional>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <boost/filesystem/path.hpp>
 #include <boost/assert.hpp>
 #include <boost/log/trivial.hpp>
 
+#include <nil/filecoin/storage/proofs/core/memory.hpp>
+#include <nil/filecoin/storage/proofs/core/crypto/poseidon_batch.hpp>
+#include <nil/filecoin/storage/proofs/core/merkle/tree_d_builder.hpp>
+
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/column.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_writer.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/params.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/porep.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/challenges.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/checkpoint.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/create_label.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/encoding_proof.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/labelling_proof.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/layer_writer.hpp>
 
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/naive/params.hpp>
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/naive/labelling_proof.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/multicore/column_hashes.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/multicore/create_label.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/multicore/prove_layers.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/multicore/tree_r_last.hpp>
 
 namespace nil {
     namespace filecoin {
         namespace stacked {
             namespace vanilla {
-                constexpr static const std::size_t TOTAL_PARENTS = 37;
+                /// Sealed nodes read and decoded at once by `StackedDrg::extract_range`, 2 MiB.
+                constexpr static const std::size_t EXTRACT_BATCH_NODES = 1 << 16;
 
                 template<typename MerkleTreeType, typename Hash>
                 struct StackedDrg {
@@ -80,189 +102,166 @@ namespace nil {
                         assert(pub_inputs.tau.is_some());
                         assert(pub_inputs.tau.comm_d == t_aux.tree_d.root());
 
-                        auto get_drg_parents_columns = [&](std::size_t x) -> std::vector<Column<tree_hash_type>> {
-                            std::size_t base_degree = graph.base_graph().degree();
-
-                            std::vector<Column<tree_hash_type>> columns(base_degree);
-
-                            std::vector<std::uint64_t> parents(0, base_degree);
-                            graph.base_parents(x, parents);
-
-                            for (parents::iterator parent_it = parents.begin(); parent_it != parents.end();
-                                 ++parent_it) {
-                                columns.push_back(t_aux.column(*parent_it));
-                            }
-
-                            assert(columns.size() == base_degree);
-
-                            return columns;
-                        };
-
-                        std::vector<Column<tree_hash_type>> get_exp_parents_columns(std::size_t x) {
-                            std::vector<auto> parents(graph.expansion_degree(), 0);
-                            graph.expanded_parents(x, parents);
+                        const std::size_t threads = std::max<std::size_t>(
+                            1, std::min<std::size_t>(settings::SETTINGS.lock().prove_layers_threads,
+                                                     std::thread::hardware_concurrency()));
+                        const std::size_t base_degree = graph.base_graph().degree();
 
-                            std::vector<Column<tree_hash_type>> result;
-                            result.reserve(parents.size());
-
-                            for (parents::iterator parent_it = parents.begin(); parent_it != parents.end();
-                                 ++parent_it) {
-                                result.push_back(t_aux.column(*parent_it));
-                            }
-
-                            return result;
-                        }
-
-                        std::vector<std::vector<>> result;
+                        std::vector<std::vector<Proof<tree_type, hash_type>>> result;
 
                         for (std::size_t k = 0; k < partition_count; k++) {
-                            std::vector<auto> result_k;
-                            result_k.reserve(challenges.size());    // not sure about actual size of result_k
-
                             BOOST_LOG_TRIVIAL(trace) << std::format("proving partition %d/%d", k + 1, partition_count);
 
                             // Derive the set of challenges we are proving over.
                             std::vector<std::size_t> challenges =
                                 pub_inputs.challenges(layer_challenges, graph_size, Some(k));
 
-                            // Stacked commitment specifics
-                            for (std::size_t challenge_index = 0,
-                                             challenges::iterator challenge_it = challenges.begin();
-                                 challenge_it != challenges.end(); ++challenge_index, ++challenge_it) {
-
-                                BOOST_LOG_TRIVIAL(trace)
-                                    << std::format(" challenge %d (%d)", *challenge_it, challenge_index);
-                                BOOST_ASSERT_MSG(*challenge_it < graph.size(), "Invalid challenge");
-                                BOOST_ASSERT_MSG(*challenge_it > 0, "Invalid challenge");
-
-                                // Initial data layer openings (c_X in Comm_D)
-                                merkle_proof_type<auto> comm_d_proof =
-                                    merkletree::processing::naive::MerkleTree_gen_proof(t_aux.tree_d, *challenge_it);
-
-                                BOOST_ASSERT(comm_d_proof.validate(*challenge_it));
-
-                                // Stacked replica column openings
-                                BOOST_ASSERT(p_aux.comm_c == t_aux.tree_c.root());
-                                auto tree_c = &t_aux.tree_c;
-
-                                // All labels in C_X
-                                BOOST_LOG_TRIVIAL(trace) << "  c_x";
-                                auto c_x = t_aux.column(std::uint32_t(*challenge_it)).into_proof(tree_c);
-
-                                // All labels in the DRG parents.
-                                BOOST_LOG_TRIVIAL(trace) << "  drg_parents";
-                                std::vector<auto> drg_parents;
-                                drg_parents.reserve();
-
-                                std::vector<auto> drg_parents_columns = get_drg_parents_columns(*challenge_it);
-
-                                for (drg_parents_columns::iterator column_it = drg_parents_columns.begin();
-                                     column_it != drg_parents_columns.end();
-                                     ++column_it) {
-                                    drg_parents.push((*column_it).into_proof(tree_c));
-                                }
-
-                                // Labels for the expander parents
-                                BOOST_LOG_TRIVIAL(trace) << "  exp_parents";
-                                std::vector<auto> exp_parents;
-                                exp_parents.reserve();
-
-                                std::vector<auto> exp_parents_columns = get_exp_parents_columns(*challenge_it);
-
-                                for (exp_parents_columns::iterator column_it = exp_parents_columns.begin();
-                                     column_it != exp_parents_columns.end();
-                                     ++column_it) {
-                                    exp_parents.push((*column_it).into_proof(tree_c));
-                                }
+                            // The columns of every challenge and of its parents are read at once for the whole
+                            // partition, each distinct node once, even if it is the parent of several challenges.
+                            std::vector<std::vector<std::uint64_t>> challenge_nodes(challenges.size());
+                            std::vector<std::uint64_t> partition_nodes;
+                            partition_nodes.reserve(challenges.size() * (1 + graph.degree()));
+                            for (std::size_t challenge_index = 0; challenge_index < challenges.size();
+                                 ++challenge_index) {
+                                std::vector<std::uint32_t> parents(graph.degree(), 0);
+                                graph.parents(challenges[challenge_index], parents);
+                                std::vector<std::uint64_t> &nodes = challenge_nodes[challenge_index];
+                                nodes.push_back(challenges[challenge_index]);
+                                nodes.insert(nodes.end(), parents.begin(), parents.end());
+                                partition_nodes.insert(partition_nodes.end(), nodes.begin(), nodes.end());
+                            }
+                            const auto partition_columns = t_aux.read_column_set(partition_nodes);
+                            BOOST_LOG_TRIVIAL(trace) << std::format("  read {} columns for {} challenges",
+                                                                    partition_columns.size(), challenges.size());
 
-                                ReplicaColumnProof rcp = {c_x, drg_parents, exp_parents};
+                            // Stacked commitment specifics, the challenges being proven in parallel. Each proof
+                            // goes to the slot of its challenge, so the order does not depend on the schedule.
+                            std::vector<Proof<tree_type, hash_type>> result_k(challenges.size());
+                            detail::processing::multicore::prove_challenges(
+                                challenges.size(), threads, [&](std::size_t challenge_index) {
+                                    const std::size_t challenge = challenges[challenge_index];
 
-                                // Final replica layer openings
-                                BOOST_LOG_TRIVIAL(trace) << "final replica layer openings";
+                                    BOOST_LOG_TRIVIAL(trace)
+                                        << std::format(" challenge %d (%d)", challenge, challenge_index);
+                                    BOOST_ASSERT_MSG(challenge < graph.size(), "Invalid challenge");
+                                    BOOST_ASSERT_MSG(challenge > 0, "Invalid challenge");
+
+                                    // Initial data layer openings (c_X in Comm_D)
+                                    merkle_proof_type<auto> comm_d_proof =
+                                        merkletree::processing::naive::MerkleTree_gen_proof(t_aux.tree_d, challenge);
+
+                                    BOOST_ASSERT(comm_d_proof.validate(challenge));
+
+                                    // Stacked replica column openings
+                                    BOOST_ASSERT(p_aux.comm_c == t_aux.tree_c.root());
+                                    auto tree_c = &t_aux.tree_c;
+
+                                    // The challenge and all its parents, base parents first, whose columns were read
+                                    // with those of the partition. The labeling proofs take their parents' labels from
+                                    // these columns as well.
+                                    const std::vector<std::uint64_t> &column_nodes = challenge_nodes[challenge_index];
+                                    const auto column_at = [&](std::size_t i) {
+                                        const typename tree_hash_type::digest_type *column =
+                                            partition_columns.column(column_nodes[i]);
+                                        return Column<tree_hash_type>(
+                                            column_nodes[i],
+                                            std::vector<typename tree_hash_type::digest_type>(column, column + layers));
+                                    };
+                                    const auto label_at = [&](std::size_t i, std::size_t layer) {
+                                        return partition_columns.column(column_nodes[i])[layer - 1];
+                                    };
+
+                                    // All labels in C_X
+                                    BOOST_LOG_TRIVIAL(trace) << "  c_x";
+                                    auto c_x = column_at(0).into_proof(tree_c);
+
+                                    // All labels in the DRG parents.
+                                    BOOST_LOG_TRIVIAL(trace) << "  drg_parents";
+                                    std::vector<auto> drg_parents;
+                                    drg_parents.reserve(base_degree);
+                                    for (std::size_t i = 1; i <= base_degree; ++i) {
+                                        drg_parents.push_back(column_at(i).into_proof(tree_c));
+                                    }
 
-                                merkle_proof_type<auto> comm_r_last_proof =
-                                    merkletree::processing::naive::MerkleTree_gen_cached_proof(
-                                        t_aux.tree_r_last, *challenge_it,
-                                        Some(t_aux.tree_r_last_config_rows_to_discard), );
+                                    // Labels for the expander parents
+                                    BOOST_LOG_TRIVIAL(trace) << "  exp_parents";
+                                    std::vector<auto> exp_parents;
+                                    exp_parents.reserve(graph.expansion_degree());
+                                    for (std::size_t i = 1 + base_degree; i < column_nodes.size(); ++i) {
+                                        exp_parents.push_back(column_at(i).into_proof(tree_c));
+                                    }
 
-                                BOOST_ASSERT(comm_r_last_proof.validate(*challenge_it));
+                                    ReplicaColumnProof rcp = {c_x, drg_parents, exp_parents};
 
-                                // Labeling Proofs Layer 1..l
-                                std::vector<auto> labeling_proofs;
-                                labeling_proofs.reserve(layers);
-                                auto encoding_proof = None;
+                                    // Final replica layer openings
+                                    BOOST_LOG_TRIVIAL(trace) << "final replica layer openings";
 
-                                for (int layer = 1; layer != layers; layer++) {
-                                    BOOST_LOG_TRIVIAL(trace) << std::format("  encoding proof layer %d", layer);
-                                    std::vector<typename tree_hash_type::digest_type> parents_data;
+                                    merkle_proof_type<auto> comm_r_last_proof =
+                                        merkletree::processing::naive::MerkleTree_gen_cached_proof(
+                                            t_aux.tree_r_last, challenge,
+                                            Some(t_aux.tree_r_last_config_rows_to_discard), );
 
-                                    if (layer == 1) {
-                                        std::vector<auto> parents(graph.base_graph().degree(), 0);
-                                        graph.base_parents(*challenge_it, parents);
+                                    BOOST_ASSERT(comm_r_last_proof.validate(challenge));
 
-                                        parents_data.reserve(parents.size());
+                                    // Labeling Proofs Layer 1..l
+                                    std::vector<auto> labeling_proofs;
+                                    labeling_proofs.reserve(layers);
+                                    auto encoding_proof = None;
 
-                                        for (parents::iterator parent_it = parents.begin(); parent_it != parents.end();
-                                             ++parent_it) {
+                                    for (int layer = 1; layer != layers; layer++) {
+                                        BOOST_LOG_TRIVIAL(trace) << std::format("  encoding proof layer %d", layer);
+                                        std::vector<typename tree_hash_type::digest_type> parents_data;
 
-                                            parents_data.push_back(t_aux.domain_node_at_layer(layer, *parent_it));
-                                        }
-                                    } else {
-                                        std::vector<auto> parents(graph.degree(), 0);
-                                        graph.parents(*challenge_it, parents);
-                                        auto base_parents_count = graph.base_graph().degree();
-
-                                        parents_data.reserve(parents.size());
-
-                                        for (std::size_t i = 0, parents::iterator parent_it = parents.begin();
-                                             parent_it != parents.end(); ++i, ++parent_it) {
-
-                                            if (i < base_parents_count) {
-                                                // parents data for base parents is from the current
-                                                // layer
-                                                parents_data.push_back(t_aux.domain_node_at_layer(layer, *parent_it));
-                                            } else {
-                                                // parents data for exp parents is from the previous
-                                                // layer
+                                        if (layer == 1) {
+                                            parents_data.reserve(base_degree);
+                                            for (std::size_t i = 1; i <= base_degree; ++i) {
+                                                parents_data.push_back(label_at(i, layer));
+                                            }
+                                        } else {
+                                            parents_data.reserve(graph.degree());
+                                            for (std::size_t i = 1; i < column_nodes.size(); ++i) {
+                                                // parents data for base parents is from the current layer, for exp
+                                                // parents from the previous layer
                                                 parents_data.push_back(
-                                                    t_aux.domain_node_at_layer(layer - 1, *parent_it));
+                                                    label_at(i, i <= base_degree ? layer : layer - 1));
                                             }
                                         }
-                                    }
 
-                                    // repeat parents
-                                    std::vector<auto> parents_data_full(TOTAL_PARENTS, Default::default());
-                                    for (chunk : parents_data_full.chunks_mut(parents_data.size())) {
-                                        chunk.copy_from_slice(&parents_data[..chunk.size()]);
-                                    }
+                                        // repeat parents
+                                        std::vector<auto> parents_data_full(TOTAL_PARENTS, Default::default());
+                                        for (chunk : parents_data_full.chunks_mut(parents_data.size())) {
+                                            chunk.copy_from_slice(&parents_data[..chunk.size()]);
+                                        }
 
-                                    const LabelingProof<typename MerkleTreeType::hash_type> labeling_proof(
-                                        std::uint32_t(layer), std::uint64_t(*challenge_it), parents_data_full.clone());
+                                        const LabelingProof<typename MerkleTreeType::hash_type> labeling_proof(
+                                            std::uint32_t(layer), std::uint64_t(challenge), parents_data_full.clone());
 
-                                    const auto labeled_node = rcp.c_x.get_node_at_layer(layer);
-                                    BOOST_ASSERT_MSG(
-                                        LabelingProof_naive_verify(labeling_proof, &pub_inputs.replica_id,
-                                                                   &labeled_node),
-                                        std::format("Invalid encoding proof generated at layer {}", layer));
-                                    BOOST_LOG_TRIVIAL(trace)
-                                        << std::format("Valid encoding proof generated at layer %d", layer);
+                                        const auto labeled_node = rcp.c_x.get_node_at_layer(layer);
+                                        BOOST_ASSERT_MSG(
+                                            LabelingProof_naive_verify(labeling_proof, &pub_inputs.replica_id,
+                                                                       &labeled_node),
+                                            std::format("Invalid encoding proof generated at layer {}", layer));
+                                        BOOST_LOG_TRIVIAL(trace)
+                                            << std::format("Valid encoding proof generated at layer %d", layer);
 
-                                    labeling_proofs.push(labeling_proof);
+                                        labeling_proofs.push(labeling_proof);
 
-                                    if (layer == layers) {
-                                        encoding_proof = Some(EncodingProof(
-                                            std::uint32_t(layer), std::uint64_t(*challenge_it), parents_data_full));
+                                        if (layer == layers) {
+                                            encoding_proof = Some(EncodingProof(
+                                                std::uint32_t(layer), std::uint64_t(challenge), parents_data_full));
+                                        }
                                     }
-                                }
 
-                                result_k.push_back(Proof({.comm_d_proofs = comm_d_proof,
-                                                          .replica_column_proofs = rcp,
-                                                          .comm_r_last_proof,
-                                                          .labeling_proofs,
-                                                          .encoding_proof = encoding_proof}));
-                            }
-                            result.push_back(result_k);
+                                    result_k[challenge_index] = Proof({.comm_d_proofs = comm_d_proof,
+                                                                       .replica_column_proofs = rcp,
+                                                                       .comm_r_last_proof,
+                                                                       .labeling_proofs,
+                                                                       .encoding_proof = encoding_proof});
+                                });
+                            result.push_back(std::move(result_k));
                         }
+
+                        return result;
                     }
 
                     void extract_and_invert_transform_layers(const StackedBucketGraph<tree_hash_type> &graph,
@@ -294,6 +293,158 @@ namespace nil {
                         }
                     }
 
+                    /// Decodes nodes `[first_node, first_node + num_nodes)` of the replica at `replica_path`.
+                    /// The labels are regenerated layer by layer in two layer-sized buffers. Only the requested
+                    /// sealed nodes are then read, `EXTRACT_BATCH_NODES` at a time, decoded against the last
+                    /// layer and passed to `write(first, count, data)`, so neither the replica nor the unsealed
+                    /// sector is ever held in memory.
+                    ///
+                    /// The last layer is labeled only up to the end of the range: its base parents precede each
+                    /// node within the layer, so the nodes before the range are needed but those after are not.
+                    /// With `unseal_cache_labels`, the next to last layer is kept in the cache directory of
+                    /// `config` under `cache_key::unseal_label_layer` with a checkpoint naming `replica_id`, and
+                    /// later extractions from the same replica only label the last layer, until `clear_temp`
+                    /// removes it. A next to last layer left from sealing is reused the same way.
+                    template<typename Write>
+                    void extract_range(const StackedBucketGraph<tree_hash_type> &graph,
+                                       const LayerChallenges &layer_challenges,
+                                       const typename tree_hash_type::digest_type &replica_id,
+                                       const boost::filesystem::path &replica_path, const StoreConfig &config,
+                                       std::uint64_t first_node, std::uint64_t num_nodes, const Write &write) {
+                        typedef typename tree_hash_type::digest_type digest_type;
+                        BOOST_LOG_TRIVIAL(trace) << std::format("extract_range: {} nodes from {}", num_nodes,
+                                                                first_node);
+                        BOOST_ASSERT_MSG(first_node + num_nodes <= graph.size(), "range exceeds the replica");
+
+                        const auto layers = layer_challenges.layers();
+                        assert(layers > 0);
+
+                        const auto layer_size = graph.size() * NODE_SIZE;
+                        const std::int32_t numa_node = settings::SETTINGS.lock().sdr_numa_node;
+                        const bool huge_pages = settings::SETTINGS.lock().sdr_huge_pages;
+                        const bool use_multicore_sdr = settings::SETTINGS.lock().use_multicore_sdr;
+                        const bool cache_labels = settings::SETTINGS.lock().unseal_cache_labels && layers > 1;
+                        huge_page_buffer layer_buffer(layer_size, huge_pages, numa_node);
+                        huge_page_buffer exp_buffer(layer_size, huge_pages, numa_node);
+
+                        const std::size_t cached_layer = layers - 1;
+                        const auto cached_config = StoreConfig::from_config(
+                            &config, cache_key::unseal_label_layer(cached_layer), Some(graph.size()));
+                        bool cached = false;
+                        if (cache_labels) {
+                            const auto sealed_config = StoreConfig::from_config(
+                                &config, cache_key::label_layer(cached_layer), Some(graph.size()));
+                            cached = read_layer_checkpoint(cached_config, replica_id, cached_layer, exp_buffer.data(),
+                                                           layer_size) ||
+                                     read_layer_checkpoint(sealed_config, replica_id, cached_layer, exp_buffer.data(),
+                                                           layer_size);
+                        }
+
+                        {
+                            const numa_thread_binding labeling_binding(numa_node);
+                            auto cache = open_parent_cache(graph, use_multicore_sdr);
+                            for (std::size_t layer = cached ? layers : 1; layer <= layers; ++layer) {
+                                BOOST_LOG_TRIVIAL(info) << std::format("regenerating layer: {}", layer);
+                                if (cache) {
+                                    cache->reset();
+                                }
+                                label_layer(graph, cache, replica_id, layer_buffer.data(),
+                                            layer == 1 ? nullptr : exp_buffer.data(), layer,
+                                            layer == layers ? first_node + num_nodes : graph.size(),
+                                            use_multicore_sdr);
+                                if (layer < layers) {
+                                    layer_buffer.swap(exp_buffer);
+                                }
+                            }
+                        }
+
+                        if (cache_labels && !cached) {
+                            BOOST_LOG_TRIVIAL(info)
+                                << std::format("  caching layer {} for later unseals", cached_layer);
+                            remove_layer_checkpoint(cached_config);
+                            const boost::filesystem::path data_path(
+                                StoreConfig::data_path(cached_config.path, cached_config.id));
+                            write_layer_file(data_path.string(), exp_buffer.data(), layer_size,
+                                             settings::SETTINGS.lock().sdr_layer_direct_io);
+                            write_layer_checkpoint(cached_config, replica_id, cached_layer, exp_buffer.data(),
+                                                   layer_size);
+                        }
+                        const std::uint8_t *keys = layer_buffer.data();
+
+                        const std::string path = replica_path.string();
+                        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                        if (fd < 0) {
+                            throw std::system_error(errno, std::generic_category(), "could not open " + path);
+                        }
+
+                        std::vector<std::uint8_t> batch(
+                            std::min<std::uint64_t>(num_nodes, EXTRACT_BATCH_NODES) * NODE_SIZE);
+                        try {
+                            std::uint64_t count = 0;
+                            for (std::uint64_t node = first_node; node < first_node + num_nodes; node += count) {
+                                count = std::min<std::uint64_t>(first_node + num_nodes - node, EXTRACT_BATCH_NODES);
+                                cache_writer::pread_all(fd, batch.data(), count * NODE_SIZE, node * NODE_SIZE, path);
+
+                                std::uint8_t *bytes = batch.data();
+                                for (std::uint64_t k = 0; k < count; ++k, bytes += NODE_SIZE) {
+                                    digest_type key;
+                                    digest_type encoded_node;
+                                    std::memcpy(&key, keys + (node + k) * NODE_SIZE, NODE_SIZE);
+                                    std::memcpy(&encoded_node, bytes, NODE_SIZE);
+                                    const digest_type data_node = decode<digest_type>(key, encoded_node);
+                                    std::memcpy(bytes, &data_node, NODE_SIZE);
+                                }
+                                write(node, count, static_cast<const std::uint8_t *>(batch.data()));
+                            }
+                        } catch (...) {
+                            ::close(fd);
+                            throw;
+                        }
+                        ::close(fd);
+                    }
+
+                    /// Opens the parents cache if labeling reads from it: always for the multicore labeler, and
+                    /// with `maximize_caching` for the others. Without it, parents are computed from the graph.
+                    auto open_parent_cache(const StackedBucketGraph<tree_hash_type> &graph, bool use_multicore_sdr) {
+                        typedef decltype(graph.parent_cache()) parent_cache_type;
+                        if (use_multicore_sdr || settings::SETTINGS.lock().maximize_caching) {
+                            return std::optional<parent_cache_type>(graph.parent_cache());
+                        }
+                        return std::optional<parent_cache_type>();
+                    }
+
+                    /// Labels nodes `[0, num_nodes)` of `layer` into `layer_labels`, `exp_labels` holding the
+                    /// previous layer.
+                    template<typename ParentCache>
+                    void label_layer(const StackedBucketGraph<tree_hash_type> &graph,
+                                     std::optional<ParentCache> &cache,
+                                     const typename tree_hash_type::digest_type &replica_id,
+                                     std::uint8_t *layer_labels, const std::uint8_t *exp_labels, std::size_t layer,
+                                     std::uint64_t num_nodes, bool use_multicore_sdr) {
+                        const auto label_nodes = [&](auto &parents) {
+                            for (std::size_t node = 0; node < num_nodes; ++node) {
+                                if (layer == 1) {
+                                    create_label(graph, parents, replica_id, layer_labels, layer, node);
+                                } else {
+                                    create_label_exp(graph, parents, replica_id, exp_labels, layer_labels, layer,
+                                                     node);
+                                }
+                            }
+                        };
+
+                        if (use_multicore_sdr) {
+                            BOOST_ASSERT_MSG(cache, "the multicore labeler reads parents from the cache");
+                            detail::processing::multicore::create_layer_labels(*cache, replica_id, layer_labels,
+                                                                               exp_labels, num_nodes, layer,
+                                                                               settings::SETTINGS.lock());
+                        } else if (cache) {
+                            label_nodes(*cache);
+                        } else {
+                            graph_parents<StackedBucketGraph<tree_hash_type>> parents(graph);
+                            label_nodes(parents);
+                        }
+                    }
+
                     std::tuple<LabelsCache<tree_type>, Labels<tree_type>> generate_labels(
                         const StackedBucketGraph<tree_hash_type> &graph, const LayerChallenges &layer_challenges,
                         const typename tree_hash_type::digest_type &replica_id, const StoreConfig &config) {
@@ -310,48 +461,91 @@ namespace nil {
 
                         const auto layer_size = graph.size() * NODE_SIZE;
                         // NOTE: this means we currently keep 2x sector size around, to improve speed.
-                        std::vector<auto> labels_buffer(2 * layer_size, 0u8);
+                        // Parent lookups are random over both buffers, so they live on huge pages of the
+                        // labeling NUMA node and the labeling threads are kept on that node.
+                        const std::int32_t numa_node = settings::SETTINGS.lock().sdr_numa_node;
+                        const bool huge_pages = settings::SETTINGS.lock().sdr_huge_pages;
+                        const numa_thread_binding labeling_binding(numa_node);
+
+                        // The layer being labeled and the previous one, holding the expander parents. The two
+                        // buffers swap roles after every layer instead of copying the finished layer over.
+                        huge_page_buffer layer_buffer(layer_size, huge_pages, numa_node);
+                        huge_page_buffer exp_buffer(layer_size, huge_pages, numa_node);
+
+                        const bool use_multicore_sdr = settings::SETTINGS.lock().use_multicore_sdr;
+                        auto cache = open_parent_cache(graph, use_multicore_sdr);
+
+                        // Reuse the layers an interrupted run already completed. Each one is verified against
+                        // its checkpoint, the first missing or damaged layer is regenerated from there on.
+                        // Every intact layer moves to the expander buffer like a freshly labeled one would.
+                        std::size_t first_layer = 1;
+                        if (settings::SETTINGS.lock().sdr_resume) {
+                            for (; first_layer <= layers; ++first_layer) {
+                                const auto layer_config = StoreConfig::from_config(
+                                    &config, cache_key::label_layer(first_layer), Some(graph.size()));
+                                if (!read_layer_checkpoint(layer_config, replica_id, first_layer, layer_buffer.data(),
+                                                           layer_size)) {
+                                    break;
+                                }
+                                layer_buffer.swap(exp_buffer);
+                                labels.push(DiskStore<typename tree_hash_type::digest_type>(
+                                    graph.size(), MerkleTreeType::base_arity, layer_config.clone()));
+                                label_configs.push(layer_config);
+                            }
 
-                        const auto use_cache = settings::SETTINGS.lock().maximize_caching;
-                        auto cache = use_cache ? Some(graph.parent_cache()) : None;
+                            if (first_layer > 1) {
+                                BOOST_LOG_TRIVIAL(info)
+                                    << std::format("resuming labeling after completed layer {}", first_layer - 1);
+                            }
+                        }
 
-                        for (std::size_t layer = 1; layer <= layers; ++layer) {
+                        // Layers are persisted in the background while the next one is labeled. A buffer is
+                        // relabeled only once the write of the layer it held two layers ago completed.
+                        const bool direct_io = settings::SETTINGS.lock().sdr_layer_direct_io;
+                        layer_writer writer;
+                        std::vector<std::size_t> write_tickets(layers + 1, 0);
+
+                        for (std::size_t layer = first_layer; layer <= layers; ++layer) {
                             BOOST_LOG_TRIVIAL(info) << std::format("generating layer: %d", layer);
-                            if (const auto Some(ref mut cache) = cache) {
-                                cache.reset();
+                            if (cache) {
+                                cache->reset();
                             }
 
-                            if (layer == 1) {
-                                const auto layer_labels = labels_buffer[..layer_size];
-                                for (std::size_t node = 0; node < graph.size(); ++node) {
-                                    create_label(graph, cache, replica_id, layer_labels, layer, node);
-                                }
-                            } else {
-                                const auto(layer_labels, exp_labels) = labels_buffer.split_at_mut(layer_size);
-                                for (std::size_t node = 0; node < graph.size(); ++node) {
-                                    create_label_exp(graph, cache, replica_id, exp_labels, layer_labels, layer, node);
-                                }
+                            if (layer > 2) {
+                                writer.wait(write_tickets[layer - 2]);
                             }
 
-                            BOOST_LOG_TRIVIAL(info) << "  setting exp parents";
-                            labels_buffer.copy_within(..layer_size, layer_size);
+                            std::uint8_t *layer_labels = layer_buffer.data();
+                            const std::uint8_t *exp_labels = layer == 1 ? nullptr : exp_buffer.data();
+
+                            label_layer(graph, cache, replica_id, layer_labels, exp_labels, layer, graph.size(),
+                                        use_multicore_sdr);
 
                             // Write the result to disk to avoid keeping it in memory all the time.
                             const auto layer_config =
                                 StoreConfig::from_config(&config, cache_key::label_layer(layer), Some(graph.size()));
 
                             BOOST_LOG_TRIVIAL(info) << "  storing labels on disk";
-                            // Construct and persist the layer data.
-                            DiskStore<typename tree_hash_type::digest_type> layer_store =
-                                DiskStore::new_from_slice_with_config(graph.size(), MerkleTreeType::base_arity,
-                                                                      &labels_buffer[..layer_size],
-                                                                      layer_config.clone());
-                            BOOST_LOG_TRIVIAL(info)
-                                << std::format("  generated layer {} store with id {}", layer, layer_config.id);
-
-                            // Track the layer specific store and StoreConfig for later retrieval.
-                            labels.push(layer_store);
+                            write_tickets[layer] = writer.submit([&, layer, layer_config, layer_labels] {
+                                remove_layer_checkpoint(layer_config);
+                                const boost::filesystem::path data_path(
+                                    StoreConfig::data_path(layer_config.path, layer_config.id));
+                                write_layer_file(data_path.string(), layer_labels, layer_size, direct_io);
+                                write_layer_checkpoint(layer_config, replica_id, layer, layer_labels, layer_size);
+                                BOOST_LOG_TRIVIAL(info)
+                                    << std::format("  generated layer {} store with id {}", layer, layer_config.id);
+                            });
                             label_configs.push(layer_config);
+
+                            layer_buffer.swap(exp_buffer);
+                        }
+
+                        writer.wait();
+
+                        // Track the layer specific stores, backed by the files just written, for later retrieval.
+                        for (std::size_t layer = first_layer; layer <= layers; ++layer) {
+                            labels.push(DiskStore<typename tree_hash_type::digest_type>(
+                                graph.size(), MerkleTreeType::base_arity, label_configs[layer - 1].clone()));
                         }
 
                         BOOST_ASSERT_MSG(labels.len() == layers, "Invalid amount of layers encoded expected");
@@ -359,6 +553,127 @@ namespace nil {
                         return (LabelsCache<Tree> {labels}, Labels<Tree> {.labels = label_configs});
                     }
 
+                    /// Generates the labels of several replicas of the same graph in lockstep (batch PC1).
+                    /// The parents cache, if kept, is opened once and each parents entry is shared by all
+                    /// replicas of the batch, while their labels are hashed together on the multi-lane SHA-256
+                    /// kernel.
+                    /// Every replica keeps its own pair of layer buffers and its layers are persisted and
+                    /// checkpointed under the matching entry of `configs`, like `generate_labels` does. On resume,
+                    /// labeling restarts after the last layer intact for every replica of the batch.
+                    std::vector<Labels<tree_type>>
+                        generate_labels_batch(const StackedBucketGraph<tree_hash_type> &graph,
+                                              const LayerChallenges &layer_challenges,
+                                              const std::vector<typename tree_hash_type::digest_type> &replica_ids,
+                                              const std::vector<StoreConfig> &configs) {
+                        BOOST_ASSERT_MSG(replica_ids.size() == configs.size(), "one store config per replica");
+                        BOOST_LOG_TRIVIAL(info) << std::format("generate labels for {} replicas", replica_ids.size());
+
+                        const auto layers = layer_challenges.layers();
+                        const auto layer_size = graph.size() * NODE_SIZE;
+
+                        const std::int32_t numa_node = settings::SETTINGS.lock().sdr_numa_node;
+                        const bool huge_pages = settings::SETTINGS.lock().sdr_huge_pages;
+                        const numa_thread_binding labeling_binding(numa_node);
+
+                        // Per replica, the layer being labeled and the previous one; they swap roles per layer.
+                        std::vector<huge_page_buffer> layer_buffers;
+                        std::vector<huge_page_buffer> exp_buffers;
+                        layer_buffers.reserve(replica_ids.size());
+                        exp_buffers.reserve(replica_ids.size());
+                        for (std::size_t replica = 0; replica < replica_ids.size(); ++replica) {
+                            layer_buffers.emplace_back(layer_size, huge_pages, numa_node);
+                            exp_buffers.emplace_back(layer_size, huge_pages, numa_node);
+                        }
+                        std::vector<Labels<tree_type>> labels(replica_ids.size());
+
+                        const auto cache = open_parent_cache(graph, false);
+
+                        const auto layer_config_of = [&](std::size_t replica, std::size_t layer) {
+                            return StoreConfig::from_config(&configs[replica], cache_key::label_layer(layer),
+                                                            Some(graph.size()));
+                        };
+
+                        std::size_t first_layer = 1;
+                        if (settings::SETTINGS.lock().sdr_resume) {
+                            for (; first_layer <= layers; ++first_layer) {
+                                bool intact = true;
+                                for (std::size_t replica = 0; intact && replica < replica_ids.size(); ++replica) {
+                                    intact = read_layer_checkpoint(layer_config_of(replica, first_layer),
+                                                                   replica_ids[replica], first_layer,
+                                                                   layer_buffers[replica].data(), layer_size);
+                                }
+                                if (!intact) {
+                                    break;
+                                }
+                                for (std::size_t replica = 0; replica < replica_ids.size(); ++replica) {
+                                    labels[replica].labels.push_back(layer_config_of(replica, first_layer));
+                                    layer_buffers[replica].swap(exp_buffers[replica]);
+                                }
+                            }
+
+                            if (first_layer > 1) {
+                                BOOST_LOG_TRIVIAL(info)
+                                    << std::format("resuming batch labeling after completed layer {}", first_layer - 1);
+                            }
+                        }
+
+                        const bool direct_io = settings::SETTINGS.lock().sdr_layer_direct_io;
+                        layer_writer writer;
+                        std::vector<std::size_t> write_tickets(layers + 1, 0);
+
+                        std::vector<std::uint8_t *> layer_labels(replica_ids.size());
+                        std::vector<const std::uint8_t *> exp_labels;
+
+                        for (std::size_t layer = first_layer; layer <= layers; ++layer) {
+                            BOOST_LOG_TRIVIAL(info) << std::format("generating batch layer: {}", layer);
+
+                            if (layer > 2) {
+                                writer.wait(write_tickets[layer - 2]);
+                            }
+
+                            exp_labels.clear();
+                            for (std::size_t replica = 0; replica < replica_ids.size(); ++replica) {
+                                layer_labels[replica] = layer_buffers[replica].data();
+                                if (layer > 1) {
+                                    exp_labels.push_back(exp_buffers[replica].data());
+                                }
+                            }
+
+                            if (cache) {
+                                for_each_parent_cache_window(
+                                    *cache, graph.size(),
+                                    [&](const CacheData &parents_cache, std::uint64_t first, std::uint64_t last) {
+                                        detail::processing::multicore::create_batch_layer_labels(
+                                            parents_cache, replica_ids, layer_labels, exp_labels, last, layer, first);
+                                    });
+                            } else {
+                                detail::processing::multicore::create_batch_layer_labels(
+                                    graph_parents<StackedBucketGraph<tree_hash_type>>(graph), replica_ids,
+                                    layer_labels, exp_labels, graph.size(), layer);
+                            }
+
+                            for (std::size_t replica = 0; replica < replica_ids.size(); ++replica) {
+                                const auto layer_config = layer_config_of(replica, layer);
+                                std::uint8_t *replica_labels = layer_labels[replica];
+                                write_tickets[layer] = writer.submit([&, replica, layer, layer_config, replica_labels] {
+                                    remove_layer_checkpoint(layer_config);
+                                    const boost::filesystem::path data_path(
+                                        StoreConfig::data_path(layer_config.path, layer_config.id));
+                                    write_layer_file(data_path.string(), replica_labels, layer_size, direct_io);
+                                    write_layer_checkpoint(layer_config, replica_ids[replica], layer,
+                                                           replica_labels, layer_size);
+                                });
+                                labels[replica].labels.push_back(layer_config);
+
+                                layer_buffers[replica].swap(exp_buffers[replica]);
+                            }
+                        }
+
+                        writer.wait();
+
+                        return labels;
+                    }
+
                     template<typename TreeHash>
                     BinaryMerkleTree<TreeHash> build_binary_tree(const std::vector<std::uint8_t> &tree_data,
                                                                  const StoreConfig &config) {
@@ -367,14 +682,15 @@ namespace nil {
                         std::size_t leafs = tree_data.size() / NODE_SIZE;
                         assert(tree_data.size() % NODE_SIZE == 0);
 
-                        std::vector<auto> build_tree_vector;
-                        build_tree_vector.reserve(leafs);
-
-                        for (std::size_t i = 0; i < leafs; ++i) {
-                            build_tree_vector.push(get_node::<K>(tree_data, i));
-                        }
+                        // Stream the data through the builder instead of collecting the leaves in memory.
+                        merkletree::tree_d_builder builder(leafs,
+                                                           StoreConfig::data_path(config.path, config.id).string());
+                        builder.append(tree_data.data(), tree_data.size());
+                        builder.finish();
 
-                        return MerkleTree::from_par_iter_with_config(build_tree_vector, config);
+                        DiskStore<typename TreeHash::digest_type> store =
+                            DiskStore::new_from_disk(get_merkle_tree_len(leafs, BINARY_ARITY), BINARY_ARITY, config);
+                        return BinaryMerkleTree<TreeHash>::from_data_store(store, leafs);
                     }
 
                     template<typename MerkleTreeType>
@@ -580,65 +896,104 @@ namespace nil {
                                                                                                       &configs);
                     }
 
-                    static void generate_tree_c_cpu_spawn_0(stf::size_t chunk, auto &hashes_chunk) {
-                        for (std::size_t j = 0, hashes_chunk::iterator hash_it = hashes_chunk.begin();
-                             hash_it != hashes_chunk.end(); ++j, ++hash_it) {
-
-                            const std::vector<auto> data;
-                            data.reserve(layers);
-
-                            for (std::size_t layer = 1; layer <= layers; ++layer) {
-                                const auto store = labels.labels_for_layer(layer);
-                                const typename MerkleTreeType::hash_type::digest_type el =
-                                    store.read_at((i * nodes_count) + j + chunk * chunk_size);
-                                data.push(el);
-                            }
-
-                            (*hash_it) = hash_single_column(data.begin(), data.end());
-                        }
-                    }
-
                     template<typename MerkleTreeType>
                     DiskTree<typename MerkleTreeType::hash_type, MerkleTreeType::base_arity,
                              MerkleTreeType::sub_tree_arity, MerkleTreeType::top_tree_arity>
                         generate_tree_c_cpu(std::size_t layers, std::size_t nodes_count, std::size_t tree_count,
                                             const std::vector<StoreConfig> &configs,
                                             const LabelsCache<tree_type> &labels) {
+                        typedef typename MerkleTreeType::hash_type::digest_type digest_type;
+
                         BOOST_LOG_TRIVIAL(info) << "generating tree c using the CPU";
 
                         BOOST_LOG_TRIVIAL(info) << "Building column hashes";
 
-                        std::vector<auto> trees;
-                        trees.reserve(tree_count);
-
-                        for (std::size_t i = 0, configs::iterator config_it = configs.begin();
-                             config_it != configs.end(); ++i, ++config_it) {
-
-                            std::vector<typename MerkleTreeType::hash_type::digest_type> hashes(
-                                nodes_count, MerkleTreeType::hash_type::digest_type::default());
-
-                            const auto n = num_cpus::get();
-
-                            // only split if we have at least two elements per thread
-                            std::size_t num_chunks = (n > nodes_count * 2) ? 1 : n;
-
-                            // chunk into n chunks
-                            std::size_t chunk_size =
-                                std::ceil(static_cast<double>(nodes_count) / static_cast<double>(num_chunks));
+                        // The column hashes of all configs are streamed in one pass over the layers, the tree of
+                        // a config is built on its own thread as soon as its hashes are complete. The hashes of a
+                        // config are allocated when its first batch arrives and freed once its tree is built; a
+                        // config is only started once the trees before the previous one are done, so that at most
+                        // two configs of hashes are held at any time.
+                        std::vector<std::vector<digest_type>> hashes(tree_count);
+                        std::vector<std::future<void>> tree_builders;
+                        std::size_t trees_joined = 0;
+                        std::atomic<std::size_t> trees_built(0);
+                        std::size_t config_nodes_done = 0;
+
+                        std::vector<DiskStore<digest_type>> stores;
+                        for (std::size_t layer = 1; layer <= layers; ++layer) {
+                            stores.push_back(labels.labels_for_layer(layer));
+                        }
 
-                            // calculate all n chunks in parallel
-                            for ((chunk, hashes_chunk) : hashes.chunks_mut(chunk_size).enumerate()) {
+                        // Batches must not straddle two configs.
+                        const std::size_t batch_nodes = std::min<std::size_t>(
+                            nodes_count, settings::SETTINGS.lock().cpu_column_batch_size);
+                        const std::size_t batches_per_config = (nodes_count + batch_nodes - 1) / batch_nodes;
+                        const auto node_of = [&](std::uint64_t position) {
+                            return (position / batches_per_config) * nodes_count +
+                                   (position % batches_per_config) * batch_nodes;
+                        };
 
-                                generate_tree_c_cpu_spawn_0(chunk, hashes_chunk);
-                            }
+                        // Column hashes are 32-byte field elements, hashed 8 at a time in SIMD lanes if enabled.
+                        static_assert(sizeof(digest_type) == fr::BYTES, "digest must be a 32-byte field element");
+                        const bool batched = settings::SETTINGS.lock().use_batched_column_hasher &&
+                                             (layers == 2 || layers == 8 || layers == 11);
+
+                        detail::processing::multicore::build_column_hashes<digest_type>(
+                            layers, tree_count * batches_per_config * batch_nodes, batch_nodes,
+                            std::max(1U, std::thread::hardware_concurrency()),
+                            [&](std::size_t layer, std::uint64_t first, std::uint64_t count, digest_type *out) {
+                                const std::uint64_t node = node_of(first / batch_nodes);
+                                const std::uint64_t config_end = (node / nodes_count + 1) * nodes_count;
+                                count = std::min<std::uint64_t>(count, config_end - node);
+                                const std::vector<digest_type> range = stores[layer].read_range(node, node + count);
+                                std::copy(range.begin(), range.end(), out);
+                            },
+                            [&](const digest_type *columns, std::size_t count, digest_type *column_hashes) {
+                                if (batched) {
+                                    poseidon::hash_columns(layers, reinterpret_cast<const std::uint8_t *>(columns),
+                                                           count, reinterpret_cast<std::uint8_t *>(column_hashes));
+                                    return;
+                                }
+                                for (std::size_t i = 0; i < count; ++i) {
+                                    column_hashes[i] =
+                                        hash_single_column(columns + i * layers, columns + (i + 1) * layers);
+                                }
+                            },
+                            [&](std::uint64_t first, std::uint64_t count, const digest_type *batch_hashes) {
+                                const std::uint64_t node = node_of(first / batch_nodes);
+                                const std::size_t config = node / nodes_count;
+                                const std::uint64_t index = node % nodes_count;
+                                count = std::min<std::uint64_t>(count, nodes_count - index);
+                                if (index == 0) {
+                                    for (; trees_joined + 1 < config; ++trees_joined) {
+                                        tree_builders[trees_joined].get();
+                                    }
+                                    hashes[config].resize(nodes_count);
+                                }
+                                std::copy(batch_hashes, batch_hashes + count, hashes[config].begin() + index);
 
-                            BOOST_LOG_TRIVIAL(info) << std::format("building base tree_c %d/%d", i + 1, tree_count);
-                            trees.push(DiskTree<typename MerkleTreeType::hash_type, MerkleTreeType::base_arity,
-                                                MerkleTreeType::sub_tree_arity, MerkleTreeType::top_tree_arity>::
-                                           from_par_iter_with_config(hashes.into_par_iter(), (*config_it).clone()));
+                                config_nodes_done += count;
+                                if (config_nodes_done < nodes_count) {
+                                    return;
+                                }
+                                config_nodes_done = 0;
+
+                                tree_builders.push_back(std::async(std::launch::async, [&, config]() {
+                                    BOOST_LOG_TRIVIAL(info)
+                                        << std::format("building base tree_c {}/{}", config + 1, tree_count);
+                                    std::vector<digest_type> config_hashes = std::move(hashes[config]);
+                                    DiskTree<typename MerkleTreeType::hash_type, MerkleTreeType::base_arity,
+                                             MerkleTreeType::sub_tree_arity, MerkleTreeType::top_tree_arity>::
+                                        from_par_iter_with_config(std::move(config_hashes), configs[config].clone());
+                                    ++trees_built;
+                                }));
+                            });
+
+                        for (; trees_joined < tree_builders.size(); ++trees_joined) {
+                            tree_builders[trees_joined].get();
                         }
 
-                        BOOST_ASSERT(tree_count == trees.len());
+                        BOOST_ASSERT(tree_count == trees_built);
                         return create_disk_tree<
                             DiskTree<typename MerkleTreeType::hash_type, MerkleTreeType::base_arity,
                                      MerkleTreeType::sub_tree_arity, MerkleTreeType::top_tree_arity>>(configs[0].size,
@@ -780,37 +1135,77 @@ namespace nil {
                         } else {
                             BOOST_LOG_TRIVIAL(info) << "generating tree r last using the CPU";
 
-                            const auto size = Store::len(last_layer_labels);
-
-                            auto start = 0;
-                            auto end = size / tree_count;
-
-                            for (std::size_t i = 0, configs::iterator config_it = configs.begin();
-                                 config_it != configs.end(); ++i, ++config_it) {
-
-                                const auto encoded_data =
-                                    last_layer_labels.read_range(start..end)
-                                        .into_par_iter()
-                                        .zip(data[(start * NODE_SIZE)..(end * NODE_SIZE)].par_chunks_mut(NODE_SIZE))
-                                        .map(| (key, data_node_bytes) | {
-                                            const auto data_node =
-                                                MerkleTreeType::hash_type::digest_type::try_from_bytes(data_node_bytes);
-
-                                            const auto encoded_node =
-                                                encode::<typename MerkleTreeType::hash_type::digest_type>(key,
-                                                                                                          data_node);
-                                            data_node_bytes.copy_from_slice(AsRef::<[u8]>::as_ref(&encoded_node));
-
-                                            encoded_node
-                                        });
+                            typedef typename MerkleTreeType::hash_type::digest_type digest_type;
+                            static_assert(sizeof(digest_type) == NODE_SIZE, "digest must be a node");
+                            std::uint8_t *const replica = data.as_mut().data();
+
+                            // Labels are encoded into the replica, the leaves hashed up in cache-sized tiles and
+                            // the cached rows written out in one pass per config.
+                            for (std::size_t i = 0; i < configs.size(); ++i) {
+                                const StoreConfig &config = configs[i];
+                                const std::uint64_t start = i * nodes_count;
+
+                                // Offsets of the levels in the cache file, which only holds those above
+                                // rows_to_discard.
+                                std::vector<std::uint64_t> level_offsets;
+                                std::uint64_t cache_nodes = 0;
+                                for (std::uint64_t width = nodes_count; width > 0;
+                                     width /= MerkleTreeType::base_arity) {
+                                    level_offsets.push_back(cache_nodes);
+                                    if (level_offsets.size() > config.rows_to_discard + 1) {
+                                        cache_nodes += width;
+                                    }
+                                }
+                                BOOST_ASSERT(cache_nodes ==
+                                             get_merkle_tree_cache_size(nodes_count, MerkleTreeType::base_arity,
+                                                                        config.rows_to_discard));
+
+                                const std::string path = StoreConfig::data_path(config.path, config.id).string();
+                                const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                                if (fd < 0) {
+                                    throw std::system_error(errno, std::generic_category(), "could not create " + path);
+                                }
+                                if (::ftruncate(fd, cache_nodes * NODE_SIZE) != 0) {
+                                    const int error = errno;
+                                    ::close(fd);
+                                    throw std::system_error(error, std::generic_category(), "could not size " + path);
+                                }
 
                                 BOOST_LOG_TRIVIAL(info)
-                                    << std::format("building base tree_r_last with CPU %d/%d", i + 1, tree_count);
-                                LCTree<typename MerkleTreeType::hash_type, MerkleTreeType::base_arity, 0,
-                                       0>::from_par_iter_with_config(encoded_data, (*config_it).clone());
-
-                                start = end;
-                                end += size / tree_count;
+                                    << std::format("building base tree_r_last with CPU {}/{}", i + 1, tree_count);
+                                try {
+                                    detail::processing::multicore::build_tree_r_last<digest_type,
+                                                                                     MerkleTreeType::base_arity>(
+                                        nodes_count, detail::processing::multicore::TREE_R_LAST_TILE_LEAVES,
+                                        std::max(1U, std::thread::hardware_concurrency()), config.rows_to_discard,
+                                        [&](std::uint64_t first, std::uint64_t count, digest_type *leaves) {
+                                            const std::vector<digest_type> keys =
+                                                last_layer_labels.read_range(start + first, start + first + count);
+                                            std::uint8_t *bytes = replica + (start + first) * NODE_SIZE;
+                                            for (std::uint64_t k = 0; k < count; ++k, bytes += NODE_SIZE) {
+                                                digest_type data_node;
+                                                std::memcpy(&data_node, bytes, NODE_SIZE);
+                                                leaves[k] = encode<digest_type>(keys[k], data_node);
+                                                std::memcpy(bytes, &leaves[k], NODE_SIZE);
+                                            }
+                                        },
+                                        [](const digest_type *children, std::size_t level) {
+                                            return typename MerkleTreeType::hash_type::Function().multi_node(
+                                                std::vector<digest_type>(children,
+                                                                         children + MerkleTreeType::base_arity),
+                                                level);
+                                        },
+                                        [&](std::size_t level, std::uint64_t first, std::uint64_t count,
+                                            const digest_type *nodes) {
+                                            cache_writer::pwrite_all(
+                                                fd, reinterpret_cast<const std::uint8_t *>(nodes), count * NODE_SIZE,
+                                                (level_offsets[level] + first) * NODE_SIZE, path);
+                                        });
+                                } catch (...) {
+                                    ::close(fd);
+                                    throw;
+                                }
+                                ::close(fd);
                             }
                         };
 
@@ -962,6 +1357,17 @@ namespace nil {
                         return std::get<1>(generate_labels(&pp.graph, &pp.layer_challenges, replica_id, config));
                     }
 
+                    /// Phase1 of replication for a batch of sectors sharing the same public parameters.
+                    /// Returns the labels of each replica in the order of `replica_ids`.
+                    std::vector<Labels<tree_type>>
+                        replicate_phase1_batch(const PublicParams<tree_type> &pp,
+                                               const std::vector<typename tree_hash_type::digest_type> &replica_ids,
+                                               const std::vector<StoreConfig> &configs) {
+                        BOOST_LOG_TRIVIAL(info) << "replicate_phase1_batch";
+
+                        return generate_labels_batch(pp.graph, pp.layer_challenges, replica_ids, configs);
+                    }
+
                     std::tuple << Self as PoRep <'a, typename MerkleTreeType::hash_type, G>>::Tau,  <
                         Self as PoRep <'a, typename MerkleTreeType::hash_type, G> >::ProverAux >  replicate_phase2(
                             const PublicParams<tree_type> &pp, const Labels<tree_type> &labels, const Data &data,
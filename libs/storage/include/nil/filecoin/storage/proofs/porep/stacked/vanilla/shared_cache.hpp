@@ -0,0 +1,368 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#ifndef FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_SHARED_CACHE_HPP
+#define FILECOIN_STORAGE_PROOFS_POREP_STACKED_VANILLA_SHARED_CACHE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#else
+#include <sys/mount.h>
+#endif
+
+#include <boost/log/trivial.hpp>
+
+#include <nil/filecoin/storage/proofs/core/crypto/sha256_compress.hpp>
+
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_codec.hpp>
+
+namespace nil {
+    namespace filecoin {
+        namespace stacked {
+            namespace vanilla {
+                /// Shared parents cache.
+                ///
+                /// A publisher (the `parentcached` tool, left running on the sealing box) decodes a parents cache once
+                /// into a file of a memory file system, `parent_cache_shared_dir`: tmpfs, or a hugetlbfs mount
+                /// to back it with huge pages. It locks the pages in memory for as long as it lives. Sealing
+                /// processes then attach to that file read-only and use the decoded entries in place, so all of
+                /// them share a single resident copy instead of competing for page cache with their own
+                /// mappings of the cache file.
+                ///
+                /// Layout: a header page (magic u64 | degree u64 | nodes u64 | source size u64, little-endian |
+                /// SHA-256 of the entries), followed by DEGREE native-endian u32 per node. The magic is written
+                /// last, a file without it is still being published and is ignored. A copy whose source size no
+                /// longer matches the cache file was published from another version of it and is ignored too.
+
+                constexpr static const std::uint64_t SHARED_PARENT_CACHE_MAGIC = 0x3163687364726473;    // "sdrdshc1"
+
+                constexpr static const std::size_t SHARED_PARENT_CACHE_HEADER_SIZE = 4096;
+
+                /// Number of nodes decoded at once while publishing.
+                constexpr static const std::size_t SHARED_PARENT_CACHE_PUBLISH_NODES = 1 << 16;
+
+                /// Path of the shared copy of the parents cache `cache_path` inside `shared_dir`.
+                inline std::string shared_parent_cache_path(const std::string &shared_dir,
+                                                            const std::string &cache_path) {
+                    const std::size_t slash = cache_path.find_last_of('/');
+                    return shared_dir + "/" + (slash == std::string::npos ? cache_path : cache_path.substr(slash + 1));
+                }
+
+                /// Read-only attachment to a published shared parents cache.
+                class shared_parent_cache {
+                public:
+                    /// Attaches to the shared copy of `cache_path`, returns null if none is published or the
+                    /// published one does not match `cache_path`. With `verify`, the entries are also checked
+                    /// against their digest, as `verify_cache` does for the cache file, the first time this
+                    /// process attaches to the copy.
+                    static std::shared_ptr<shared_parent_cache> attach(const std::string &shared_dir,
+                                                                       const std::string &cache_path,
+                                                                       bool verify = false) {
+                        const std::string path = shared_parent_cache_path(shared_dir, cache_path);
+                        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                        if (fd < 0) {
+                            return nullptr;
+                        }
+
+                        struct stat st;
+                        void *ptr = MAP_FAILED;
+                        if (::fstat(fd, &st) == 0 && std::size_t(st.st_size) >= SHARED_PARENT_CACHE_HEADER_SIZE) {
+                            ptr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                        }
+                        ::close(fd);
+                        if (ptr == MAP_FAILED) {
+                            return nullptr;
+                        }
+
+                        std::shared_ptr<shared_parent_cache> cache(
+                            new shared_parent_cache(static_cast<const std::uint8_t *>(ptr), st.st_size));
+                        const std::uint8_t *header = cache->base_;
+                        const std::uint64_t nodes = cache_codec::get_le(header + 16, 8);
+                        if (cache_codec::get_le(header, 8) != SHARED_PARENT_CACHE_MAGIC ||
+                            cache_codec::get_le(header + 8, 8) != DEGREE ||
+                            SHARED_PARENT_CACHE_HEADER_SIZE + nodes * DEGREE * sizeof(std::uint32_t) > cache->size_) {
+                            return nullptr;
+                        }
+
+                        struct stat source;
+                        if (::stat(cache_path.c_str(), &source) != 0 ||
+                            std::uint64_t(source.st_size) != cache_codec::get_le(header + 24, 8)) {
+                            BOOST_LOG_TRIVIAL(warning)
+                                << std::format("shared parent cache: ignoring {}, published from another {}", path,
+                                               cache_path);
+                            return nullptr;
+                        }
+                        cache->nodes_ = nodes;
+
+                        if (verify) {
+                            // Hashing the copy takes as long as reading tens of gigabytes, a published copy
+                            // is verified once per process. It is told apart from a later copy at the same
+                            // path by its inode, modification time and recorded digest.
+                            const std::string key =
+                                path + ":" + std::to_string(st.st_ino) + ":" + modification_time(st) + ":" +
+                                std::string(reinterpret_cast<const char *>(header + 32), sha256::DIGEST_SIZE);
+                            static std::mutex verified_mutex;
+                            static std::set<std::string> verified;
+                            const std::lock_guard<std::mutex> lock(verified_mutex);
+                            if (verified.count(key) == 0) {
+                                if (!std::equal(header + 32, header + 32 + sha256::DIGEST_SIZE,
+                                                cache->digest().begin())) {
+                                    BOOST_LOG_TRIVIAL(warning)
+                                        << std::format("shared parent cache: ignoring {}, digest mismatch", path);
+                                    return nullptr;
+                                }
+                                verified.insert(key);
+                            }
+                        }
+                        return cache;
+                    }
+
+                    shared_parent_cache(const shared_parent_cache &) = delete;
+                    shared_parent_cache &operator=(const shared_parent_cache &) = delete;
+
+                    ~shared_parent_cache() {
+                        ::munmap(const_cast<std::uint8_t *>(base_), size_);
+                    }
+
+                    std::uint64_t nodes() const {
+                        return nodes_;
+                    }
+
+                    /// The DEGREE parents of every node, one node after the other.
+                    const std::uint32_t *entries() const {
+                        return reinterpret_cast<const std::uint32_t *>(base_ + SHARED_PARENT_CACHE_HEADER_SIZE);
+                    }
+
+                    /// SHA-256 of the entries of `nodes` nodes at `entries`, as recorded in the header.
+                    static std::array<std::uint8_t, sha256::DIGEST_SIZE> digest(const std::uint32_t *entries,
+                                                                                std::uint64_t nodes) {
+                        return sha256::digest(reinterpret_cast<const std::uint8_t *>(entries),
+                                              nodes * DEGREE * sizeof(std::uint32_t));
+                    }
+
+                private:
+                    shared_parent_cache(const std::uint8_t *base, std::size_t size) : base_(base), size_(size) {
+                    }
+
+                    std::array<std::uint8_t, sha256::DIGEST_SIZE> digest() const {
+                        return digest(entries(), nodes_);
+                    }
+
+                    /// Modification time of `st` to the nanosecond, so that a copy modified in place is told
+                    /// apart.
+                    static std::string modification_time(const struct stat &st) {
+#ifdef __APPLE__
+                        const struct timespec &time = st.st_mtimespec;
+#else
+                        const struct timespec &time = st.st_mtim;
+#endif
+                        return std::to_string(time.tv_sec) + "." + std::to_string(time.tv_nsec);
+                    }
+
+                    const std::uint8_t *base_;
+                    std::size_t size_;
+                    std::uint64_t nodes_ = 0;
+                };
+
+                /// Publishes the parents cache `cache_path` (raw or compressed) into `shared_dir` and keeps it
+                /// locked in memory until destroyed. The published file itself outlives the publisher, so
+                /// attached processes are never left with a dangling mapping.
+                class shared_parent_cache_publisher {
+                public:
+                    shared_parent_cache_publisher(const std::string &shared_dir, const std::string &cache_path) {
+                        const std::string path = shared_parent_cache_path(shared_dir, cache_path);
+                        if (shared_parent_cache::attach(shared_dir, cache_path)) {
+                            map(path, O_RDONLY, PROT_READ);
+                            lock(path);
+                            return;
+                        }
+
+                        const std::string tmp_path = path + ".tmp." + std::to_string(::getpid());
+                        struct stat source;
+                        if (::stat(cache_path.c_str(), &source) != 0) {
+                            throw std::system_error(errno, std::generic_category(), "could not stat " + cache_path);
+                        }
+                        const std::uint64_t nodes = cache_nodes(cache_path, source.st_size);
+                        const std::size_t payload =
+                            SHARED_PARENT_CACHE_HEADER_SIZE + nodes * DEGREE * sizeof(std::uint32_t);
+
+                        const int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                        if (fd < 0) {
+                            throw std::system_error(errno, std::generic_category(), "could not create " + tmp_path);
+                        }
+                        // hugetlbfs only accepts sizes in whole huge pages, its block size.
+                        struct statfs fs;
+                        const std::size_t page = ::fstatfs(fd, &fs) == 0 && fs.f_bsize > 0 ? fs.f_bsize : 4096;
+                        size_ = (payload + page - 1) / page * page;
+                        if (::ftruncate(fd, size_) != 0) {
+                            const int error = errno;
+                            ::close(fd);
+                            ::unlink(tmp_path.c_str());
+                            throw std::system_error(error, std::generic_category(), "could not size " + tmp_path);
+                        }
+                        void *ptr = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                        ::close(fd);
+                        if (ptr == MAP_FAILED) {
+                            const int error = errno;
+                            ::unlink(tmp_path.c_str());
+                            throw std::system_error(error, std::generic_category(), "could not mmap " + tmp_path);
+                        }
+                        base_ = static_cast<std::uint8_t *>(ptr);
+
+                        try {
+                            decode(cache_path, nodes,
+                                   reinterpret_cast<std::uint32_t *>(base_ + SHARED_PARENT_CACHE_HEADER_SIZE));
+                        } catch (...) {
+                            ::munmap(base_, size_);
+                            ::unlink(tmp_path.c_str());
+                            throw;
+                        }
+
+                        std::vector<std::uint8_t> header;
+                        cache_codec::put_le(header, DEGREE, 8);
+                        cache_codec::put_le(header, nodes, 8);
+                        cache_codec::put_le(header, source.st_size, 8);
+                        const std::array<std::uint8_t, sha256::DIGEST_SIZE> digest = shared_parent_cache::digest(
+                            reinterpret_cast<const std::uint32_t *>(base_ + SHARED_PARENT_CACHE_HEADER_SIZE), nodes);
+                        header.insert(header.end(), digest.begin(), digest.end());
+                        std::memcpy(base_ + 8, header.data(), header.size());
+                        header.clear();
+                        cache_codec::put_le(header, SHARED_PARENT_CACHE_MAGIC, 8);
+                        std::memcpy(base_, header.data(), header.size());
+
+                        ::msync(base_, size_, MS_SYNC);
+                        if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                            const int error = errno;
+                            ::munmap(base_, size_);
+                            base_ = nullptr;
+                            ::unlink(tmp_path.c_str());
+                            throw std::system_error(error, std::generic_category(), "could not publish " + path);
+                        }
+                        lock(path);
+
+                        BOOST_LOG_TRIVIAL(info)
+                            << std::format("shared parent cache: published {} ({} nodes)", path, nodes);
+                    }
+
+                    shared_parent_cache_publisher(const shared_parent_cache_publisher &) = delete;
+                    shared_parent_cache_publisher &operator=(const shared_parent_cache_publisher &) = delete;
+
+                    ~shared_parent_cache_publisher() {
+                        if (base_ != nullptr) {
+                            ::munmap(base_, size_);
+                        }
+                    }
+
+                private:
+                    static std::uint64_t cache_nodes(const std::string &cache_path, std::uint64_t cache_size) {
+                        if (compressed_cache_reader::is_compressed(cache_path)) {
+                            return compressed_cache_reader(cache_path).nodes();
+                        }
+                        return cache_size / (DEGREE * sizeof(std::uint32_t));
+                    }
+
+                    static void decode(const std::string &cache_path, std::uint64_t nodes, std::uint32_t *entries) {
+                        if (compressed_cache_reader::is_compressed(cache_path)) {
+                            compressed_cache_reader reader(cache_path);
+                            for (std::uint64_t first = 0; first < nodes; first += SHARED_PARENT_CACHE_PUBLISH_NODES) {
+                                const std::uint64_t count =
+                                    std::min<std::uint64_t>(SHARED_PARENT_CACHE_PUBLISH_NODES, nodes - first);
+                                reader.decode_range(first, count, entries + first * DEGREE);
+                            }
+                            return;
+                        }
+
+                        std::ifstream in(cache_path, std::ios::binary);
+                        std::vector<std::uint8_t> chunk(SHARED_PARENT_CACHE_PUBLISH_NODES * DEGREE *
+                                                        sizeof(std::uint32_t));
+                        for (std::uint64_t first = 0; first < nodes; first += SHARED_PARENT_CACHE_PUBLISH_NODES) {
+                            const std::uint64_t count =
+                                std::min<std::uint64_t>(SHARED_PARENT_CACHE_PUBLISH_NODES, nodes - first);
+                            if (!in.read(reinterpret_cast<char *>(chunk.data()),
+                                         count * DEGREE * sizeof(std::uint32_t))) {
+                                throw std::runtime_error("truncated parents cache: " + cache_path);
+                            }
+                            for (std::size_t i = 0; i < count * DEGREE; ++i) {
+                                entries[first * DEGREE + i] = static_cast<std::uint32_t>(
+                                    cache_codec::get_le(chunk.data() + i * sizeof(std::uint32_t), 4));
+                            }
+                        }
+                    }
+
+                    void map(const std::string &path, int flags, int prot) {
+                        const int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+                        struct stat st;
+                        if (fd < 0 || ::fstat(fd, &st) != 0) {
+                            const int error = errno;
+                            if (fd >= 0) {
+                                ::close(fd);
+                            }
+                            throw std::system_error(error, std::generic_category(), "could not open " + path);
+                        }
+                        size_ = st.st_size;
+                        void *ptr = ::mmap(nullptr, size_, prot, MAP_SHARED, fd, 0);
+                        ::close(fd);
+                        if (ptr == MAP_FAILED) {
+                            throw std::system_error(errno, std::generic_category(), "could not mmap " + path);
+                        }
+                        base_ = static_cast<std::uint8_t *>(ptr);
+                    }
+
+                    void lock(const std::string &path) {
+                        // Without the lock tmpfs pages can still be swapped out; hugetlbfs pages never are.
+                        if (::mlock(base_, size_) != 0) {
+                            BOOST_LOG_TRIVIAL(warning) << std::format(
+                                "shared parent cache: could not lock {} in memory, check RLIMIT_MEMLOCK", path);
+                        }
+                    }
+
+                    std::uint8_t *base_ = nullptr;
+                    std::size_t size_ = 0;
+                };
+            }    // namespace vanilla
+        }        // namespace stacked
+    }            // namespace filecoin
+}    // namespace nil
+
+#endif
@@ -0,0 +1,100 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE chacha8_test
+
+#include <array>
+#include <cstdint>
+
+#include <boost/test/unit_test.hpp>
+
+#include <nil/filecoin/storage/proofs/core/crypto/chacha8.hpp>
+
+using namespace nil::filecoin;
+
+BOOST_AUTO_TEST_SUITE(chacha8_test_suite)
+
+chacha8::key_type key_of(std::uint8_t first_byte) {
+    std::array<std::uint8_t, 32> seed = {};
+    seed[0] = first_byte;
+    return chacha8::key_from_seed(seed.data());
+}
+
+// Keystream words, little endian, of the 8-round ChaCha test vectors of draft-strombergson-chacha-test-vectors
+// (TC1 and TC2, 256-bit key, zero IV).
+BOOST_AUTO_TEST_CASE(test_block_known_answer) {
+    const chacha8::block_type zero_key_block_0 = {0x2fef003e, 0xd6405f89, 0xe8b85b7f, 0xa1a5091f,
+                                                  0xc30e842c, 0x3b7f9ace, 0x88e11b18, 0x1e1a71ef,
+                                                  0x72e14c98, 0x416f21b9, 0x6753449f, 0x19566d45,
+                                                  0xa3424a31, 0x01b086da, 0xb8fd7b38, 0x42fe0c0e};
+    const chacha8::block_type zero_key_block_1 = {0x0dfaaed2, 0x51c1a5ea, 0x6cdb0abf, 0xada5f201,
+                                                  0x1258fdc0, 0xaaa2f959, 0x8f0ff2dc, 0x6ba266d5,
+                                                  0x38ec3250, 0x98dac5bb, 0x566f0cee, 0x652a878b,
+                                                  0x25bf8aa0, 0xbb21eb1d, 0xd8e5564b, 0xaa681e82};
+    const chacha8::block_type one_key_block_0 = {0xa0e95ecf, 0x61a94a49, 0xedd5053e, 0x4b805b72,
+                                                 0x65a4f412, 0xcc5a63ee, 0xe81d313a, 0xea890474,
+                                                 0xf4049d28, 0xdb18753c, 0x3344eb56, 0x23a198e4,
+                                                 0x4d46d88c, 0xbbdd6337, 0x3bee2292, 0xc8e3fad8};
+
+    chacha8::block_type block;
+    chacha8::block(key_of(0), 0, block);
+    BOOST_CHECK(block == zero_key_block_0);
+    chacha8::block(key_of(0), 1, block);
+    BOOST_CHECK(block == zero_key_block_1);
+    chacha8::block(key_of(1), 0, block);
+    BOOST_CHECK(block == one_key_block_0);
+}
+
+BOOST_AUTO_TEST_CASE(test_block_x8_matches_block) {
+    std::array<chacha8::key_type, chacha8::LANES> keys;
+    for (std::size_t lane = 0; lane < chacha8::LANES; ++lane) {
+        keys[lane] = key_of(static_cast<std::uint8_t>(lane * 37 + 1));
+    }
+
+    for (std::uint64_t counter : {std::uint64_t(0), std::uint64_t(3), std::uint64_t(1) << 32}) {
+        std::array<chacha8::block_type, chacha8::LANES> blocks;
+        chacha8::block_x8(keys.data(), counter, blocks.data());
+        for (std::size_t lane = 0; lane < chacha8::LANES; ++lane) {
+            chacha8::block_type expected;
+            chacha8::block(keys[lane], counter, expected);
+            BOOST_CHECK(blocks[lane] == expected);
+        }
+
+#ifdef FILECOIN_CHACHA8_X86_KERNELS
+        // block_x8 dispatches, so the AVX2 kernel is also checked directly when the CPU has it.
+        if (chacha8::has_avx2()) {
+            chacha8::block_avx2_x8(keys.data(), counter, blocks.data());
+            for (std::size_t lane = 0; lane < chacha8::LANES; ++lane) {
+                chacha8::block_type expected;
+                chacha8::block(keys[lane], counter, expected);
+                BOOST_CHECK(blocks[lane] == expected);
+            }
+        }
+#endif
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
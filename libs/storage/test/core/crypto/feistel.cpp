@@ -87,4 +87,21 @@ BOOST_AUTO_TEST_CASE(test_feistel_on_arbitrary_set) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_feistel_permute_batch) {
+    const std::vector<Index> keys = {1, 2, 3, 4};
+    for (const Index n : {5, 17, 1000, 1 << 12}) {
+        const auto precomputed = precompute(n);
+
+        std::vector<Index> indices(n), batch(n);
+        for (Index i = 0; i < n; ++i) {
+            indices[i] = (i * 7) % n;
+        }
+        permute_batch(n, indices.data(), indices.size(), keys, precomputed, batch.data());
+
+        for (Index i = 0; i < n; ++i) {
+            BOOST_CHECK_EQUAL(batch[i], permute(n, indices[i], keys, precomputed));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,162 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+#define BOOST_TEST_MODULE poseidon_batch_test
+
+#include <iterator>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <nil/crypto3/algebra/curves/bls12.hpp>
+#include <nil/crypto3/multiprecision/cpp_int.hpp>
+
+#include <nil/filecoin/storage/proofs/core/crypto/poseidon_batch.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/hash.hpp>
+
+using namespace nil::filecoin;
+
+BOOST_AUTO_TEST_SUITE(poseidon_batch_test_suite)
+
+std::array<std::uint8_t, fr::BYTES> from_hex(const char *hex) {
+    std::array<std::uint8_t, fr::BYTES> bytes;
+    for (std::size_t i = 0; i < fr::BYTES; ++i) {
+        bytes[i] = static_cast<std::uint8_t>(std::stoi(std::string(hex + 2 * i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+/// Canonical pseudo-random field elements, the top byte kept below that of the modulus.
+std::vector<std::uint8_t> sample_inputs(std::size_t elements) {
+    std::vector<std::uint8_t> inputs(elements * fr::BYTES);
+    std::uint64_t x = 0x9e3779b97f4a7c15;
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        inputs[i] = static_cast<std::uint8_t>(x);
+        if (i % fr::BYTES == fr::BYTES - 1) {
+            inputs[i] &= 0x3f;
+        }
+    }
+    return inputs;
+}
+
+BOOST_AUTO_TEST_CASE(test_field_arithmetic) {
+    const std::vector<std::uint8_t> inputs = sample_inputs(16);
+    for (std::size_t i = 0; i < 16; ++i) {
+        fr::element a;
+        BOOST_CHECK(fr::from_bytes(inputs.data() + i * fr::BYTES, a));
+        BOOST_CHECK(fr::mul(a, fr::inverse(a)) == fr::ONE);
+        BOOST_CHECK(fr::add(fr::sub(fr::ONE, a), a) == fr::ONE);
+
+        std::array<std::uint8_t, fr::BYTES> bytes;
+        fr::to_bytes(a, bytes.data());
+        BOOST_CHECK(std::equal(bytes.begin(), bytes.end(), inputs.begin() + i * fr::BYTES));
+    }
+
+    // p itself is rejected, p - 1 is the largest canonical element.
+    std::array<std::uint8_t, fr::BYTES> modulus;
+    for (std::size_t i = 0; i < fr::BYTES; ++i) {
+        modulus[i] = static_cast<std::uint8_t>(fr::MODULUS[i / 8] >> (8 * (i % 8)));
+    }
+    fr::element value;
+    BOOST_CHECK(!fr::from_bytes(modulus.data(), value));
+    modulus[0] -= 1;
+    BOOST_CHECK(fr::from_bytes(modulus.data(), value));
+    BOOST_CHECK(fr::add(value, fr::ONE) == fr::element {});
+}
+
+BOOST_AUTO_TEST_CASE(test_hash_matches_reference) {
+    // Computed with an independent implementation of the same parameter generation.
+    const std::array<std::uint8_t, fr::BYTES> a =
+        from_hex("f5b165224a58b791df6af1d8303e61cdc4bb86c3d1c427103c344c41c4f5170f");
+    const std::array<std::uint8_t, fr::BYTES> b =
+        from_hex("7bd5d47e446fcec2a3d811736110e5781bcccea696762e6116c6e9c996ccdf1a");
+    const std::array<std::uint8_t, fr::BYTES> expected =
+        from_hex("f4073259140a873eccc7f2404ae56890c19e4a621f21391920d7645c9643562e");
+
+    std::vector<std::uint8_t> inputs(a.begin(), a.end());
+    inputs.insert(inputs.end(), b.begin(), b.end());
+    std::array<std::uint8_t, fr::BYTES> digest;
+    poseidon::hash_batch_scalar<2>(inputs.data(), 1, digest.data());
+    BOOST_CHECK(digest == expected);
+}
+
+template<std::size_t Arity>
+void check_batch_matches_scalar() {
+    // Not a multiple of the lane count, so that both paths of `hash_batch` are taken.
+    const std::size_t count = 3 * poseidon::LANES + 5;
+    const std::vector<std::uint8_t> inputs = sample_inputs(count * Arity);
+
+    std::vector<std::uint8_t> scalar(count * fr::BYTES);
+    std::vector<std::uint8_t> batched(count * fr::BYTES);
+    poseidon::hash_batch_scalar<Arity>(inputs.data(), count, scalar.data());
+    poseidon::hash_columns(Arity, inputs.data(), count, batched.data());
+    BOOST_CHECK(scalar == batched);
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_matches_scalar) {
+    check_batch_matches_scalar<2>();
+    check_batch_matches_scalar<8>();
+    check_batch_matches_scalar<11>();
+}
+
+template<std::size_t Arity>
+void check_columns_match_crypto3() {
+    typedef nil::crypto3::algebra::curves::bls12<381>::scalar_field_type field_type;
+    typedef typename field_type::value_type value_type;
+    typedef typename field_type::integral_type integral_type;
+
+    const std::size_t count = poseidon::LANES + 3;
+    const std::vector<std::uint8_t> inputs = sample_inputs(count * Arity);
+    std::vector<std::uint8_t> batched(count * fr::BYTES);
+    poseidon::hash_columns(Arity, inputs.data(), count, batched.data());
+
+    for (std::size_t i = 0; i < count; ++i) {
+        std::vector<value_type> column;
+        for (std::size_t j = 0; j < Arity; ++j) {
+            const std::uint8_t *element = inputs.data() + (i * Arity + j) * fr::BYTES;
+            integral_type value;
+            nil::crypto3::multiprecision::import_bits(value, element, element + fr::BYTES, 8, false);
+            column.emplace_back(value);
+        }
+        const value_type expected = hash_single_column<field_type>(column.begin(), column.end());
+
+        std::vector<std::uint8_t> bytes;
+        nil::crypto3::multiprecision::export_bits(static_cast<integral_type>(expected.data),
+                                                  std::back_inserter(bytes), 8, false);
+        bytes.resize(fr::BYTES);
+        BOOST_CHECK(std::equal(bytes.begin(), bytes.end(), batched.begin() + i * fr::BYTES));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_columns_match_crypto3) {
+    // The column heights `hash_single_column` hashes with crypto3 on the unbatched path.
+    check_columns_match_crypto3<2>();
+    check_columns_match_crypto3<11>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE sha256_compress_test
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <nil/crypto3/hash/sha2.hpp>
+#include <nil/crypto3/hash/algorithm/hash.hpp>
+
+#include <nil/filecoin/storage/proofs/core/crypto/sha256_compress.hpp>
+#include <nil/filecoin/storage/proofs/core/hasher/sha256.hpp>
+
+using namespace nil::filecoin;
+
+BOOST_AUTO_TEST_SUITE(sha256_compress_test_suite)
+
+std::vector<std::uint8_t> padded_message(std::size_t length) {
+    std::vector<std::uint8_t> message(sha256::padded_blocks(length) * sha256::BLOCK_SIZE);
+    for (std::size_t i = 0; i < length; ++i) {
+        message[i] = static_cast<std::uint8_t>(i * 31 + length);
+    }
+    sha256::pad(message.data(), length);
+    return message;
+}
+
+std::array<std::uint8_t, sha256::DIGEST_SIZE> reference_digest(std::size_t length) {
+    std::vector<std::uint8_t> message = padded_message(length);
+    message.resize(length);
+
+    typename nil::crypto3::hashes::sha2<256>::digest_type digest =
+        nil::crypto3::hash<nil::crypto3::hashes::sha2<256>>(message);
+
+    std::array<std::uint8_t, sha256::DIGEST_SIZE> result;
+    std::copy(digest.begin(), digest.end(), result.begin());
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_compress_matches_sha2) {
+    for (std::size_t length = 0; length < 1300; length += 13) {
+        const std::vector<std::uint8_t> message = padded_message(length);
+        const std::size_t blocks = message.size() / sha256::BLOCK_SIZE;
+
+        sha256::state_type portable = sha256::INITIAL_STATE;
+        sha256::compress_portable(portable, message.data(), blocks);
+
+        sha256::state_type dispatched = sha256::INITIAL_STATE;
+        sha256::compress(dispatched, message.data(), blocks);
+
+        std::array<std::uint8_t, sha256::DIGEST_SIZE> digest;
+        sha256::store_digest(portable, digest.data());
+
+        BOOST_CHECK(digest == reference_digest(length));
+        BOOST_CHECK(portable == dispatched);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_compress_x8_matches_single_lane) {
+    const std::size_t length = 1228;
+    std::vector<std::vector<std::uint8_t>> messages;
+    const std::uint8_t *data[sha256::LANES];
+    for (std::size_t lane = 0; lane < sha256::LANES; ++lane) {
+        messages.push_back(padded_message(length));
+        messages.back()[lane] ^= 0xff;
+        data[lane] = messages.back().data();
+    }
+
+    std::array<sha256::state_type, sha256::LANES> states;
+    states.fill(sha256::INITIAL_STATE);
+    sha256::compress_x8(states, data, sha256::padded_blocks(length));
+
+    for (std::size_t lane = 0; lane < sha256::LANES; ++lane) {
+        sha256::state_type expected = sha256::INITIAL_STATE;
+        sha256::compress_portable(expected, data[lane], sha256::padded_blocks(length));
+        BOOST_CHECK(states[lane] == expected);
+    }
+}
+
+#ifdef FILECOIN_SHA256_X86_KERNELS
+// The dispatcher only ever runs the fastest kernel, so each one is also checked directly when the CPU has it.
+BOOST_AUTO_TEST_CASE(test_sha_ni_matches_portable) {
+    if (!sha256::supports(sha256::backend::sha_ni)) {
+        BOOST_TEST_MESSAGE("SHA-NI not supported, skipping");
+        return;
+    }
+    for (std::size_t length = 0; length < 1300; length += 13) {
+        const std::vector<std::uint8_t> message = padded_message(length);
+        const std::size_t blocks = message.size() / sha256::BLOCK_SIZE;
+
+        sha256::state_type expected = sha256::INITIAL_STATE;
+        sha256::compress_portable(expected, message.data(), blocks);
+
+        sha256::state_type state = sha256::INITIAL_STATE;
+        sha256::compress_sha_ni(state, message.data(), blocks);
+        BOOST_CHECK(state == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_avx2_x8_matches_portable) {
+    if (!sha256::supports(sha256::backend::avx2)) {
+        BOOST_TEST_MESSAGE("AVX2 not supported, skipping");
+        return;
+    }
+    for (std::size_t length = 0; length < 1300; length += 13) {
+        std::vector<std::vector<std::uint8_t>> messages;
+        const std::uint8_t *data[sha256::LANES];
+        for (std::size_t lane = 0; lane < sha256::LANES; ++lane) {
+            messages.push_back(padded_message(length));
+            messages.back()[lane % (length + 1)] ^= static_cast<std::uint8_t>(lane + 1);
+            data[lane] = messages.back().data();
+        }
+
+        std::array<sha256::state_type, sha256::LANES> states;
+        states.fill(sha256::INITIAL_STATE);
+        sha256::compress_avx2_x8(states, data, sha256::padded_blocks(length));
+
+        for (std::size_t lane = 0; lane < sha256::LANES; ++lane) {
+            sha256::state_type expected = sha256::INITIAL_STATE;
+            sha256::compress_portable(expected, data[lane], sha256::padded_blocks(length));
+            BOOST_CHECK(states[lane] == expected);
+        }
+    }
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(test_hash_pairs_matches_sha2) {
+    // Not a multiple of the lane count, so that both paths are taken.
+    const std::size_t pairs = 3 * sha256::LANES + 5;
+    std::vector<std::uint8_t> in(pairs * sha256::PAIR_SIZE);
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        in[i] = static_cast<std::uint8_t>(i * 17 + (i >> 7));
+    }
+
+    std::vector<std::uint8_t> out(pairs * sha256::NODE_SIZE);
+    sha256::hash_pairs(in.data(), out.data(), pairs);
+
+    for (std::size_t i = 0; i < pairs; ++i) {
+        typename nil::crypto3::hashes::sha2<256>::digest_type digest =
+            nil::crypto3::hash<nil::crypto3::hashes::sha2<256>>(in.begin() + i * sha256::PAIR_SIZE,
+                                                                in.begin() + (i + 1) * sha256::PAIR_SIZE);
+        digest[sha256::NODE_SIZE - 1] &= 0x3f;
+        BOOST_CHECK(std::equal(digest.begin(), digest.end(), out.begin() + i * sha256::NODE_SIZE));
+    }
+
+    // In place, as the tree builders do.
+    sha256::hash_pairs(in.data(), in.data(), pairs);
+    BOOST_CHECK(std::equal(out.begin(), out.end(), in.begin()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
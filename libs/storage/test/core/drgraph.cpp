@@ -0,0 +1,67 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE drgraph_test
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <nil/crypto3/hash/sha2.hpp>
+
+#include <nil/filecoin/storage/proofs/core/drgraph.hpp>
+
+using namespace nil::filecoin;
+
+BOOST_AUTO_TEST_SUITE(drgraph_test_suite)
+
+BOOST_AUTO_TEST_CASE(test_parents_range_matches_parents) {
+    const std::size_t nodes = 1 << 12;
+    const std::array<std::uint8_t, 32> porep_id = {1, 2, 3};
+    const BucketGraph<nil::crypto3::hashes::sha2<256>> graph(nodes, BASE_DEGREE, 0, porep_id);
+
+    // Ranges starting off the 8-node groups of the ChaCha8 kernel and ending inside one, including the
+    // special cased nodes 0 and 1 and the last node of the graph.
+    const std::pair<std::size_t, std::size_t> ranges[] = {
+        {0, 1}, {0, 2}, {0, 19}, {1, 8}, {5, 13}, {7, 9}, {1000, 24}, {nodes - 11, 11}};
+
+    std::vector<std::uint32_t> parents(graph.degree());
+    for (const auto &[start, count] : ranges) {
+        std::vector<std::uint32_t> range(count * graph.degree());
+        graph.parents_range(start, count, range.data());
+
+        for (std::size_t i = 0; i < count; ++i) {
+            graph.parents(start + i, parents);
+            BOOST_CHECK(std::equal(parents.begin(), parents.end(), range.begin() + i * graph.degree()));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
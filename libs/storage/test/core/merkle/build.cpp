@@ -0,0 +1,96 @@
+//----------------------------------------------------------------------------
+// Copyright (C) 2018-2020 Mikhail Komarov <nemo@nil.foundation>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Server Side Public License, version 1,
+// as published by the author.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Server Side Public License for more details.
+//
+// You should have received a copy of the Server Side Public License
+// along with this program. If not, see
+// <https://github.com/NilFoundation/plugin/blob/master/LICENSE_1_0.txt>.
+//----------------------------------------------------------------------------
+
+#define BOOST_TEST_MODULE merkle_build_test
+
+#include <cstdint>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <nil/crypto3/hash/sha2.hpp>
+
+#include <nil/filecoin/storage/proofs/core/merkle/merkle.hpp>
+#include <nil/filecoin/storage/proofs/core/merkle/storage/disk.hpp>
+#include <nil/filecoin/storage/proofs/core/merkle/storage/vec.hpp>
+
+using namespace nil::filecoin;
+
+BOOST_AUTO_TEST_SUITE(merkle_build_test_suite)
+
+typedef nil::crypto3::hashes::sha2<256> hash_type;
+
+/// Builds the tree over the same leaves in `parallel_store` with the tiled parallel `build` and in `serial_store`
+/// one level at a time, and checks that every node agrees.
+template<std::size_t Arity, typename Store>
+void build_matches_serial(Store parallel_store, Store serial_store, std::size_t leafs,
+                          const utilities::StoreConfig &config) {
+    typedef merkletree::MerkleTree<hash_type, Store, Arity> tree_type;
+
+    std::vector<std::uint8_t> data(leafs * tree_type::element_size);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<std::uint8_t>(i * 131 + (i >> 9));
+    }
+    parallel_store.write(std::make_pair(data.data(), data.data() + data.size()), 0);
+    serial_store.write(std::make_pair(data.data(), data.data() + data.size()), 0);
+
+    tree_type parallel(parallel_store);
+    tree_type serial(serial_store);
+    // Well above `SMALL_TREE_BUILD`, so that `build` goes through `process_layers` with several tiles.
+    BOOST_REQUIRE(leafs > merkletree::BUILD_CHUNK_NODES * Arity);
+
+    const typename tree_type::element parallel_root = parallel.template build<Arity>(leafs, parallel.row_count, config);
+    const typename tree_type::element serial_root = serial.template build_small_tree<Arity>(leafs, serial.row_count);
+
+    BOOST_CHECK(parallel_root == serial_root);
+    BOOST_CHECK(parallel.read_range(0, parallel.len) == serial.read_range(0, serial.len));
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_build_vec_store) {
+    const utilities::StoreConfig config(boost::filesystem::temp_directory_path(), "merkle_build_vec", 0);
+
+    const std::size_t binary_leafs = 1 << 16;
+    const std::size_t binary_len = utilities::get_merkle_tree_len(binary_leafs, 2);
+    build_matches_serial<2>(storage::VecStore(binary_len), storage::VecStore(binary_len), binary_leafs, config);
+
+    const std::size_t oct_leafs = 1 << 18;
+    const std::size_t oct_len = utilities::get_merkle_tree_len(oct_leafs, 8);
+    build_matches_serial<8>(storage::VecStore(oct_len), storage::VecStore(oct_len), oct_leafs, config);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_build_disk_store) {
+    const boost::filesystem::path directory = boost::filesystem::temp_directory_path() / "merkle_build_test";
+    boost::filesystem::create_directories(directory);
+    const utilities::StoreConfig parallel_config(directory, "parallel", 0);
+    const utilities::StoreConfig serial_config(directory, "serial", 0);
+
+    const std::size_t binary_leafs = 1 << 16;
+    const std::size_t binary_len = utilities::get_merkle_tree_len(binary_leafs, 2);
+    build_matches_serial<2>(storage::DiskStore(binary_len, 2, parallel_config),
+                            storage::DiskStore(binary_len, 2, serial_config), binary_leafs, parallel_config);
+    boost::filesystem::remove_all(directory);
+    boost::filesystem::create_directories(directory);
+
+    const std::size_t oct_leafs = 1 << 18;
+    const std::size_t oct_len = utilities::get_merkle_tree_len(oct_leafs, 8);
+    build_matches_serial<8>(storage::DiskStore(oct_len, 8, parallel_config),
+                            storage::DiskStore(oct_len, 8, serial_config), oct_leafs, parallel_config);
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+//----------------------------------------------------------------------------
+// Copyright (C) 2018-2020 Mikhail Komarov <nemo@nil.foundation>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the Server Side Public License, version 1,
+// as published by the author.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Server Side Public License for more details.
+//
+// You should have received a copy of the Server Side Public License
+// along with this program. If not, see
+// <https://github.com/NilFoundation/plugin/blob/master/LICENSE_1_0.txt>.
+//----------------------------------------------------------------------------
+
+#define BOOST_TEST_MODULE tree_d_builder_test
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <nil/crypto3/hash/sha2.hpp>
+#include <nil/crypto3/hash/algorithm/hash.hpp>
+
+#include <nil/filecoin/storage/proofs/core/merkle/tree_d_builder.hpp>
+
+using namespace nil::filecoin;
+
+BOOST_AUTO_TEST_SUITE(tree_d_builder_test_suite)
+
+typedef merkletree::tree_d_builder::node_type node_type;
+
+/// All levels of the tree over `data`, zero-padded to `leaves`, hashed with crypto3.
+std::vector<std::uint8_t> reference_tree(std::vector<std::uint8_t> data, std::size_t leaves) {
+    data.resize(leaves * merkletree::tree_d_builder::NODE_SIZE);
+    std::vector<std::uint8_t> tree = data;
+    std::vector<std::uint8_t> level = data;
+    while (level.size() > merkletree::tree_d_builder::NODE_SIZE) {
+        std::vector<std::uint8_t> parents;
+        for (std::size_t i = 0; i < level.size(); i += 2 * merkletree::tree_d_builder::NODE_SIZE) {
+            typename nil::crypto3::hashes::sha2<256>::digest_type digest =
+                nil::crypto3::hash<nil::crypto3::hashes::sha2<256>>(
+                    level.begin() + i, level.begin() + i + 2 * merkletree::tree_d_builder::NODE_SIZE);
+            std::vector<std::uint8_t> node(digest.begin(), digest.end());
+            node.back() &= 0x3f;
+            parents.insert(parents.end(), node.begin(), node.end());
+        }
+        tree.insert(tree.end(), parents.begin(), parents.end());
+        level = parents;
+    }
+    return tree;
+}
+
+BOOST_AUTO_TEST_CASE(test_incremental_matches_reference) {
+    const boost::filesystem::path path = boost::filesystem::temp_directory_path() / "tree_d_builder_test";
+    // Enough leaves for several flushes, the data stops short of the sector to exercise the padding.
+    const std::size_t leaves = 4 * merkletree::TREE_D_FLUSH_NODES;
+    std::vector<std::uint8_t> data(leaves * merkletree::tree_d_builder::NODE_SIZE - 12345);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<std::uint8_t>(i * 131 + (i >> 9));
+    }
+
+    merkletree::tree_d_builder builder(leaves, path.string());
+    for (std::size_t offset = 0, chunk = 1; offset < data.size(); offset += chunk, chunk = chunk * 7 % 65537) {
+        chunk = std::min(chunk, data.size() - offset);
+        builder.append(data.data() + offset, chunk);
+    }
+    const node_type root = builder.finish();
+
+    const std::vector<std::uint8_t> expected = reference_tree(data, leaves);
+    BOOST_CHECK(std::equal(root.begin(), root.end(), expected.end() - merkletree::tree_d_builder::NODE_SIZE));
+
+    std::ifstream stored(path.string(), std::ios::binary);
+    const std::vector<std::uint8_t> tree((std::istreambuf_iterator<char>(stored)), std::istreambuf_iterator<char>());
+    BOOST_CHECK(tree == expected);
+    BOOST_CHECK(!boost::filesystem::exists(path.string() + ".partial"));
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
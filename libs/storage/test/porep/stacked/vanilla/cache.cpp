@@ -30,7 +30,13 @@
 #include <boost/test/data/test_case.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <fstream>
+#include <random>
+
 #include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_codec.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/cache_writer.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/shared_cache.hpp>
 
 using namespace nil::filecoin;
 
@@ -88,4 +94,165 @@ BOOST_AUTO_TEST_CASE(test_read_partial_range) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_compressed_round_trip) {
+    using namespace nil::filecoin::stacked::vanilla;
+
+    const std::uint64_t nodes = 3 * COMPRESSED_BLOCK_NODES + 17;
+    const std::string path = "/tmp/filecoin-compressed-parent-cache-test.cache";
+
+    std::mt19937 rng(7);
+    std::vector<std::uint32_t> parents(nodes * DEGREE);
+    for (std::uint64_t node = 2; node < nodes; ++node) {
+        for (std::size_t i = 0; i < BASE_DEGREE; ++i) {
+            parents[node * DEGREE + i] = node - 1 - rng() % std::min<std::uint64_t>(node - 1, 1024);
+        }
+        for (std::size_t i = BASE_DEGREE; i < DEGREE; ++i) {
+            parents[node * DEGREE + i] = rng() % nodes;
+        }
+    }
+
+    write_compressed_parent_cache(path, nodes, [&](std::uint64_t first, std::size_t count, std::uint32_t *out) {
+        std::copy(parents.begin() + first * DEGREE, parents.begin() + (first + count) * DEGREE, out);
+    });
+
+    BOOST_CHECK(compressed_cache_reader::is_compressed(path));
+    compressed_cache_reader reader(path);
+    BOOST_CHECK_EQUAL(reader.nodes(), nodes);
+    BOOST_CHECK(reader.verify());
+
+    // A range straddling block boundaries.
+    const std::uint64_t first = COMPRESSED_BLOCK_NODES - 5;
+    const std::size_t count = COMPRESSED_BLOCK_NODES + 10;
+    std::vector<std::uint32_t> decoded(count * DEGREE);
+    reader.decode_range(first, count, decoded.data());
+    BOOST_CHECK(std::equal(decoded.begin(), decoded.end(), parents.begin() + first * DEGREE));
+
+    // Flipping a payload byte must be caught by the block checksums.
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(-100, std::ios::end);
+        const char byte = char(file.get() ^ 1);
+        file.seekp(-100, std::ios::end);
+        file.put(byte);
+    }
+    BOOST_CHECK(!compressed_cache_reader(path).verify());
+
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_resumed_generation) {
+    using namespace nil::filecoin::stacked::vanilla;
+
+    const std::uint64_t nodes = 3 * GENERATION_SEGMENT_NODES + 123;
+
+    std::vector<std::uint32_t> parents(nodes * DEGREE);
+    for (std::uint64_t node = 1; node < nodes; ++node) {
+        for (std::size_t i = 0; i < DEGREE; ++i) {
+            parents[node * DEGREE + i] = i < BASE_DEGREE ? node - 1 - i % node : (node * 7919 + i) % nodes;
+        }
+    }
+    const auto fill = [&](std::uint64_t first, std::size_t count, std::uint32_t *out) {
+        std::copy(parents.begin() + first * DEGREE, parents.begin() + (first + count) * DEGREE, out);
+    };
+
+    for (std::uint32_t format : {RAW_PARENT_CACHE_FORMAT, COMPRESSED_PARENT_CACHE_FORMAT}) {
+        const std::string path = "/tmp/filecoin-parent-cache-generation-test-" + std::to_string(format) + ".cache";
+
+        // An interrupted generation leaves no cache behind, only its partial state. A single thread generates
+        // the segments in order, so both segments before the failing one are complete.
+        BOOST_CHECK_THROW(write_parent_cache(
+                              path, format, nodes,
+                              [&](std::uint64_t first, std::size_t count, std::uint32_t *out) {
+                                  if (first >= 2 * GENERATION_SEGMENT_NODES) {
+                                      throw std::runtime_error("interrupted");
+                                  }
+                                  fill(first, count, out);
+                              },
+                              1),
+                          std::runtime_error);
+        BOOST_CHECK(!boost::filesystem::exists(path));
+        BOOST_CHECK(boost::filesystem::exists(parent_cache_progress_path(path)));
+
+        // The resumed generation must not generate the completed segments again.
+        std::uint64_t reported = 0;
+        write_parent_cache(
+            path, format, nodes,
+            [&](std::uint64_t first, std::size_t count, std::uint32_t *out) {
+                if (first < 2 * GENERATION_SEGMENT_NODES) {
+                    throw std::runtime_error("completed segment generated again");
+                }
+                fill(first, count, out);
+            },
+            2, [&](std::uint64_t done, std::uint64_t total) { reported = done; });
+        BOOST_CHECK_EQUAL(reported, nodes);
+        BOOST_CHECK(!boost::filesystem::exists(parent_cache_progress_path(path)));
+        BOOST_CHECK(*verify_parent_cache_digest(path));
+
+        std::vector<std::uint32_t> decoded(nodes * DEGREE);
+        if (format == COMPRESSED_PARENT_CACHE_FORMAT) {
+            compressed_cache_reader(path).decode_range(0, nodes, decoded.data());
+        } else {
+            std::ifstream file(path, std::ios::binary);
+            file.read(reinterpret_cast<char *>(decoded.data()), decoded.size() * sizeof(std::uint32_t));
+        }
+        BOOST_CHECK(decoded == parents);
+
+        std::remove(path.c_str());
+        std::remove(parent_cache_digest_path(path).c_str());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_shared_publish_attach) {
+    using namespace nil::filecoin::stacked::vanilla;
+
+    const std::uint64_t nodes = 1000;
+    const std::string path = "/tmp/filecoin-shared-parent-cache-test.cache";
+    const std::string shared_dir = "/dev/shm";
+
+    std::vector<std::uint32_t> parents(nodes * DEGREE);
+    for (std::size_t i = 0; i < parents.size(); ++i) {
+        parents[i] = (i * 2654435761u) % nodes;
+    }
+    {
+        std::ofstream file(path, std::ios::binary);
+        for (std::uint32_t parent : parents) {
+            const char bytes[4] = {char(parent), char(parent >> 8), char(parent >> 16), char(parent >> 24)};
+            file.write(bytes, 4);
+        }
+    }
+    std::remove(shared_parent_cache_path(shared_dir, path).c_str());
+
+    BOOST_CHECK(!shared_parent_cache::attach(shared_dir, path));
+    {
+        shared_parent_cache_publisher publisher(shared_dir, path);
+        const auto shared = shared_parent_cache::attach(shared_dir, path);
+        BOOST_REQUIRE(shared);
+        BOOST_CHECK_EQUAL(shared->nodes(), nodes);
+        BOOST_CHECK(std::equal(parents.begin(), parents.end(), shared->entries()));
+    }
+    // The published copy outlives its publisher.
+    BOOST_CHECK(shared_parent_cache::attach(shared_dir, path));
+    BOOST_CHECK(shared_parent_cache::attach(shared_dir, path, true));
+
+    // A damaged entry is only caught when verifying.
+    {
+        std::fstream shared(shared_parent_cache_path(shared_dir, path),
+                            std::ios::binary | std::ios::in | std::ios::out);
+        shared.seekp(SHARED_PARENT_CACHE_HEADER_SIZE + 4 * DEGREE);
+        shared.put(char(0xff));
+    }
+    BOOST_CHECK(shared_parent_cache::attach(shared_dir, path));
+    BOOST_CHECK(!shared_parent_cache::attach(shared_dir, path, true));
+
+    // A copy published from another version of the cache file is ignored.
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+        file.write("\0\0\0\0", 4);
+    }
+    BOOST_CHECK(!shared_parent_cache::attach(shared_dir, path));
+
+    std::remove(shared_parent_cache_path(shared_dir, path).c_str());
+    std::remove(path.c_str());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
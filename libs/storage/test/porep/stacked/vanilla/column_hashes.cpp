@@ -0,0 +1,105 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE vanilla_column_hashes_test
+
+#include <boost/test/unit_test.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <nil/filecoin/storage/proofs/core/crypto/poseidon_batch.hpp>
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/multicore/column_hashes.hpp>
+
+using namespace nil::filecoin;
+using namespace nil::filecoin::stacked::vanilla::detail::processing::multicore;
+
+typedef std::array<std::uint8_t, fr::BYTES> digest_type;
+
+BOOST_AUTO_TEST_SUITE(vanilla_column_hashes_test_suite)
+
+/// `layers` layers of `nodes` canonical pseudo-random field elements.
+std::vector<std::vector<digest_type>> sample_layers(std::size_t layers, std::size_t nodes) {
+    std::vector<std::vector<digest_type>> labels(layers, std::vector<digest_type>(nodes));
+    std::uint64_t x = 0x9e3779b97f4a7c15;
+    for (std::vector<digest_type> &layer : labels) {
+        for (digest_type &label : layer) {
+            for (std::uint8_t &byte : label) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                byte = static_cast<std::uint8_t>(x);
+            }
+            label[fr::BYTES - 1] &= 0x3f;
+        }
+    }
+    return labels;
+}
+
+/// Hashes the columns through the pipeline with the batched hasher and compares every hash with the
+/// one of the column hashed on its own by the scalar hasher.
+template<std::size_t Layers>
+void check_pipeline_matches_single_column() {
+    // Neither a multiple of the batch nor of the hashing chunk, so that partial batches and chunks are hashed.
+    const std::size_t nodes = 2 * COLUMN_HASH_CHUNK + 77;
+    const std::size_t batch_nodes = 3 * COLUMN_HASH_CHUNK / 2;
+    const std::vector<std::vector<digest_type>> labels = sample_layers(Layers, nodes);
+
+    std::vector<digest_type> hashes(nodes);
+    std::uint64_t sunk = 0;
+    build_column_hashes<digest_type>(
+        Layers, nodes, batch_nodes, 3,
+        [&](std::size_t layer, std::uint64_t first, std::uint64_t count, digest_type *out) {
+            std::copy(labels[layer].begin() + first, labels[layer].begin() + first + count, out);
+        },
+        [&](const digest_type *columns, std::size_t count, digest_type *column_hashes) {
+            poseidon::hash_columns(Layers, columns->data(), count, column_hashes->data());
+        },
+        [&](std::uint64_t first, std::uint64_t count, const digest_type *batch_hashes) {
+            BOOST_CHECK_EQUAL(first, sunk);
+            std::copy(batch_hashes, batch_hashes + count, hashes.begin() + first);
+            sunk += count;
+        });
+    BOOST_CHECK_EQUAL(sunk, nodes);
+
+    for (std::size_t node = 0; node < nodes; ++node) {
+        std::array<digest_type, Layers> column;
+        for (std::size_t layer = 0; layer < Layers; ++layer) {
+            column[layer] = labels[layer][node];
+        }
+        digest_type expected;
+        poseidon::hash_batch_scalar<Layers>(column.data()->data(), 1, expected.data());
+        BOOST_CHECK(hashes[node] == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_pipeline_matches_single_column) {
+    check_pipeline_matches_single_column<2>();
+    check_pipeline_matches_single_column<11>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
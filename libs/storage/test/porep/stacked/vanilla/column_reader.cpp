@@ -0,0 +1,126 @@
+//---------------------------------------------------------------------------//
+//  MIT License
+//
+//  Copyright (c) 2020-2021 Mikhail Komarov <nemo@nil.foundation>
+//  Copyright (c) 2020-2021 Nikita Kaskov <nemo@nil.foundation>
+
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//  SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#define BOOST_TEST_MODULE vanilla_column_reader_test
+
+#include <boost/test/unit_test.hpp>
+
+#include <array>
+#include <fstream>
+#include <random>
+
+#include <boost/filesystem.hpp>
+
+#include <nil/filecoin/storage/proofs/porep/stacked/vanilla/detail/processing/multicore/column_reader.hpp>
+
+using namespace nil::filecoin;
+using namespace nil::filecoin::stacked::vanilla::detail::processing::multicore;
+
+BOOST_AUTO_TEST_SUITE(column_reader_test_suite)
+
+BOOST_AUTO_TEST_CASE(test_read_columns_matches_single_reads) {
+    const boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(directory);
+
+    const std::size_t layers = 11;
+    const std::uint64_t layer_nodes = 4 * COLUMN_READ_MAX_NODES;
+    std::mt19937_64 rng(42);
+
+    std::vector<std::vector<std::uint8_t>> labels(layers, std::vector<std::uint8_t>(layer_nodes * NODE_SIZE));
+    std::vector<std::string> paths;
+    for (std::size_t layer = 0; layer < layers; ++layer) {
+        for (std::uint8_t &byte : labels[layer]) {
+            byte = static_cast<std::uint8_t>(rng());
+        }
+        paths.push_back((directory / ("layer-" + std::to_string(layer + 1))).string());
+        std::ofstream out(paths.back(), std::ios::binary);
+        out.write(reinterpret_cast<const char *>(labels[layer].data()), labels[layer].size());
+    }
+
+    // Unsorted, with repeated, adjacent, nearby and distant nodes, and the first and last node.
+    std::vector<std::uint64_t> nodes = {7, 3, 7, 8, 9, 60, 0, layer_nodes - 1, 3 * COLUMN_READ_MAX_NODES};
+    for (std::size_t i = 0; i < 500; ++i) {
+        nodes.push_back(rng() % layer_nodes);
+    }
+
+    for (std::size_t threads : {1, 4}) {
+        std::vector<std::uint8_t> columns(nodes.size() * layers * NODE_SIZE);
+        read_columns(paths, nodes.data(), nodes.size(), columns.data(), threads);
+
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            for (std::size_t layer = 0; layer < layers; ++layer) {
+                BOOST_CHECK(std::equal(labels[layer].begin() + nodes[i] * NODE_SIZE,
+                                       labels[layer].begin() + (nodes[i] + 1) * NODE_SIZE,
+                                       columns.begin() + (i * layers + layer) * NODE_SIZE));
+            }
+        }
+    }
+
+    // A node past the end of a layer fails.
+    const std::uint64_t past_end = layer_nodes;
+    std::vector<std::uint8_t> column(layers * NODE_SIZE);
+    BOOST_CHECK_THROW(read_columns(paths, &past_end, 1, column.data(), 4), std::runtime_error);
+
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(test_column_set_reads_shared_nodes_once) {
+    const boost::filesystem::path directory =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(directory);
+
+    const std::size_t layers = 2;
+    const std::uint64_t layer_nodes = 256;
+    typedef std::array<std::uint8_t, NODE_SIZE> digest_type;
+
+    std::vector<std::string> paths;
+    for (std::size_t layer = 0; layer < layers; ++layer) {
+        std::vector<std::uint8_t> labels(layer_nodes * NODE_SIZE);
+        for (std::uint64_t node = 0; node < layer_nodes; ++node) {
+            labels[node * NODE_SIZE] = static_cast<std::uint8_t>(node);
+            labels[node * NODE_SIZE + 1] = static_cast<std::uint8_t>(layer);
+        }
+        paths.push_back((directory / ("layer-" + std::to_string(layer + 1))).string());
+        std::ofstream out(paths.back(), std::ios::binary);
+        out.write(reinterpret_cast<const char *>(labels.data()), labels.size());
+    }
+
+    // Two challenges sharing parents 5 and 200.
+    const column_set<digest_type> set(paths, {10, 5, 200, 3, 11, 5, 200, 255}, 2);
+    BOOST_CHECK_EQUAL(set.size(), 6);
+    for (std::uint64_t node : {3, 5, 10, 11, 200, 255}) {
+        const digest_type *column = set.column(node);
+        for (std::size_t layer = 0; layer < layers; ++layer) {
+            BOOST_CHECK_EQUAL(column[layer][0], node);
+            BOOST_CHECK_EQUAL(column[layer][1], layer);
+        }
+    }
+
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_SUITE_END()